@@ -0,0 +1,263 @@
+// Decoder throughput benchmark.
+//
+// Drives the same `EnrichableSpiDecoder` used by `EnrichableSpiAnalyzer`
+// over generated waveforms and reports frames/s, edges/s, heap allocations
+// per frame and peak RSS for every CPOL/CPHA, word size and enable line
+// combination.  Run it before and after a decoder change and compare.
+//
+//   enrichable_spi_decoder_benchmark [--bits N] [--repeat N] [--threads N] [--filter TEXT] [--csv]
+//
+// `--threads` lets cases with an enable line decode in parallel segments.
+
+#include "EnrichableSpiAnalyzerSettings.h"
+#include "EnrichableSpiHeadless.h"
+#include "SyntheticSpiCapture.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static std::atomic<U64> allocationCount( 0 );
+
+void* operator new( size_t size )
+{
+	allocationCount++;
+	void* p = malloc( size ? size : 1 );
+	if( p == NULL )
+		throw std::bad_alloc();
+	return p;
+}
+
+void operator delete( void* p ) noexcept
+{
+	free( p );
+}
+
+void operator delete( void* p, size_t ) noexcept
+{
+	free( p );
+}
+
+static U64 GetPeakRssKb( const struct rusage& usage )
+{
+#ifdef __APPLE__
+	return usage.ru_maxrss / 1024;
+#else
+	return usage.ru_maxrss;
+#endif
+}
+
+struct BenchmarkResult
+{
+	U64 frames;
+	U64 edges;
+	U64 allocations;
+	double seconds;
+	bool valid;
+};
+
+static BenchmarkResult RunWorkload( const SyntheticSpiWorkload& workload, U32 repeat, U32 threads )
+{
+	EnrichableSpiCapture capture;
+	capture.mSampleRate = 100000000;
+	std::vector<U64> expectedMosi;
+	std::vector<U64> expectedMiso;
+	GenerateSyntheticSpiCapture( workload, &capture, &expectedMosi, &expectedMiso );
+
+	EnrichableSpiAnalyzerSettings settings;
+	workload.ApplyTo( &settings );
+
+	BenchmarkResult best;
+	best.seconds = -1;
+
+	for( U32 r = 0; r < repeat; r++ )
+	{
+		EnrichableSpiHeadlessAnalyzer analyzer( &settings, &capture );
+		analyzer.SetThreadCount( threads );
+
+		U64 allocationsBefore = allocationCount;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		analyzer.Run( NULL );
+		std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+		U64 allocations = allocationCount - allocationsBefore;
+
+		HeadlessSpiResults& results = analyzer.GetResults();
+		BenchmarkResult result;
+		result.frames = results.GetNumFrames();
+		result.edges = capture.GetEdgeCount();
+		result.allocations = allocations;
+		result.seconds = std::chrono::duration<double>( end - start ).count();
+
+		// Every generated word must come back, in order; glitches only
+		// produce (discarded) partial words, never frames.
+		result.valid = results.mFrames.size() == expectedMosi.size();
+		for( U64 i = 0; result.valid && i < results.mFrames.size(); i++ )
+		{
+			if( results.mFrames[i].mData1 != expectedMosi[i] || results.mFrames[i].mData2 != expectedMiso[i] )
+				result.valid = false;
+		}
+
+		if( best.seconds < 0 || result.seconds < best.seconds )
+			best = result;
+	}
+
+	return best;
+}
+
+// Each case runs in a child process, so the peak RSS reported for it is its
+// own rather than the largest of every case run before it.
+static bool RunWorkloadInChild( const SyntheticSpiWorkload& workload, U32 repeat, U32 threads, BenchmarkResult* result, U64* peakRssKb )
+{
+	int fds[2];
+	if( pipe( fds ) != 0 )
+		return false;
+
+	pid_t pid = fork();
+	if( pid < 0 )
+	{
+		close( fds[0] );
+		close( fds[1] );
+		return false;
+	}
+	if( pid == 0 )
+	{
+		close( fds[0] );
+		BenchmarkResult childResult = RunWorkload( workload, repeat, threads );
+		ssize_t written = write( fds[1], &childResult, sizeof( childResult ) );
+		_exit( written == ssize_t( sizeof( childResult ) ) ? 0 : 1 );
+	}
+
+	close( fds[1] );
+	size_t received = 0;
+	while( received < sizeof( *result ) )
+	{
+		ssize_t count = read( fds[0], (char*)result + received, sizeof( *result ) - received );
+		if( count <= 0 )
+			break;
+		received += count;
+	}
+	close( fds[0] );
+
+	int status;
+	struct rusage usage;
+	if( wait4( pid, &status, 0, &usage ) != pid )
+		return false;
+
+	*peakRssKb = GetPeakRssKb( usage );
+	return received == sizeof( *result ) && WIFEXITED( status ) && WEXITSTATUS( status ) == 0;
+}
+
+int main( int argc, char** argv )
+{
+	U64 bitsPerCase = 4000000;
+	U32 repeat = 3;
+	U32 threads = 1;
+	std::string filter;
+	bool csv = false;
+
+	for( int i = 1; i < argc; i++ )
+	{
+		if( strcmp( argv[i], "--bits" ) == 0 && i + 1 < argc )
+			bitsPerCase = strtoull( argv[++i], NULL, 10 );
+		else if( strcmp( argv[i], "--repeat" ) == 0 && i + 1 < argc )
+			repeat = strtoul( argv[++i], NULL, 10 );
+		else if( strcmp( argv[i], "--threads" ) == 0 && i + 1 < argc )
+			threads = strtoul( argv[++i], NULL, 10 );
+		else if( strcmp( argv[i], "--filter" ) == 0 && i + 1 < argc )
+			filter = argv[++i];
+		else if( strcmp( argv[i], "--csv" ) == 0 )
+			csv = true;
+		else
+		{
+			std::cerr << "usage: " << argv[0] << " [--bits N] [--repeat N] [--threads N] [--filter TEXT] [--csv]\n";
+			return 2;
+		}
+	}
+	if( repeat == 0 )
+		repeat = 1;
+
+	const BitState polarities[] = { BIT_LOW, BIT_HIGH };
+	const AnalyzerEnums::Edge phases[] = { AnalyzerEnums::LeadingEdge, AnalyzerEnums::TrailingEdge };
+	const U32 widths[] = { 8, 16, 32, 64 };
+	const SyntheticSpiWorkload::EnableMode enableModes[] = {
+		SyntheticSpiWorkload::NoEnable,
+		SyntheticSpiWorkload::WithEnable,
+		SyntheticSpiWorkload::GlitchyEnable
+	};
+
+	if( csv )
+		std::cout << "case,frames,edges,seconds,frames_per_s,edges_per_s,allocs_per_frame,peak_rss_kb,valid\n";
+	else
+		std::cout << std::left << std::setw( 36 ) << "case"
+			<< std::right << std::setw( 10 ) << "frames"
+			<< std::setw( 14 ) << "frames/s"
+			<< std::setw( 14 ) << "edges/s"
+			<< std::setw( 14 ) << "allocs/frame"
+			<< std::setw( 14 ) << "peak RSS kB"
+			<< "\n";
+
+	bool allValid = true;
+	for( BitState polarity : polarities )
+	for( AnalyzerEnums::Edge phase : phases )
+	for( U32 width : widths )
+	for( SyntheticSpiWorkload::EnableMode enableMode : enableModes )
+	{
+		SyntheticSpiWorkload workload;
+		workload.mClockInactiveState = polarity;
+		workload.mDataValidEdge = phase;
+		workload.mBitsPerTransfer = width;
+		workload.mEnableMode = enableMode;
+		workload.mWordCount = bitsPerCase / width;
+
+		std::string name = workload.GetName();
+		if( !filter.empty() && name.find( filter ) == std::string::npos )
+			continue;
+
+		BenchmarkResult result;
+		U64 peakRssKb;
+		if( !RunWorkloadInChild( workload, repeat, threads, &result, &peakRssKb ) )
+		{
+			std::cerr << name << ": benchmark process failed\n";
+			allValid = false;
+			continue;
+		}
+		allValid = allValid && result.valid;
+
+		double framesPerSecond = result.frames / result.seconds;
+		double edgesPerSecond = result.edges / result.seconds;
+		double allocationsPerFrame = result.frames ? double( result.allocations ) / result.frames : 0;
+
+		if( csv )
+		{
+			std::cout << name << "," << result.frames << "," << result.edges << "," << result.seconds << ","
+				<< framesPerSecond << "," << edgesPerSecond << "," << allocationsPerFrame << ","
+				<< peakRssKb << "," << ( result.valid ? "yes" : "no" ) << "\n";
+		}
+		else
+		{
+			std::cout << std::left << std::setw( 36 ) << name
+				<< std::right << std::setw( 10 ) << result.frames
+				<< std::fixed << std::setprecision( 0 )
+				<< std::setw( 14 ) << framesPerSecond
+				<< std::setw( 14 ) << edgesPerSecond
+				<< std::setprecision( 3 )
+				<< std::setw( 14 ) << allocationsPerFrame
+				<< std::setw( 14 ) << peakRssKb
+				<< ( result.valid ? "" : "  DECODE MISMATCH" )
+				<< "\n";
+		}
+	}
+
+	return allValid ? 0 : 1;
+}
@@ -0,0 +1,209 @@
+// Packed sample conversion benchmark.
+//
+// Packs generated SPI waveforms into raw samples of 1, 2, 4 and 8 bytes and
+// converts them back into transitions with every `PackedSampleReader` kernel
+// the CPU supports, reporting samples/s and the speedup over the scalar
+// kernel.  Every kernel must reproduce the scalar kernel's transitions -- and
+// the generated ones -- exactly; the benchmark exits non-zero otherwise.
+//
+//   enrichable_spi_packed_sample_benchmark [--bits N] [--repeat N] [--csv]
+
+#include "EnrichableSpiPackedSamples.h"
+#include "SyntheticSpiCapture.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Toggles every few samples outside of the decoded channels, so masking
+// is exercised too.
+#define NOISE_CHANNEL 5
+#define NOISE_INTERVAL 3
+// Fed to the reader in chunks that don't line up with the kernels' blocks.
+#define CHUNK_SAMPLES 1000003
+
+static U64 PackCapture( const EnrichableSpiCapture& capture, U32 bytesPerSample, U64 padding, std::vector<U8>* samples )
+{
+	U64 count = padding;
+	for( const CaptureChannel& channel : capture.mChannels )
+	{
+		if( !channel.mTransitions.empty() && channel.mTransitions.back() + padding > count )
+			count = channel.mTransitions.back() + padding;
+	}
+
+	samples->assign( count * bytesPerSample, 0 );
+	for( U32 index = 0; index < capture.mChannels.size(); index++ )
+	{
+		const CaptureChannel& channel = capture.mChannels[index];
+		U8* lane = &( *samples )[index / 8];
+		U8 bit = U8( 1 << ( index % 8 ) );
+
+		bool high = channel.mInitialState == BIT_HIGH;
+		size_t next = 0;
+		for( U64 s = 0; s < count; s++ )
+		{
+			while( next < channel.mTransitions.size() && channel.mTransitions[next] == s )
+			{
+				high = !high;
+				next++;
+			}
+			if( high )
+				lane[s * bytesPerSample] |= bit;
+		}
+	}
+
+	for( U64 s = 0; s < count; s++ )
+	{
+		if( ( s / NOISE_INTERVAL ) & 1 )
+			( *samples )[s * bytesPerSample + ( bytesPerSample - 1 )] |= 1 << NOISE_CHANNEL;
+	}
+
+	return count;
+}
+
+static bool SameChannels( const EnrichableSpiCapture& a, const EnrichableSpiCapture& b, U32 channels )
+{
+	for( U32 i = 0; i < channels; i++ )
+	{
+		if( i >= a.mChannels.size() || i >= b.mChannels.size() )
+			return false;
+		if( a.mChannels[i].mInitialState != b.mChannels[i].mInitialState || a.mChannels[i].mTransitions != b.mChannels[i].mTransitions )
+			return false;
+	}
+	return true;
+}
+
+static double Convert( const std::vector<U8>& samples, U32 bytesPerSample, U64 channelMask, PackedSampleKernel kernel, U32 repeat, EnrichableSpiCapture* capture )
+{
+	U64 count = samples.size() / bytesPerSample;
+	double best = -1;
+
+	for( U32 r = 0; r < repeat; r++ )
+	{
+		capture->mChannels.clear();
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		PackedSampleReader reader( capture, bytesPerSample, channelMask, kernel );
+		for( U64 offset = 0; offset < count; offset += CHUNK_SAMPLES )
+			reader.AddSamples( &samples[offset * bytesPerSample], count - offset < CHUNK_SAMPLES ? count - offset : CHUNK_SAMPLES );
+		double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+
+		if( best < 0 || seconds < best )
+			best = seconds;
+	}
+
+	return best;
+}
+
+int main( int argc, char** argv )
+{
+	U64 bitsPerCase = 1000000;
+	U32 repeat = 3;
+	bool csv = false;
+
+	for( int i = 1; i < argc; i++ )
+	{
+		if( strcmp( argv[i], "--bits" ) == 0 && i + 1 < argc )
+			bitsPerCase = strtoull( argv[++i], NULL, 10 );
+		else if( strcmp( argv[i], "--repeat" ) == 0 && i + 1 < argc )
+			repeat = strtoul( argv[++i], NULL, 10 );
+		else if( strcmp( argv[i], "--csv" ) == 0 )
+			csv = true;
+		else
+		{
+			std::cerr << "usage: " << argv[0] << " [--bits N] [--repeat N] [--csv]\n";
+			return 2;
+		}
+	}
+	if( repeat == 0 )
+		repeat = 1;
+
+	const U32 widths[] = { 1, 2, 4, 8 };
+	// Samples per clock half period: a fast bus, and a slow one where most
+	// samples repeat their predecessor.
+	const U32 halfPeriods[] = { 4, 50 };
+	const PackedSampleKernel kernels[] = { PackedSampleScalar, PackedSampleSse2, PackedSampleAvx2, PackedSampleNeon };
+	const U64 channelMask = ( 1 << SYNTHETIC_MOSI_CHANNEL ) | ( 1 << SYNTHETIC_MISO_CHANNEL )
+		| ( 1 << SYNTHETIC_CLOCK_CHANNEL ) | ( 1 << SYNTHETIC_ENABLE_CHANNEL );
+
+	if( csv )
+		std::cout << "case,kernel,samples,seconds,samples_per_s,speedup,valid\n";
+	else
+		std::cout << "best kernel: " << GetPackedSampleKernelName( GetBestPackedSampleKernel() ) << "\n"
+			<< std::left << std::setw( 28 ) << "case"
+			<< std::setw( 10 ) << "kernel"
+			<< std::right << std::setw( 12 ) << "samples"
+			<< std::setw( 16 ) << "samples/s"
+			<< std::setw( 10 ) << "speedup"
+			<< "\n";
+
+	bool allValid = true;
+	for( U32 halfPeriod : halfPeriods )
+	for( U32 width : widths )
+	{
+		SyntheticSpiWorkload workload;
+		workload.mEnableMode = SyntheticSpiWorkload::GlitchyEnable;
+		workload.mHalfPeriodSamples = halfPeriod;
+		workload.mWordCount = bitsPerCase / workload.mBitsPerTransfer;
+
+		EnrichableSpiCapture generated;
+		std::vector<U64> expectedMosi;
+		std::vector<U64> expectedMiso;
+		GenerateSyntheticSpiCapture( workload, &generated, &expectedMosi, &expectedMiso );
+
+		std::vector<U8> samples;
+		U64 count = PackCapture( generated, width, 10 * halfPeriod, &samples );
+
+		std::stringstream name;
+		name << width * 8 << "ch/" << halfPeriod << "-sample-half-period";
+
+		EnrichableSpiCapture scalar;
+		double scalarSeconds = 0;
+		for( PackedSampleKernel kernel : kernels )
+		{
+			if( !IsPackedSampleKernelSupported( kernel ) )
+				continue;
+
+			EnrichableSpiCapture converted;
+			double seconds = Convert( samples, width, channelMask, kernel, repeat, &converted );
+			if( kernel == PackedSampleScalar )
+			{
+				scalar = converted;
+				scalarSeconds = seconds;
+			}
+
+			bool valid = SameChannels( converted, scalar, SYNTHETIC_ENABLE_CHANNEL + 1 )
+				&& SameChannels( converted, generated, SYNTHETIC_ENABLE_CHANNEL + 1 )
+				&& converted.mChannels.size() == SYNTHETIC_ENABLE_CHANNEL + 1;
+			allValid = allValid && valid;
+
+			double samplesPerSecond = count / seconds;
+			double speedup = scalarSeconds / seconds;
+
+			if( csv )
+			{
+				std::cout << name.str() << "," << GetPackedSampleKernelName( kernel ) << "," << count << "," << seconds << ","
+					<< samplesPerSecond << "," << speedup << "," << ( valid ? "yes" : "no" ) << "\n";
+			}
+			else
+			{
+				std::cout << std::left << std::setw( 28 ) << name.str()
+					<< std::setw( 10 ) << GetPackedSampleKernelName( kernel )
+					<< std::right << std::setw( 12 ) << count
+					<< std::fixed << std::setprecision( 0 )
+					<< std::setw( 16 ) << samplesPerSecond
+					<< std::setprecision( 2 )
+					<< std::setw( 10 ) << speedup
+					<< ( valid ? "" : "  MISMATCH" )
+					<< "\n";
+			}
+		}
+	}
+
+	return allValid ? 0 : 1;
+}
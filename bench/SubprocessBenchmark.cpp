@@ -0,0 +1,262 @@
+// Script round-trip latency benchmark.
+//
+// Starts each reference script in bench/scripts through
+// `EnrichableAnalyzerSubprocess` and times `EmitMarker`, `EmitBubble`,
+// `EmitTabular` and `GetFeatureEnablement` round-trips, reporting
+// p50/p99/p99.9 latency and sustained messages/s per message type, followed
+// by the cost of starting the script afresh ("start") and of reusing it
+// through a `reset` message ("reuse") when the analyzer reruns.
+//
+// The "pipe" transport talks to the script and records the conversation;
+// the "replay" transport then answers the same requests from that recording
+// without the script, which leaves only the analyzer's side of a round-trip.
+//
+//   enrichable_spi_subprocess_benchmark [--iterations N] [--script COMMAND] [--slow-delay MS]
+
+#include "EnrichableAnalyzerSubprocess.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <signal.h>
+#include <unistd.h>
+
+#define START_ITERATIONS 20
+
+// Exposes the feature query, and lets `bubble` be measured on its own for
+// scripts that also support `bubble2`.
+class BenchmarkSubprocess : public EnrichableAnalyzerSubprocess
+{
+public:
+	bool QueryFeature( const char* feature )
+	{
+		return GetFeatureEnablement( feature );
+	}
+
+	bool CombinedBubbleEnabled()
+	{
+		return featureCombinedBubble;
+	}
+
+	void SetCombinedBubbleEnabled( bool enabled )
+	{
+		featureCombinedBubble = enabled;
+	}
+};
+
+struct ScriptCase
+{
+	std::string name;
+	std::string command;
+	U32 iterations;
+};
+
+struct LatencySummary
+{
+	double p50;
+	double p99;
+	double p999;
+	double messagesPerSecond;
+};
+
+static LatencySummary Summarize( std::vector<double>& latencies, double totalSeconds )
+{
+	LatencySummary summary;
+	std::sort( latencies.begin(), latencies.end() );
+
+	size_t count = latencies.size();
+	summary.p50 = latencies[ std::min( count - 1, size_t( count * 0.50 ) ) ];
+	summary.p99 = latencies[ std::min( count - 1, size_t( count * 0.99 ) ) ];
+	summary.p999 = latencies[ std::min( count - 1, size_t( count * 0.999 ) ) ];
+	summary.messagesPerSecond = count / totalSeconds;
+
+	return summary;
+}
+
+static void PrintRow( const std::string& script, const std::string& transport, const char* messageType, const LatencySummary& summary )
+{
+	std::cout << std::left << std::setw( 16 ) << script
+		<< std::setw( 10 ) << transport
+		<< std::setw( 10 ) << messageType
+		<< std::right << std::fixed << std::setprecision( 1 )
+		<< std::setw( 12 ) << summary.p50
+		<< std::setw( 12 ) << summary.p99
+		<< std::setw( 12 ) << summary.p999
+		<< std::setprecision( 0 )
+		<< std::setw( 14 ) << summary.messagesPerSecond
+		<< "\n";
+}
+
+static void RunScript( const ScriptCase& script, const std::string& transport, const std::string& recording )
+{
+	EnrichableScriptRecording::Mode recordingMode = transport == "replay" ? EnrichableScriptRecording::Replay : EnrichableScriptRecording::Record;
+
+	BenchmarkSubprocess subprocess;
+	subprocess.SetParserCommand( script.command );
+	subprocess.SetRecording( recording, recordingMode );
+	subprocess.Start();
+	subprocess.WaitUntilReady();
+
+	Frame frame;
+	frame.mStartingSampleInclusive = 0x3ae3012;
+	frame.mEndingSampleInclusive = 0x3ae309b9;
+	frame.mType = 0;
+	frame.mFlags = 0;
+
+	// `bubble2` rows time both channels' bubbles for a frame, as Logic
+	// asks for them on a full-duplex capture.
+	bool combinedBubble = subprocess.CombinedBubbleEnabled();
+	const char* messageTypes[] = { MARKER_PREFIX, BUBBLE_PREFIX, COMBINED_BUBBLE_PREFIX, TABULAR_PREFIX, FEATURE_PREFIX };
+	for( const char* messageType : messageTypes )
+	{
+		if( strcmp( messageType, COMBINED_BUBBLE_PREFIX ) == 0 && !combinedBubble )
+			continue;
+		subprocess.SetCombinedBubbleEnabled( strcmp( messageType, COMBINED_BUBBLE_PREFIX ) == 0 );
+
+		std::vector<double> latencies;
+		latencies.reserve( script.iterations );
+
+		std::chrono::steady_clock::time_point runStart = std::chrono::steady_clock::now();
+		for( U32 i = 0; i < script.iterations; i++ )
+		{
+			frame.mData1 = i & 0xff;
+			frame.mData2 = ~i & 0xff;
+
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			if( strcmp( messageType, MARKER_PREFIX ) == 0 )
+				subprocess.EmitMarker( i / 4, i, frame, 8 );
+			else if( strcmp( messageType, BUBBLE_PREFIX ) == 0 )
+				subprocess.EmitBubble( i / 4, i, frame, "mosi" );
+			else if( strcmp( messageType, COMBINED_BUBBLE_PREFIX ) == 0 )
+			{
+				subprocess.EmitBubble( i / 4, i, frame, "mosi" );
+				subprocess.EmitBubble( i / 4, i, frame, "miso" );
+			}
+			else if( strcmp( messageType, TABULAR_PREFIX ) == 0 )
+				subprocess.EmitTabular( i / 4, i, frame );
+			else
+				subprocess.QueryFeature( BUBBLE_PREFIX );
+			std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+			latencies.push_back( std::chrono::duration<double, std::micro>( end - start ).count() );
+		}
+		double totalSeconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - runStart ).count();
+
+		PrintRow( script.name, transport, messageType, Summarize( latencies, totalSeconds ) );
+	}
+
+	// Scripts that don't acknowledge `reset` are restarted instead, so
+	// their "reuse" matches their "start".
+	std::vector<double> starts;
+	std::vector<double> reuses;
+	double startSeconds = 0;
+	double reuseSeconds = 0;
+	// Restarts would start the recording over.
+	if( recordingMode == EnrichableScriptRecording::Record )
+		subprocess.SetRecording( "", EnrichableScriptRecording::Off );
+	for( U32 i = 0; i < START_ITERATIONS; i++ )
+	{
+		subprocess.Stop();
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		subprocess.SetParserCommand( script.command );
+		subprocess.Start();
+		subprocess.WaitUntilReady();
+		std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+		subprocess.SetParserCommand( script.command );
+		subprocess.Start();
+		subprocess.WaitUntilReady();
+		std::chrono::steady_clock::time_point reused = std::chrono::steady_clock::now();
+
+		starts.push_back( std::chrono::duration<double, std::micro>( started - start ).count() );
+		reuses.push_back( std::chrono::duration<double, std::micro>( reused - started ).count() );
+		startSeconds += std::chrono::duration<double>( started - start ).count();
+		reuseSeconds += std::chrono::duration<double>( reused - started ).count();
+	}
+	PrintRow( script.name, transport, "start", Summarize( starts, startSeconds ) );
+	PrintRow( script.name, transport, "reuse", Summarize( reuses, reuseSeconds ) );
+
+	subprocess.Stop();
+}
+
+int main( int argc, char** argv )
+{
+	U32 iterations = 20000;
+	std::string customScript;
+	std::string slowDelay = "1";
+
+	for( int i = 1; i < argc; i++ )
+	{
+		if( strcmp( argv[i], "--iterations" ) == 0 && i + 1 < argc )
+			iterations = strtoul( argv[++i], NULL, 10 );
+		else if( strcmp( argv[i], "--script" ) == 0 && i + 1 < argc )
+			customScript = argv[++i];
+		else if( strcmp( argv[i], "--slow-delay" ) == 0 && i + 1 < argc )
+			slowDelay = argv[++i];
+		else
+		{
+			std::cerr << "usage: " << argv[0] << " [--iterations N] [--script COMMAND] [--slow-delay MS]\n";
+			return 2;
+		}
+	}
+	if( iterations == 0 )
+		iterations = 1;
+
+	// A dead script would otherwise end the benchmark with SIGPIPE.
+	signal( SIGPIPE, SIG_IGN );
+
+	std::vector<ScriptCase> scripts;
+	if( !customScript.empty() )
+	{
+		ScriptCase custom = { "custom", customScript, iterations };
+		scripts.push_back( custom );
+	}
+	else
+	{
+		std::string scriptDir = ENRICHABLE_SPI_BENCH_SCRIPT_DIR;
+
+		ScriptCase nativeEcho = { "native-echo", ENRICHABLE_SPI_ECHO_SCRIPT, iterations };
+		ScriptCase pythonEcho = { "python-echo", "python3 " + scriptDir + "/echo.py", iterations };
+
+		// Each slow round-trip costs at least the delay; keep its run short.
+		double delayMs = atof( slowDelay.c_str() );
+		U32 slowIterations = iterations;
+		if( delayMs > 0 )
+			slowIterations = std::max( 1000u, std::min( iterations, U32( 2000.0 / delayMs ) ) );
+		ScriptCase slow = { "slow-responder", "python3 " + scriptDir + "/slow_responder.py " + slowDelay, slowIterations };
+
+		scripts.push_back( nativeEcho );
+		scripts.push_back( pythonEcho );
+		scripts.push_back( slow );
+	}
+
+	// Round-trips go over the stdin/stdout pipe pair; other transports slot
+	// in here as the subprocess grows them.  "replay" must follow "pipe",
+	// whose recording it answers from.
+	const char* transports[] = { "pipe", "replay" };
+	std::string recording = "/tmp/enrichable_spi_benchmark_" + std::to_string( getpid() ) + ".rec";
+
+	std::cout << std::left << std::setw( 16 ) << "script"
+		<< std::setw( 10 ) << "transport"
+		<< std::setw( 10 ) << "message"
+		<< std::right
+		<< std::setw( 12 ) << "p50 us"
+		<< std::setw( 12 ) << "p99 us"
+		<< std::setw( 12 ) << "p99.9 us"
+		<< std::setw( 14 ) << "msgs/s"
+		<< "\n";
+
+	for( const ScriptCase& script : scripts )
+		for( const char* transport : transports )
+			RunScript( script, transport, recording );
+	unlink( recording.c_str() );
+
+	return 0;
+}
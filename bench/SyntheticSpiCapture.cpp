@@ -0,0 +1,220 @@
+#include "SyntheticSpiCapture.h"
+#include "EnrichableSpiAnalyzerSettings.h"
+
+#include <sstream>
+
+namespace
+{
+	// Emits transitions onto a `CaptureChannel` while tracking its level.
+	class LineWriter
+	{
+	public:
+		LineWriter( CaptureChannel* channel, BitState initialState )
+		:	mChannel( channel ),
+			mState( initialState )
+		{
+			if( mChannel != NULL )
+				mChannel->mInitialState = initialState;
+		}
+
+		void Transition( U64 sample )
+		{
+			mState = Invert( mState );
+			if( mChannel != NULL )
+				mChannel->AddTransition( sample );
+		}
+
+		void TransitionIfNeeded( U64 sample, BitState state )
+		{
+			if( state != mState )
+				Transition( sample );
+		}
+
+	protected:
+		CaptureChannel* mChannel;
+		BitState mState;
+	};
+
+	U32 NextRandom( U32* state )
+	{
+		U32 x = *state;
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		*state = x;
+		return x;
+	}
+
+	BitState GetBit( U64 word, U32 bit, const SyntheticSpiWorkload& workload )
+	{
+		U32 shift = bit;
+		if( workload.mShiftOrder == AnalyzerEnums::MsbFirst )
+			shift = workload.mBitsPerTransfer - 1 - bit;
+
+		return ( ( word >> shift ) & 1 ) ? BIT_HIGH : BIT_LOW;
+	}
+}
+
+SyntheticSpiWorkload::SyntheticSpiWorkload()
+:	mClockInactiveState( BIT_LOW ),
+	mDataValidEdge( AnalyzerEnums::LeadingEdge ),
+	mShiftOrder( AnalyzerEnums::MsbFirst ),
+	mBitsPerTransfer( 8 ),
+	mEnableMode( WithEnable ),
+	mWordCount( 100000 ),
+	mWordsPerTransaction( 4 ),
+	mHalfPeriodSamples( 4 ),
+	mGlitchInterval( 7 ),
+	mSeed( 0x2545f491 )
+{
+}
+
+std::string SyntheticSpiWorkload::GetName() const
+{
+	std::stringstream ss;
+
+	ss << "cpol" << ( mClockInactiveState == BIT_LOW ? 0 : 1 );
+	ss << "/cpha" << ( mDataValidEdge == AnalyzerEnums::LeadingEdge ? 0 : 1 );
+	ss << "/" << mBitsPerTransfer << "bit";
+
+	switch( mEnableMode )
+	{
+	case NoEnable:
+		ss << "/no-enable";
+		break;
+	case WithEnable:
+		ss << "/enable";
+		break;
+	case GlitchyEnable:
+		ss << "/glitchy-enable";
+		break;
+	}
+
+	return ss.str();
+}
+
+void SyntheticSpiWorkload::ApplyTo( EnrichableSpiAnalyzerSettings* settings ) const
+{
+	settings->mMosiChannel = Channel( 0, SYNTHETIC_MOSI_CHANNEL );
+	settings->mMisoChannel = Channel( 0, SYNTHETIC_MISO_CHANNEL );
+	settings->mClockChannel = Channel( 0, SYNTHETIC_CLOCK_CHANNEL );
+	if( mEnableMode == NoEnable )
+		settings->mEnableChannel = UNDEFINED_CHANNEL;
+	else
+		settings->mEnableChannel = Channel( 0, SYNTHETIC_ENABLE_CHANNEL );
+
+	settings->mShiftOrder = mShiftOrder;
+	settings->mBitsPerTransfer = mBitsPerTransfer;
+	settings->mClockInactiveState = mClockInactiveState;
+	settings->mDataValidEdge = mDataValidEdge;
+	settings->mEnableActiveState = BIT_LOW;
+	settings->mParserCommand = "";
+}
+
+void GenerateSyntheticSpiCapture(
+	const SyntheticSpiWorkload& workload,
+	EnrichableSpiCapture* capture,
+	std::vector<U64>* expectedMosi,
+	std::vector<U64>* expectedMiso
+) {
+	capture->mChannels.clear();
+	capture->AddChannel( SYNTHETIC_MOSI_CHANNEL );
+	capture->AddChannel( SYNTHETIC_MISO_CHANNEL );
+	capture->AddChannel( SYNTHETIC_CLOCK_CHANNEL );
+	if( workload.mEnableMode != SyntheticSpiWorkload::NoEnable )
+		capture->AddChannel( SYNTHETIC_ENABLE_CHANNEL );
+
+	U64 bitsPerTransaction = U64( workload.mBitsPerTransfer ) * workload.mWordsPerTransaction;
+	U64 edgesPerChannel = ( workload.mWordCount + 1 ) * workload.mBitsPerTransfer * 2;
+	capture->mChannels[SYNTHETIC_CLOCK_CHANNEL].mTransitions.reserve( edgesPerChannel );
+	capture->mChannels[SYNTHETIC_MOSI_CHANNEL].mTransitions.reserve( edgesPerChannel / 2 + bitsPerTransaction );
+	capture->mChannels[SYNTHETIC_MISO_CHANNEL].mTransitions.reserve( edgesPerChannel / 2 + bitsPerTransaction );
+
+	LineWriter mosi( &capture->mChannels[SYNTHETIC_MOSI_CHANNEL], BIT_LOW );
+	LineWriter miso( &capture->mChannels[SYNTHETIC_MISO_CHANNEL], BIT_LOW );
+	LineWriter clock( &capture->mChannels[SYNTHETIC_CLOCK_CHANNEL], workload.mClockInactiveState );
+	LineWriter enable( capture->GetChannel( Channel( 0, SYNTHETIC_ENABLE_CHANNEL ) ), BIT_HIGH );
+	bool useEnable = workload.mEnableMode != SyntheticSpiWorkload::NoEnable;
+
+	U64 half = workload.mHalfPeriodSamples;
+	U64 mask = workload.mBitsPerTransfer == 64 ? ~0ull : ( ( 1ull << workload.mBitsPerTransfer ) - 1 );
+	U32 random = workload.mSeed;
+	U64 transaction = 0;
+	U64 sample = 10 * half;
+
+	expectedMosi->clear();
+	expectedMiso->clear();
+	expectedMosi->reserve( workload.mWordCount );
+	expectedMiso->reserve( workload.mWordCount );
+
+	U64 word = 0;
+	while( word < workload.mWordCount )
+	{
+		if( useEnable )
+			enable.Transition( sample );
+		sample += 2 * half;
+
+		bool glitch = workload.mEnableMode == SyntheticSpiWorkload::GlitchyEnable
+			&& workload.mGlitchInterval != 0
+			&& ( transaction % workload.mGlitchInterval ) == workload.mGlitchInterval - 1;
+
+		for( U32 w = 0; w < workload.mWordsPerTransaction && word < workload.mWordCount; w++, word++ )
+		{
+			U64 mosiWord = ( ( U64( NextRandom( &random ) ) << 32 ) | NextRandom( &random ) ) & mask;
+			U64 misoWord = ( ~mosiWord ) & mask;
+
+			// Drop enable halfway through the first word of a glitchy
+			// transaction, then resend the word from the start.
+			U32 attempts = ( glitch && w == 0 ) ? 2 : 1;
+			for( U32 attempt = 0; attempt < attempts; attempt++ )
+			{
+				U32 bits = workload.mBitsPerTransfer;
+				if( attempt + 1 < attempts )
+					bits = ( bits + 1 ) / 2;
+
+				for( U32 bit = 0; bit < bits; bit++ )
+				{
+					if( workload.mDataValidEdge == AnalyzerEnums::LeadingEdge )
+					{
+						mosi.TransitionIfNeeded( sample, GetBit( mosiWord, bit, workload ) );
+						miso.TransitionIfNeeded( sample, GetBit( misoWord, bit, workload ) );
+						sample += half;
+						clock.Transition( sample );  //data valid
+						sample += half;
+						clock.Transition( sample );  //data invalid
+					}else
+					{
+						clock.Transition( sample );  //data invalid
+						mosi.TransitionIfNeeded( sample, GetBit( mosiWord, bit, workload ) );
+						miso.TransitionIfNeeded( sample, GetBit( misoWord, bit, workload ) );
+						sample += half;
+						clock.Transition( sample );  //data valid
+						sample += half;
+					}
+				}
+
+				mosi.TransitionIfNeeded( sample, BIT_LOW );
+				miso.TransitionIfNeeded( sample, BIT_LOW );
+				sample += 2 * half;
+
+				if( attempt + 1 < attempts )
+				{
+					enable.Transition( sample );
+					sample += 2 * half;
+					enable.Transition( sample );
+					sample += 2 * half;
+				}
+			}
+
+			expectedMosi->push_back( mosiWord );
+			expectedMiso->push_back( misoWord );
+		}
+
+		if( useEnable )
+			enable.Transition( sample );
+		sample += 10 * half;
+		transaction++;
+	}
+
+	capture->mTriggerSample = 0;
+}
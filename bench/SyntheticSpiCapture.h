@@ -0,0 +1,51 @@
+#ifndef SYNTHETIC_SPI_CAPTURE_H
+#define SYNTHETIC_SPI_CAPTURE_H
+
+#include <AnalyzerTypes.h>
+#include "EnrichableSpiCapture.h"
+
+#include <string>
+#include <vector>
+
+class EnrichableSpiAnalyzerSettings;
+
+#define SYNTHETIC_MOSI_CHANNEL 0
+#define SYNTHETIC_MISO_CHANNEL 1
+#define SYNTHETIC_CLOCK_CHANNEL 2
+#define SYNTHETIC_ENABLE_CHANNEL 3
+
+// Shape of a generated SPI waveform.
+struct SyntheticSpiWorkload
+{
+	enum EnableMode { NoEnable, WithEnable, GlitchyEnable };
+
+	SyntheticSpiWorkload();
+
+	std::string GetName() const;
+	void ApplyTo( EnrichableSpiAnalyzerSettings* settings ) const;
+
+	BitState mClockInactiveState;
+	AnalyzerEnums::Edge mDataValidEdge;
+	AnalyzerEnums::ShiftOrder mShiftOrder;
+	U32 mBitsPerTransfer;
+	EnableMode mEnableMode;
+
+	U64 mWordCount;
+	U32 mWordsPerTransaction;
+	U32 mHalfPeriodSamples;
+	// With `GlitchyEnable`, one transaction in this many has its enable line
+	// dropped in the middle of a word; the aborted word is then resent.
+	U32 mGlitchInterval;
+	U32 mSeed;
+};
+
+// Generates `workload` into `capture` and returns the MOSI/MISO word pairs a
+// correct decoder reports, in order.
+void GenerateSyntheticSpiCapture(
+	const SyntheticSpiWorkload& workload,
+	EnrichableSpiCapture* capture,
+	std::vector<U64>* expectedMosi,
+	std::vector<U64>* expectedMiso
+);
+
+#endif //SYNTHETIC_SPI_CAPTURE_H
@@ -0,0 +1,63 @@
+/*
+ * Minimal native enrichment script used as a reference by
+ * enrichable_spi_subprocess_benchmark: it answers every message with the
+ * cheapest valid response so that measurements show the analyzer's own
+ * round-trip cost.
+ */
+#include <stdio.h>
+#include <string.h>
+
+static const char* field(const char* line, int index, char* out, size_t outLength)
+{
+	const char* start = line;
+	size_t length;
+	int i;
+
+	for(i = 0; i < index; i++) {
+		start = strchr(start, '\t');
+		if(start == NULL) {
+			out[0] = '\0';
+			return out;
+		}
+		start++;
+	}
+
+	length = strcspn(start, "\t\n");
+	if(length >= outLength) {
+		length = outLength - 1;
+	}
+	memcpy(out, start, length);
+	out[length] = '\0';
+
+	return out;
+}
+
+int main(void)
+{
+	char line[1024];
+	char value[64];
+
+	while(fgets(line, sizeof(line), stdin) != NULL) {
+		if(strncmp(line, "feature\t", 8) == 0) {
+			fputs("yes\n", stdout);
+		} else if(strncmp(line, "features\t", 9) == 0) {
+			fputs("yes\tyes\tyes\tyes\n", stdout);
+		} else if(strncmp(line, "marker\t", 7) == 0) {
+			fputs("0\tmosi\tDot\n\n", stdout);
+		} else if(strncmp(line, "bubble\t", 7) == 0) {
+			printf("%s\n\n", field(line, 8, value, sizeof(value)));
+		} else if(strncmp(line, "bubble2\t", 8) == 0) {
+			printf("%s\n\n", field(line, 7, value, sizeof(value)));
+			printf("%s\n\n", field(line, 8, value, sizeof(value)));
+		} else if(strncmp(line, "tabular\t", 8) == 0) {
+			printf("MOSI %s\n\n", field(line, 7, value, sizeof(value)));
+		} else if(strcmp(line, "reset\n") == 0) {
+			fputs("ok\n", stdout);
+		} else {
+			fputs("\n", stdout);
+		}
+		fflush(stdout);
+	}
+
+	return 0;
+}
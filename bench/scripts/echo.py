@@ -0,0 +1,83 @@
+"""Reference Python enrichment script for the subprocess benchmark.
+
+Shaped like examples/simple_logging.py without the log file, so that its
+timings reflect interpreter overhead rather than disk I/O.
+"""
+import fileinput
+import sys
+
+
+def get_bubble_text(line):
+    _, pkt, idx, start, end, f_type, flags, direction, value = (
+        line.split('\t')
+    )
+
+    return [value]
+
+
+def get_combined_bubble_text(line):
+    _, pkt, idx, start, end, f_type, flags, mosi, miso = (
+        line.split('\t')
+    )
+
+    return [mosi], [miso]
+
+
+def get_markers(line):
+    _, pkt, idx, sample_count, start, end, f_type, flags, mosi, miso = (
+        line.split('\t')
+    )
+
+    return ["0\tmosi\tDot"]
+
+
+def get_tabular_text(line):
+    _, pkt, idx, start, end, f_type, flags, mosi, miso = (
+        line.split('\t')
+    )
+
+    return ["MOSI " + mosi]
+
+
+def main():
+    for line in fileinput.input():
+        line = line.strip()
+
+        result = ""
+        if line.startswith('feature\t'):
+            sys.stdout.write("yes\n")
+            sys.stdout.flush()
+            continue
+        elif line.startswith('features\t'):
+            sys.stdout.write("yes\tyes\tyes\tyes\n")
+            sys.stdout.flush()
+            continue
+        elif line == 'reset':
+            sys.stdout.write("ok\n")
+            sys.stdout.flush()
+            continue
+        elif line.startswith('bubble\t'):
+            results = get_bubble_text(line)
+            if results:
+                result = "\n".join(results) + "\n"
+        elif line.startswith('bubble2\t'):
+            # MOSI's list ends here; MISO's is ended below.
+            mosi, miso = get_combined_bubble_text(line)
+            result = "".join(text + "\n" for text in mosi) + "\n"
+            result += "".join(text + "\n" for text in miso)
+        elif line.startswith('marker\t'):
+            markers = get_markers(line)
+            if markers:
+                result = "\n".join(markers) + "\n"
+        elif line.startswith('tabular\t'):
+            results = get_tabular_text(line)
+            if results:
+                result = "\n".join(results) + "\n"
+
+        sys.stdout.write(result)
+        sys.stdout.write("\n")
+        sys.stdout.flush()
+
+
+if __name__ == '__main__':
+    main()
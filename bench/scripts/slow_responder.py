@@ -0,0 +1,24 @@
+"""Artificially slow enrichment script for the subprocess benchmark.
+
+Sleeps before answering each message to stand in for scripts that do real
+work per frame.  The delay in milliseconds is the first argument (default 1).
+"""
+import fileinput
+import sys
+import time
+
+
+def main(delay):
+    for line in fileinput.input(files=('-',)):
+        time.sleep(delay)
+
+        if line.startswith('feature\t'):
+            sys.stdout.write("yes\n")
+        else:
+            sys.stdout.write("\n")
+        sys.stdout.flush()
+
+
+if __name__ == '__main__':
+    delay_ms = float(sys.argv[1]) if len(sys.argv) > 1 else 1.0
+    main(delay_ms / 1000.0)
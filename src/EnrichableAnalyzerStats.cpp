@@ -0,0 +1,282 @@
+#include "EnrichableAnalyzerStats.h"
+#include "EnrichableFrameTee.h"
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include <string.h>
+
+#define STATS_WRITE_INTERVAL_NS 1000000000ull
+
+LatencyHistogram::LatencyHistogram() {
+	Reset();
+}
+
+void LatencyHistogram::Reset() {
+	memset(counts, 0, sizeof(counts));
+	count = 0;
+	max = 0;
+	sum = 0;
+}
+
+unsigned LatencyHistogram::BucketIndex(U64 value) {
+	if(value < 32) {
+		return value;
+	}
+
+	unsigned msb = 63 - __builtin_clzll(value);
+	unsigned shift = msb - 4;
+	return 32 + (shift - 1) * 16 + ((value >> shift) - 16);
+}
+
+U64 LatencyHistogram::BucketUpperBound(unsigned index) {
+	if(index < 32) {
+		return index;
+	}
+
+	unsigned shift = (index - 32) / 16 + 1;
+	U64 subBucket = (index - 32) % 16 + 16;
+	return ((subBucket + 1) << shift) - 1;
+}
+
+void LatencyHistogram::Record(U64 value) {
+	counts[BucketIndex(value)]++;
+	count++;
+	sum += value;
+	if(value > max) {
+		max = value;
+	}
+}
+
+U64 LatencyHistogram::Count() const {
+	return count;
+}
+
+U64 LatencyHistogram::Max() const {
+	return max;
+}
+
+double LatencyHistogram::Mean() const {
+	return count ? sum / count : 0;
+}
+
+U64 LatencyHistogram::Percentile(double percentile) const {
+	if(count == 0) {
+		return 0;
+	}
+
+	U64 target = U64(percentile / 100.0 * count + 0.5);
+	if(target < 1) {
+		target = 1;
+	}
+
+	U64 seen = 0;
+	for(unsigned i = 0; i < BUCKET_COUNT; i++) {
+		seen += counts[i];
+		if(seen >= target) {
+			U64 bound = BucketUpperBound(i);
+			return bound < max ? bound : max;
+		}
+	}
+	return max;
+}
+
+EnrichableAnalyzerStats::EnrichableAnalyzerStats():
+	enabled(false),
+	lastWrite(0),
+	started(Now()),
+	promoted(0),
+	markerTimeSinceDecode(0),
+	frameTee(NULL)
+{
+	Reset();
+}
+
+void EnrichableAnalyzerStats::SetOutputFile(std::string path) {
+	std::lock_guard<std::mutex> guard(lock);
+	outputFile = path;
+	enabled.store(path.length() > 0, std::memory_order_relaxed);
+}
+
+void EnrichableAnalyzerStats::SetFrameTee(const EnrichableFrameTee* tee) {
+	frameTee = tee;
+}
+
+bool EnrichableAnalyzerStats::Enabled() const {
+	return enabled.load(std::memory_order_relaxed);
+}
+
+void EnrichableAnalyzerStats::Reset() {
+	std::lock_guard<std::mutex> guard(lock);
+	for(unsigned i = 0; i < MessageTypeCount; i++) {
+		messages[i].requests = 0;
+		messages[i].skipped.store(0, std::memory_order_relaxed);
+		messages[i].bytesSent = 0;
+		messages[i].bytesReceived = 0;
+		messages[i].lockWait.Reset();
+		messages[i].roundTrip.Reset();
+	}
+	decode.Reset();
+	for(unsigned i = 0; i < EnrichableRequestScheduler::PriorityCount; i++) {
+		queueWait[i].Reset();
+	}
+	promoted = 0;
+	markerTimeSinceDecode = 0;
+	started = Now();
+}
+
+U64 EnrichableAnalyzerStats::Now() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()
+	).count();
+}
+
+void EnrichableAnalyzerStats::RecordRequest(
+	MessageType type,
+	U64 lockWait,
+	U64 roundTrip,
+	U64 bytesSent,
+	U64 bytesReceived
+) {
+	std::lock_guard<std::mutex> guard(lock);
+	MessageStats& stats = messages[type];
+
+	stats.requests++;
+	stats.bytesSent += bytesSent;
+	stats.bytesReceived += bytesReceived;
+	stats.lockWait.Record(lockWait);
+	stats.roundTrip.Record(roundTrip);
+
+	if(type == Marker) {
+		markerTimeSinceDecode += lockWait + roundTrip;
+	}
+}
+
+void EnrichableAnalyzerStats::RecordSkip(MessageType type) {
+	messages[type].skipped.fetch_add(1, std::memory_order_relaxed);
+}
+
+void EnrichableAnalyzerStats::RecordQueueWait(EnrichableRequestScheduler::Priority priority, U64 wait, bool promotedRequest) {
+	std::lock_guard<std::mutex> guard(lock);
+	queueWait[priority].Record(wait);
+	if(promotedRequest) {
+		promoted++;
+	}
+}
+
+void EnrichableAnalyzerStats::RecordDecode(U64 duration) {
+	std::lock_guard<std::mutex> guard(lock);
+	if(markerTimeSinceDecode < duration) {
+		duration -= markerTimeSinceDecode;
+	} else {
+		duration = 0;
+	}
+	markerTimeSinceDecode = 0;
+
+	decode.Record(duration);
+}
+
+const char* EnrichableAnalyzerStats::GetMessageTypeName(MessageType type) {
+	switch(type) {
+		case Marker:
+			return "marker";
+		case Bubble:
+			return "bubble";
+		case Tabular:
+			return "tabular";
+		case Feature:
+			return "feature";
+		case ScriptReset:
+			return "reset";
+		case CombinedBubble:
+			return "bubble2";
+		default:
+			return "unknown";
+	}
+}
+
+void EnrichableAnalyzerStats::WriteHistogram(std::ostream& out, const char* name, const LatencyHistogram& histogram) {
+	out << "  " << std::left << std::setw(12) << name << std::right;
+	out << " count=" << histogram.Count();
+	out << std::fixed << std::setprecision(1);
+	out << " mean=" << histogram.Mean() / 1000.0;
+	out << " p50=" << histogram.Percentile(50) / 1000.0;
+	out << " p90=" << histogram.Percentile(90) / 1000.0;
+	out << " p99=" << histogram.Percentile(99) / 1000.0;
+	out << " p99.9=" << histogram.Percentile(99.9) / 1000.0;
+	out << " max=" << histogram.Max() / 1000.0;
+	out << " (us)\n";
+}
+
+void EnrichableAnalyzerStats::Write(bool force) {
+	if(!Enabled()) {
+		return;
+	}
+
+	// The report is put together under the lock and written out after it.
+	std::stringstream out;
+	std::string path;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		U64 now = Now();
+		if(outputFile.empty() || (!force && now - lastWrite < STATS_WRITE_INTERVAL_NS)) {
+			return;
+		}
+		lastWrite = now;
+		path = outputFile;
+		Format(out, now);
+	}
+
+	std::ofstream file(path.c_str(), std::ios::trunc);
+	if(!file) {
+		std::cerr << "Unable to write statistics file: ";
+		std::cerr << path;
+		std::cerr << "\n";
+		return;
+	}
+	file << out.rdbuf();
+}
+
+void EnrichableAnalyzerStats::Format(std::ostream& out, U64 now) {
+	out << "# Enrichable SPI analyzer statistics\n";
+	out << "elapsed_s " << std::fixed << std::setprecision(3) << (now - started) / 1e9 << "\n";
+
+	for(unsigned i = 0; i < MessageTypeCount; i++) {
+		const MessageStats& stats = messages[i];
+
+		out << "\n" << GetMessageTypeName(MessageType(i)) << "\n";
+		out << "  requests=" << stats.requests;
+		out << " bytes_sent=" << stats.bytesSent;
+		out << " bytes_received=" << stats.bytesReceived;
+
+		U64 skipped = stats.skipped.load(std::memory_order_relaxed);
+		if(skipped > 0) {
+			out << " skipped=" << skipped;
+			out << " skip_rate=" << std::fixed << std::setprecision(1)
+				<< 100.0 * skipped / (skipped + stats.requests) << "%";
+		}
+		out << "\n";
+		WriteHistogram(out, "lock_wait", stats.lockWait);
+		WriteHistogram(out, "round_trip", stats.roundTrip);
+	}
+
+	out << "\nscheduler\n";
+	out << "  promoted=" << promoted << "\n";
+	WriteHistogram(out, "interactive", queueWait[EnrichableRequestScheduler::Interactive]);
+	WriteHistogram(out, "background", queueWait[EnrichableRequestScheduler::Background]);
+
+	out << "\ndecoder\n";
+	WriteHistogram(out, "get_word", decode);
+
+	if(frameTee != NULL && (frameTee->Enabled() || frameTee->GetPublished() > 0)) {
+		out << "\nframe_output\n";
+		out << "  published=" << frameTee->GetPublished();
+		out << " dropped=" << frameTee->GetDropped();
+		out << " blocked=" << frameTee->GetBlocked();
+		out << " bytes_written=" << frameTee->GetBytesWritten();
+		out << "\n";
+	}
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <LogicPublicTypes.h>
+#include "EnrichableRequestScheduler.h"
+#include <atomic>
+#include <iosfwd>
+#include <mutex>
+#include <string>
+
+class EnrichableFrameTee;
+
+// Log-linear latency histogram in the style of HdrHistogram: exact below 32,
+// then 16 sub-buckets per power of two (about 6% relative precision) up to
+// the full U64 range.  Values are nanoseconds.
+class LatencyHistogram {
+	public:
+		LatencyHistogram();
+
+		void Record(U64 value);
+		void Reset();
+
+		U64 Count() const;
+		U64 Max() const;
+		double Mean() const;
+		U64 Percentile(double percentile) const;
+
+	protected:
+		static unsigned BucketIndex(U64 value);
+		static U64 BucketUpperBound(unsigned index);
+
+		enum { BUCKET_COUNT = 32 + 59 * 16 };
+
+		U64 counts[BUCKET_COUNT];
+		U64 count;
+		U64 max;
+		double sum;
+};
+
+// Counters for the script protocol and the decoder, written as a text report
+// when a statistics file is configured.
+//
+// Safe to call from any thread.  The counters have a lock of their own, held
+// only while counting, so recording a decode never waits behind a request to
+// the script.
+class EnrichableAnalyzerStats {
+	public:
+		enum MessageType {
+			Marker,
+			Bubble,
+			Tabular,
+			Feature,
+			// Named apart from `Reset()`, which clears these counters.
+			ScriptReset,
+			CombinedBubble,
+			MessageTypeCount
+		};
+
+		struct MessageStats {
+			U64 requests;
+			// Frames not sent because the script filter or the script's
+			// subscriptions rejected them; counted outside of the lock.
+			std::atomic<U64> skipped;
+			U64 bytesSent;
+			U64 bytesReceived;
+			LatencyHistogram lockWait;
+			LatencyHistogram roundTrip;
+		};
+
+		EnrichableAnalyzerStats();
+
+		void SetOutputFile(std::string path);
+		bool Enabled() const;
+		// Its counters are included while it is enabled.
+		void SetFrameTee(const EnrichableFrameTee* tee);
+		void Reset();
+
+		static U64 Now();
+
+		void RecordRequest(MessageType type, U64 lockWait, U64 roundTrip, U64 bytesSent, U64 bytesReceived);
+		void RecordSkip(MessageType type);
+		// Time spent waiting for the script, by scheduling priority;
+		// `promoted` marks background requests let through ahead of
+		// interactive ones.
+		void RecordQueueWait(EnrichableRequestScheduler::Priority priority, U64 wait, bool promotedRequest);
+		// `duration` covers a whole `GetWord` call; marker requests made
+		// since the previous call are subtracted so only decoding remains.
+		void RecordDecode(U64 duration);
+
+		// Rewrites the statistics file at most once per second; `force`
+		// writes it regardless.
+		void Write(bool force);
+
+		static const char* GetMessageTypeName(MessageType type);
+
+	protected:
+		// Only called with the lock held.
+		void Format(std::ostream& out, U64 now);
+		void WriteHistogram(std::ostream& out, const char* name, const LatencyHistogram& histogram);
+
+		std::mutex lock;
+		// Whether `outputFile` is set; checked without the lock.
+		std::atomic<bool> enabled;
+		std::string outputFile;
+		U64 lastWrite;
+		U64 started;
+
+		MessageStats messages[MessageTypeCount];
+		LatencyHistogram decode;
+		LatencyHistogram queueWait[EnrichableRequestScheduler::PriorityCount];
+		U64 promoted;
+		U64 markerTimeSinceDecode;
+		const EnrichableFrameTee* frameTee;
+};
@@ -12,21 +12,137 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <errno.h>
+#include <spawn.h>
 #include <wordexp.h>
+#include <poll.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+
+#include <map>
+
+// How long `Stop` waits for the script to exit before killing it.
+#define STOP_TIMEOUT_MS 1000
+#define STOP_POLL_INTERVAL_MS 10
+// How often a start thread waiting on a shared script checks whether its
+// analyzer is stopping.
+#define START_POLL_INTERVAL_MS 10
+
+extern char** environ;
+
+namespace {
+	// Shared scripts, by command.
+	std::mutex hostRegistryLock;
+	std::map<std::string, std::weak_ptr<EnrichableScriptHost>> hostRegistry;
+
+	// Only the script's stdin and stdout survive the exec; other scripts,
+	// started later or by another thread meanwhile, mustn't hold this one's
+	// pipes open.
+	int OpenPipe(int fds[2]) {
+#ifdef __APPLE__
+		// macOS has no `pipe2`, so there a process started by another
+		// thread in between can still inherit these.
+		if(pipe(fds) < 0) {
+			return -1;
+		}
+		fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+		fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+		return 0;
+#else
+		return pipe2(fds, O_CLOEXEC);
+#endif
+	}
+
+	// What the text cache stores with a frame's text, to tell it apart from
+	// a different frame at the same index.
+	U32 GetFrameCheck(const Frame& frame) {
+		U64 check = frame.mStartingSampleInclusive
+			^ (frame.mEndingSampleInclusive << 21)
+			^ (frame.mData1 * 0x9e3779b97f4a7c15ull)
+			^ (frame.mData2 * 0xc2b2ae3d27d4eb4full);
+		return U32(check ^ (check >> 32));
+	}
+}
+
+EnrichableScriptHost::EnrichableScriptHost():
+	pid(0),
+	nextInstance(0),
+	abandonedLines(0)
+{
+}
+
+EnrichableScriptHost::~EnrichableScriptHost() {
+	StopProcess();
+}
 
-std::mutex subprocessLock;
+void EnrichableScriptHost::StopProcess() {
+	if(pid <= 0) {
+		return;
+	}
+
+	// Closing the pipes delivers end-of-file to the script's stdin.
+	close(inpipefd[0]);
+	close(outpipefd[1]);
+	kill(pid, SIGINT);
+
+	bool exited = false;
+	for(int waited = 0; waited < STOP_TIMEOUT_MS; waited += STOP_POLL_INTERVAL_MS) {
+		if(waitpid(pid, NULL, WNOHANG) != 0) {
+			exited = true;
+			break;
+		}
+		usleep(STOP_POLL_INTERVAL_MS * 1000);
+	}
+	if(!exited) {
+		std::cerr << "Analyzer subprocess did not exit; killing it.\n";
+		kill(pid, SIGKILL);
+		waitpid(pid, NULL, 0);
+	}
+
+	pid = 0;
+	command = "";
+}
+
+void EnrichableScriptHost::Interrupt() {
+	pid_t running = pid;
+	if(running > 0) {
+		kill(running, SIGKILL);
+	}
+}
 
 EnrichableAnalyzerSubprocess::EnrichableAnalyzerSubprocess():
+	parserCommand(""),
 	enabled(false),
+	shareScript(false),
+	host(new EnrichableScriptHost()),
+	sharedHost(false),
+	instanceId(0),
+	recordingMode(EnrichableScriptRecording::Off),
 	featureMarker(true),
 	featureBubble(true),
 	featureTabular(true),
-	parserCommand("")
+	featureCombinedBubble(false),
+	textCache(TEXT_CACHE_MAX_BYTES),
+	strings(new EnrichableStringTable()),
+	frameSelection(new FrameSelection()),
+	started(true),
+	startingShared(false),
+	stopping(false),
+	abandoned(false),
+	requestType(EnrichableAnalyzerStats::Marker),
+	requestPriority(EnrichableRequestScheduler::Background),
+	requestPromoted(false),
+	requestFrameIndex(TRACE_NO_ARG),
+	requestLockStart(0),
+	requestStart(0),
+	requestBytesSent(0),
+	requestBytesReceived(0)
 {
+	stats.SetFrameTee(&frameTee);
 }
 
 EnrichableAnalyzerSubprocess::~EnrichableAnalyzerSubprocess()
 {
+	InterruptStartThread();
 }
 
 std::vector<EnrichableAnalyzerSubprocess::Marker> EnrichableAnalyzerSubprocess::EmitMarker(
@@ -37,9 +153,13 @@ std::vector<EnrichableAnalyzerSubprocess::Marker> EnrichableAnalyzerSubprocess::
 ) {
 	std::vector<EnrichableAnalyzerSubprocess::Marker> markers;
 
+	WaitUntilReady();
 	if(! (enabled && featureMarker)) {
 		return markers;
 	}
+	if(!FrameSelected(EnrichableAnalyzerStats::Marker, frame)) {
+		return markers;
+	}
 
 	std::stringstream outputStream;
 
@@ -66,7 +186,7 @@ std::vector<EnrichableAnalyzerSubprocess::Marker> EnrichableAnalyzerSubprocess::
 
 	std::string outputValue = outputStream.str();
 
-	LockSubprocess();
+	BeginRequest(EnrichableAnalyzerStats::Marker, frameIndex);
 	SendOutputLine(
 		outputValue.c_str(),
 		outputValue.length()
@@ -103,23 +223,39 @@ std::vector<EnrichableAnalyzerSubprocess::Marker> EnrichableAnalyzerSubprocess::
 
 				std::cerr << "Disabling analyzer subprocess.\n";
 				enabled = false;
+				EndRequest();
 				return markers;
 			}
 		} else {
 			break;
 		}
 	}
-	UnlockSubprocess();
+	EndRequest();
 
 	return markers;
 }
 
-std::vector<std::string> EnrichableAnalyzerSubprocess::EmitBubble(U64 packetId, U64 frameIndex, Frame& frame, std::string channelName) {
-	std::vector<std::string> bubbles;
+EnrichableTextLines EnrichableAnalyzerSubprocess::EmitBubble(U64 packetId, U64 frameIndex, Frame& frame, std::string channelName) {
+	EnrichableTextLines bubbles;
 
+	WaitUntilReady();
 	if(! (enabled && featureBubble)) {
 		return bubbles;
 	}
+	if(!FrameSelected(EnrichableAnalyzerStats::Bubble, frame)) {
+		return bubbles;
+	}
+
+	// Logic draws a frame's bubbles again each time it comes into view.
+	unsigned channel = channelName == "miso" ? 1 : 0;
+	EnrichableTextCache::Kind kind = EnrichableTextCache::Kind(EnrichableTextCache::MosiBubble + channel);
+	U32 check = GetFrameCheck(frame);
+	if(textCache.Find(kind, frameIndex, check, &bubbles)) {
+		return bubbles;
+	}
+	if(featureCombinedBubble) {
+		return EmitCombinedBubble(packetId, frameIndex, frame, channel);
+	}
 
 	std::stringstream outputStream;
 	outputStream << BUBBLE_PREFIX;
@@ -142,31 +278,76 @@ std::vector<std::string> EnrichableAnalyzerSubprocess::EmitBubble(U64 packetId,
 	outputStream << LINE_SEPARATOR;
 	std::string value = outputStream.str();
 
-	LockSubprocess();
+	BeginRequest(EnrichableAnalyzerStats::Bubble, frameIndex, EnrichableRequestScheduler::Interactive);
 	SendOutputLine(value.c_str(), value.length());
 	char bubbleText[256];
-	while(true) {
-		GetInputLine(
-			bubbleText,
-			256
-		);
-		if(strlen(bubbleText) > 0) {
-			bubbles.push_back(bubbleText);
-		} else {
-			break;
-		}
-	}
-	UnlockSubprocess();
+	GetTextLines(bubbleText, 256, &bubbles);
+	EndRequest();
 
+	textCache.Store(kind, frameIndex, check, bubbles);
 	return bubbles;
 }
 
-std::vector<std::string> EnrichableAnalyzerSubprocess::EmitTabular(U64 packetId, U64 frameIndex, Frame& frame) {
-	std::vector<std::string> lines;
+EnrichableTextLines EnrichableAnalyzerSubprocess::EmitCombinedBubble(U64 packetId, U64 frameIndex, Frame& frame, unsigned channel) {
+	EnrichableTextLines bubbles[2];
 
+	std::stringstream outputStream;
+	outputStream << COMBINED_BUBBLE_PREFIX;
+	outputStream << UNIT_SEPARATOR;
+	outputStream << std::hex << packetId;
+	outputStream << UNIT_SEPARATOR;
+	outputStream << std::hex << frameIndex;
+	outputStream << UNIT_SEPARATOR;
+	outputStream << std::hex << frame.mStartingSampleInclusive;
+	outputStream << UNIT_SEPARATOR;
+	outputStream << std::hex << frame.mEndingSampleInclusive;
+	outputStream << UNIT_SEPARATOR;
+	outputStream << std::hex << (U64)frame.mType;
+	outputStream << UNIT_SEPARATOR;
+	outputStream << std::hex << (U64)frame.mFlags;
+	outputStream << UNIT_SEPARATOR;
+	outputStream << std::hex << frame.mData1;
+	outputStream << UNIT_SEPARATOR;
+	outputStream << std::hex << frame.mData2;
+	outputStream << LINE_SEPARATOR;
+	std::string value = outputStream.str();
+
+	// MOSI's list, then MISO's, each ended by an empty line.
+	BeginRequest(EnrichableAnalyzerStats::CombinedBubble, frameIndex, EnrichableRequestScheduler::Interactive);
+	SendOutputLine(value.c_str(), value.length());
+	char bubbleText[256];
+	GetTextLines(bubbleText, 256, &bubbles[0]);
+	GetTextLines(bubbleText, 256, &bubbles[1]);
+	EndRequest();
+
+	// Logic asks for the other channel's bubble next; it is answered from
+	// the cache.
+	U32 check = GetFrameCheck(frame);
+	textCache.Store(EnrichableTextCache::MosiBubble, frameIndex, check, bubbles[0]);
+	textCache.Store(EnrichableTextCache::MisoBubble, frameIndex, check, bubbles[1]);
+
+	return bubbles[channel];
+}
+
+EnrichableTextLines EnrichableAnalyzerSubprocess::EmitTabular(
+	U64 packetId,
+	U64 frameIndex,
+	Frame& frame,
+	EnrichableRequestScheduler::Priority priority
+) {
+	EnrichableTextLines lines;
+
+	WaitUntilReady();
 	if(! (enabled && featureBubble)) {
 		return lines;
 	}
+	if(!FrameSelected(EnrichableAnalyzerStats::Tabular, frame)) {
+		return lines;
+	}
+	U32 check = GetFrameCheck(frame);
+	if(textCache.Find(EnrichableTextCache::Tabular, frameIndex, check, &lines)) {
+		return lines;
+	}
 
 	std::stringstream outputStream;
 
@@ -191,106 +372,330 @@ std::vector<std::string> EnrichableAnalyzerSubprocess::EmitTabular(U64 packetId,
 
 	std::string value = outputStream.str();
 
-	LockSubprocess();
+	BeginRequest(EnrichableAnalyzerStats::Tabular, frameIndex, priority);
 	SendOutputLine(value.c_str(), value.length());
 	char tabularText[512];
-	while(true) {
-		GetInputLine(
-			tabularText,
-			512
-		);
-		if(strlen(tabularText) > 0) {
-			lines.push_back(tabularText);
-		} else {
-			break;
-		}
-	}
-	UnlockSubprocess();
+	GetTextLines(tabularText, 512, &lines);
+	EndRequest();
 
+	textCache.Store(EnrichableTextCache::Tabular, frameIndex, check, lines);
 	return lines;
 }
 
 bool EnrichableAnalyzerSubprocess::MarkerEnabled() {
+	WaitUntilReady();
 	return featureMarker;
 }
 
 bool EnrichableAnalyzerSubprocess::BubbleEnabled() {
+	WaitUntilReady();
 	return featureBubble;
 }
 
 bool EnrichableAnalyzerSubprocess::TabularEnabled() {
+	WaitUntilReady();
 	return featureTabular;
 }
 
 void EnrichableAnalyzerSubprocess::SetParserCommand(std::string cmd) {
+	JoinStartThread();
 	parserCommand = cmd;
 	enabled = true;
 }
 
+void EnrichableAnalyzerSubprocess::SetShareScript(bool share) {
+	JoinStartThread();
+	shareScript = share;
+}
+
+void EnrichableAnalyzerSubprocess::SetRecording(std::string path, EnrichableScriptRecording::Mode mode) {
+	JoinStartThread();
+	recordingPath = path;
+	recordingMode = path.length() ? mode : EnrichableScriptRecording::Off;
+}
+
+void EnrichableAnalyzerSubprocess::SetFrameFilter(std::string expression) {
+	if(expression == frameFilterExpression) {
+		return;
+	}
+	frameFilterExpression = expression;
+
+	std::shared_ptr<FrameSelection> selection(new FrameSelection(*std::atomic_load(&frameSelection)));
+	std::string error;
+	if(!selection->filter.Compile(expression, &error)) {
+		std::cerr << "Ignoring script filter: ";
+		std::cerr << error;
+		std::cerr << "\n";
+		selection->filter.Compile("", &error);
+	}
+	std::atomic_store(&frameSelection, std::shared_ptr<const FrameSelection>(selection));
+}
+
+void EnrichableAnalyzerSubprocess::SetRegion(U64 firstSample, U64 lastSample) {
+	std::shared_ptr<FrameSelection> selection(new FrameSelection(*std::atomic_load(&frameSelection)));
+	selection->regionFirstSample = firstSample;
+	selection->regionLastSample = lastSample;
+	std::atomic_store(&frameSelection, std::shared_ptr<const FrameSelection>(selection));
+}
+
+bool EnrichableAnalyzerSubprocess::FrameSelected(EnrichableAnalyzerStats::MessageType type, const Frame& frame) {
+	std::shared_ptr<const FrameSelection> selection = std::atomic_load(&frameSelection);
+	// Frames are never at negative sample numbers.
+	bool selected = U64(frame.mEndingSampleInclusive) >= selection->regionFirstSample
+		&& U64(frame.mStartingSampleInclusive) <= selection->regionLastSample
+		&& selection->filter.Matches(frame)
+		&& (!Ready() || GetSubscription(type).Matches(frame));
+	if(!selected && stats.Enabled()) {
+		stats.RecordSkip(type);
+	}
+	return selected;
+}
+
+const EnrichableFrameFilter& EnrichableAnalyzerSubprocess::GetSubscription(EnrichableAnalyzerStats::MessageType type) {
+	switch(type) {
+		case EnrichableAnalyzerStats::Marker:
+			return subscriptionMarker;
+		case EnrichableAnalyzerStats::Bubble:
+			return subscriptionBubble;
+		default:
+			return subscriptionTabular;
+	}
+}
+
 void EnrichableAnalyzerSubprocess::Start() {
+	JoinStartThread();
+	// Frame indexes start over with every run.
+	textCache.Clear();
+	AttachHost();
+	started.store(false, std::memory_order_relaxed);
+	stopping.store(false);
+	abandoned = false;
+	startingHost = host;
+	startingShared = sharedHost;
+	startThread = std::thread(&EnrichableAnalyzerSubprocess::StartProcess, this);
+}
+
+void EnrichableAnalyzerSubprocess::AttachHost() {
+	// Let go of a host outside of the registry lock: if this was its last
+	// user, its script is stopped.
+	std::shared_ptr<EnrichableScriptHost> previous = host;
+
+	// A replay has no script to share.
+	if(!shareScript || recordingMode == EnrichableScriptRecording::Replay) {
+		if(sharedHost || !host) {
+			host.reset(new EnrichableScriptHost());
+			sharedHost = false;
+		}
+		return;
+	}
+
+	std::lock_guard<std::mutex> guard(hostRegistryLock);
+	std::shared_ptr<EnrichableScriptHost> found = hostRegistry[parserCommand].lock();
+	if(!found) {
+		found.reset(new EnrichableScriptHost());
+		hostRegistry[parserCommand] = found;
+	}
+	if(!sharedHost || found != host) {
+		host = found;
+		sharedHost = true;
+		instanceId = host->nextInstance++;
+	}
+
+	for(auto entry = hostRegistry.begin(); entry != hostRegistry.end(); ) {
+		if(entry->second.expired()) {
+			entry = hostRegistry.erase(entry);
+		} else {
+			++entry;
+		}
+	}
+}
+
+bool EnrichableAnalyzerSubprocess::Ready() {
+	return started.load(std::memory_order_acquire);
+}
+
+void EnrichableAnalyzerSubprocess::WaitUntilReady() {
+	if(Ready()) {
+		return;
+	}
+
+	std::unique_lock<std::mutex> guard(startLock);
+	startCondition.wait(guard, [this]() { return Ready(); });
+}
+
+void EnrichableAnalyzerSubprocess::InterruptStartThread() {
+	// A script that hangs before answering the `features` handshake would
+	// otherwise keep the start thread, and so whoever joins it, waiting
+	// forever.  If the script is only slow to start, it is started again
+	// on the next run.  A shared script keeps serving the other analyzers;
+	// the start thread notices `stopping` and gives up on it instead.
+	if(startThread.joinable() && !Ready()) {
+		stopping.store(true);
+		if(!startingShared) {
+			startingHost->Interrupt();
+		}
+	}
+	JoinStartThread();
+	startingHost.reset();
+}
+
+void EnrichableAnalyzerSubprocess::JoinStartThread() {
+	if(startThread.joinable()) {
+		startThread.join();
+	}
+}
+
+void EnrichableAnalyzerSubprocess::StartProcess() {
+	// An interrupted script's pipe must fail the write, not end the process.
+	sigset_t pipeSignal;
+	sigemptyset(&pipeSignal);
+	sigaddset(&pipeSignal, SIGPIPE);
+	pthread_sigmask(SIG_BLOCK, &pipeSignal, NULL);
+
+	trace.NameThread("script start");
+	{
+		TraceSpan span(&trace, "script start");
+		LaunchProcess();
+	}
+
+	std::lock_guard<std::mutex> guard(startLock);
+	started.store(true, std::memory_order_release);
+	startCondition.notify_all();
+}
+
+void EnrichableAnalyzerSubprocess::LaunchProcess() {
+	LockSubprocess();
+	bool recordingOpened = recording.Open(recordingPath, recordingMode);
+	UnlockSubprocess();
+
+	// A replay stands in for the script entirely.
+	if(recordingMode == EnrichableScriptRecording::Replay) {
+		StopProcess();
+		if(!recordingOpened) {
+			Terminate();
+			return;
+		}
+		GetFeatures();
+		return;
+	}
+
 	if(!parserCommand.length()) {
 		std::cerr << "No parser command defined; aborting subprocess.\n";
 		Terminate();
-	} else {
-		std::cerr << "Starting analyzer subprocess: ";
-		std::cerr << parserCommand;
-		std::cerr << "\n";
+		return;
 	}
 
+	std::unique_lock<std::mutex> launch(host->launchLock);
+
+	// Logic reruns the analyzer after every settings change; scripts that
+	// load large models can take seconds to start, so a running script for
+	// the same command is reused if it can clear its state.  A shared
+	// script is reused regardless -- other analyzers depend on it -- and
+	// asked which features it supports for this analyzer.  So is a script
+	// being recorded: the recording starts empty, and a replay answers the
+	// handshake from it.
+	if(host->pid > 0) {
+		bool reset = host->command == parserCommand && Reset();
+		if(reset || (sharedHost && host->pid > 0)) {
+			launch.unlock();
+			std::cerr << "Reusing analyzer subprocess: ";
+			std::cerr << parserCommand;
+			std::cerr << "\n";
+			if(sharedHost || recordingMode == EnrichableScriptRecording::Record) {
+				GetFeatures();
+			}
+			return;
+		}
+		host->StopProcess();
+	}
+
+	std::cerr << "Starting analyzer subprocess: ";
+	std::cerr << parserCommand;
+	std::cerr << "\n";
 
-	if(pipe(inpipefd) < 0) {
+	// The command is split here rather than in the child, so that nothing
+	// but the exec itself runs there.
+	wordexp_t cmdParsed;
+	if(wordexp(parserCommand.c_str(), &cmdParsed, 0) != 0) {
+		std::cerr << "Unable to parse the parser command; aborting subprocess.\n";
+		Terminate();
+		return;
+	}
+	if(cmdParsed.we_wordc == 0) {
+		wordfree(&cmdParsed);
+		std::cerr << "No parser command defined; aborting subprocess.\n";
+		Terminate();
+		return;
+	}
+
+	int* inpipefd = host->inpipefd;
+	int* outpipefd = host->outpipefd;
+	if(OpenPipe(inpipefd) < 0) {
 		std::cerr << "Failed to create input pipe: ";
 		std::cerr << errno;
 		std::cerr << "\n";
+		wordfree(&cmdParsed);
 		Terminate();
+		return;
 	}
-	if(pipe(outpipefd) < 0) {
+	if(OpenPipe(outpipefd) < 0) {
 		std::cerr << "Failed to create output pipe: ";
 		std::cerr << errno;
 		std::cerr << "\n";
+		close(inpipefd[0]);
+		close(inpipefd[1]);
+		wordfree(&cmdParsed);
 		Terminate();
+		return;
 	}
-	std::cerr << "Starting fork...\n";
-	commandPid = fork();
-
-	if(commandPid == 0) {
-		std::cerr << "Forked...\n";
-		if(dup2(outpipefd[0], STDIN_FILENO) < 0) {
-			std::cerr << "Failed to redirect STDIN: ";
-			std::cerr << errno;
-			std::cerr << "\n";
-			exit(errno);
-		}
-		if(dup2(inpipefd[1], STDOUT_FILENO) < 0) {
-			std::cerr << "Failed to redirect STDOUT: ";
-			std::cerr << errno;
-			std::cerr << "\n";
-			exit(errno);
-		}
-
-		wordexp_t cmdParsed;
-		char *args[25];
-
-		wordexp(parserCommand.c_str(), &cmdParsed, 0);
-		int i;
-		for(i = 0; i < cmdParsed.we_wordc; i++) {
-			args[i] = cmdParsed.we_wordv[i];
-		}
-		args[i] = (char*)NULL;
-
+	// `posix_spawn` doesn't copy Logic's address space the way `fork` does,
+	// so starting a script costs the same however large Logic has grown.
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_adddup2(&actions, outpipefd[0], STDIN_FILENO);
+	posix_spawn_file_actions_adddup2(&actions, inpipefd[1], STDOUT_FILENO);
+
+	// The script starts with no signals blocked and SIGPIPE at its default,
+	// whatever the thread starting it had.
+	posix_spawnattr_t attributes;
+	posix_spawnattr_init(&attributes);
+	sigset_t signals;
+	sigemptyset(&signals);
+	posix_spawnattr_setsigmask(&attributes, &signals);
+	sigaddset(&signals, SIGPIPE);
+	posix_spawnattr_setsigdefault(&attributes, &signals);
+	posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+	pid_t pid;
+	int error = posix_spawnp(&pid, cmdParsed.we_wordv[0], &actions, &attributes, cmdParsed.we_wordv, environ);
+	posix_spawnattr_destroy(&attributes);
+	posix_spawn_file_actions_destroy(&actions);
+	wordfree(&cmdParsed);
+
+	close(inpipefd[1]);
+	close(outpipefd[0]);
+	if(error != 0) {
+		std::cerr << "Failed to spawn analyzer subprocess: ";
+		std::cerr << strerror(error);
+		std::cerr << "\n";
 		close(inpipefd[0]);
-		close(inpipefd[1]);
-		close(outpipefd[0]);
 		close(outpipefd[1]);
-
-		execvp(args[0], args);
-
-		std::cerr << "Failed to spawn analyzer subprocess!\n";
-	} else {
-		close(inpipefd[1]);
-		close(outpipefd[0]);
+		Terminate();
+		return;
+	}
+	host->pid = pid;
+	// `InterruptStartThread` may have looked for the script before it was
+	// started.
+	if(stopping.load() && !sharedHost) {
+		host->Interrupt();
 	}
+	host->command = parserCommand;
+	launch.unlock();
+
+	GetFeatures();
+}
 
+void EnrichableAnalyzerSubprocess::GetFeatures() {
 	// Check script to see which features are enabled;
 	// * 'no': This feature can be skipped.  This is used to improve
 	//   performance by allowing the script to not receive messages for
@@ -300,27 +705,78 @@ void EnrichableAnalyzerSubprocess::Start() {
 	//   but it's more important to me that the default case be simple
 	//   than the default case be high-performance.   Scripts are expected
 	//   to respond to even unhandled messages.
-	featureBubble = GetFeatureEnablement(BUBBLE_PREFIX);
-	featureMarker = GetFeatureEnablement(MARKER_PREFIX);
-	featureTabular = GetFeatureEnablement(TABULAR_PREFIX);
+	// All three are asked in one `features` message; scripts that predate
+	// it are asked one `feature` message at a time instead.
+	featureCombinedBubble = false;
+	if(!GetFeatureEnablements()) {
+		featureBubble = GetFeatureEnablement(BUBBLE_PREFIX);
+		featureMarker = GetFeatureEnablement(MARKER_PREFIX);
+		featureTabular = GetFeatureEnablement(TABULAR_PREFIX);
+	}
+	GetSubscriptions();
 }
 
-void EnrichableAnalyzerSubprocess::Stop(int exitCode) {
-	if(enabled) {
-		close(inpipefd[0]);
-		close(outpipefd[1]);
+void EnrichableAnalyzerSubprocess::Stop() {
+	InterruptStartThread();
+	frameTee.Close();
+	WriteStats(true);
+	trace.Close();
 
-		kill(commandPid, SIGINT);
+	LockSubprocess();
+	recording.Close();
+	UnlockSubprocess();
 
-		exit(exitCode);
-	}
+	StopProcess();
+	enabled = false;
 }
 
 void EnrichableAnalyzerSubprocess::Terminate() {
-	Stop(1);
+	StopProcess();
 	enabled = false;
 }
 
+void EnrichableAnalyzerSubprocess::StopProcess() {
+	// A shared script keeps running for the other analyzers using it.
+	if(sharedHost) {
+		host.reset(new EnrichableScriptHost());
+		sharedHost = false;
+	} else if(host) {
+		host->StopProcess();
+	}
+}
+
+bool EnrichableAnalyzerSubprocess::Reset() {
+	// The script may have exited since the previous run; it is reaped here
+	// and started again.
+	if(waitpid(host->pid, NULL, WNOHANG) != 0) {
+		close(host->inpipefd[0]);
+		close(host->outpipefd[1]);
+		host->pid = 0;
+		host->command = "";
+		return false;
+	}
+
+	std::stringstream outputStream;
+	char result[16];
+	std::string value;
+
+	outputStream << RESET_PREFIX;
+	outputStream << LINE_SEPARATOR;
+	value = outputStream.str();
+
+	GetScriptResponse(
+		EnrichableAnalyzerStats::ScriptReset,
+		value.c_str(),
+		value.length(),
+		result,
+		16
+	);
+
+	// Scripts written before this message answer it with an empty line;
+	// those are restarted so that they still begin every run afresh.
+	return strcmp(result, RESET_ACKNOWLEDGEMENT) == 0;
+}
+
 bool EnrichableAnalyzerSubprocess::GetFeatureEnablement(const char* feature) {
 	std::stringstream outputStream;
 	char result[16];
@@ -333,6 +789,7 @@ bool EnrichableAnalyzerSubprocess::GetFeatureEnablement(const char* feature) {
 	value = outputStream.str();
 
 	GetScriptResponse(
+		EnrichableAnalyzerStats::Feature,
 		value.c_str(),
 		value.length(),
 		result,
@@ -347,15 +804,165 @@ bool EnrichableAnalyzerSubprocess::GetFeatureEnablement(const char* feature) {
 	return true;
 }
 
-void EnrichableAnalyzerSubprocess::LockSubprocess() {
-	subprocessLock.lock();
+bool EnrichableAnalyzerSubprocess::GetFeatureEnablements() {
+	const char* features[] = {MARKER_PREFIX, BUBBLE_PREFIX, TABULAR_PREFIX};
+	bool* enablements[] = {&featureMarker, &featureBubble, &featureTabular};
+	std::stringstream outputStream;
+	char result[64];
+	std::string value;
+
+	outputStream << FEATURES_PREFIX;
+	for(const char* feature: features) {
+		outputStream << UNIT_SEPARATOR;
+		outputStream << feature;
+	}
+	outputStream << UNIT_SEPARATOR;
+	outputStream << COMBINED_BUBBLE_PREFIX;
+	outputStream << LINE_SEPARATOR;
+	value = outputStream.str();
+
+	GetScriptResponse(
+		EnrichableAnalyzerStats::Feature,
+		value.c_str(),
+		value.length(),
+		result,
+		64
+	);
+	if(strlen(result) == 0) {
+		return false;
+	}
+
+	// One answer per feature, in the order asked; missing answers mean yes.
+	std::stringstream inputStream(result);
+	std::string answer;
+	for(unsigned i = 0; i < 3; i++) {
+		if(!std::getline(inputStream, answer, UNIT_SEPARATOR)) {
+			answer = "";
+		}
+		*enablements[i] = answer != "no";
+		if(!*enablements[i]) {
+			std::cerr << "message type \"";
+			std::cerr << features[i];
+			std::cerr << "\" disabled\n";
+		}
+	}
+
+	// `bubble2` replaces `bubble` only for scripts that ask for it.
+	featureCombinedBubble = std::getline(inputStream, answer, UNIT_SEPARATOR) && answer == "yes";
+	if(featureCombinedBubble) {
+		std::cerr << "message type \"";
+		std::cerr << COMBINED_BUBBLE_PREFIX;
+		std::cerr << "\" enabled\n";
+	}
+	return true;
+}
+
+void EnrichableAnalyzerSubprocess::GetSubscriptions() {
+	const char* types[] = {MARKER_PREFIX, BUBBLE_PREFIX, TABULAR_PREFIX};
+	EnrichableFrameFilter* subscriptions[] = {&subscriptionMarker, &subscriptionBubble, &subscriptionTabular};
+	std::stringstream outputStream;
+	char result[1024];
+	std::string value;
+
+	outputStream << SUBSCRIPTIONS_PREFIX;
+	for(const char* type: types) {
+		outputStream << UNIT_SEPARATOR;
+		outputStream << type;
+	}
+	outputStream << LINE_SEPARATOR;
+	value = outputStream.str();
+
+	GetScriptResponse(
+		EnrichableAnalyzerStats::Feature,
+		value.c_str(),
+		value.length(),
+		result,
+		1024
+	);
+
+	// One filter expression per message type, in the order asked; missing
+	// or empty ones subscribe to every frame.
+	std::stringstream inputStream(result);
+	std::string answer;
+	for(unsigned i = 0; i < 3; i++) {
+		if(!std::getline(inputStream, answer, UNIT_SEPARATOR)) {
+			answer = "";
+		}
+
+		std::string error;
+		if(!subscriptions[i]->Compile(answer, &error)) {
+			std::cerr << "Ignoring subscription for message type \"";
+			std::cerr << types[i];
+			std::cerr << "\": ";
+			std::cerr << error;
+			std::cerr << "\n";
+			subscriptions[i]->Compile("", &error);
+		} else if(answer.length()) {
+			std::cerr << "message type \"";
+			std::cerr << types[i];
+			std::cerr << "\" subscribed to: ";
+			std::cerr << answer;
+			std::cerr << "\n";
+		}
+	}
+}
+
+bool EnrichableAnalyzerSubprocess::LockSubprocess(EnrichableRequestScheduler::Priority priority) {
+	return host->scheduler.Lock(priority);
 }
 
 void EnrichableAnalyzerSubprocess::UnlockSubprocess() {
-	subprocessLock.unlock();
+	host->scheduler.Unlock();
+}
+
+void EnrichableAnalyzerSubprocess::BeginRequest(
+	EnrichableAnalyzerStats::MessageType messageType,
+	U64 frameIndex,
+	EnrichableRequestScheduler::Priority priority
+) {
+	// Two clock reads are negligible next to a pipe round-trip, so they are
+	// taken unconditionally; whether to record is decided under the lock.
+	U64 lockStart = EnrichableAnalyzerStats::Now();
+	bool promoted = LockSubprocess(priority);
+
+	requestType = messageType;
+	requestPriority = priority;
+	requestPromoted = promoted;
+	requestFrameIndex = frameIndex;
+	requestLockStart = lockStart;
+	requestStart = EnrichableAnalyzerStats::Now();
+	requestBytesSent = 0;
+	requestBytesReceived = 0;
+}
+
+void EnrichableAnalyzerSubprocess::EndRequest() {
+	U64 requestEnd = EnrichableAnalyzerStats::Now();
+
+	if(stats.Enabled()) {
+		stats.RecordRequest(
+			requestType,
+			requestStart - requestLockStart,
+			requestEnd - requestStart,
+			requestBytesSent,
+			requestBytesReceived
+		);
+		stats.RecordQueueWait(requestPriority, requestStart - requestLockStart, requestPromoted);
+	}
+	if(trace.Enabled()) {
+		trace.Record("lock wait", requestLockStart, requestStart);
+		trace.Record(
+			EnrichableAnalyzerStats::GetMessageTypeName(requestType),
+			requestStart,
+			requestEnd,
+			requestFrameIndex
+		);
+	}
+
+	UnlockSubprocess();
 }
 
 bool EnrichableAnalyzerSubprocess::GetScriptResponse(
+	EnrichableAnalyzerStats::MessageType messageType,
 	const char* outBuffer,
 	unsigned outBufferLength,
 	char* inBuffer,
@@ -363,20 +970,79 @@ bool EnrichableAnalyzerSubprocess::GetScriptResponse(
 ) {
 	bool result;
 
-	LockSubprocess();
+	BeginRequest(messageType);
 	SendOutputLine(outBuffer, outBufferLength);
 	result = GetInputLine(inBuffer, inBufferLength);
-	UnlockSubprocess();
+	EndRequest();
 
 	return result;
 }
 
+void EnrichableAnalyzerSubprocess::GetTextLines(char* buffer, unsigned bufferLength, EnrichableTextLines* lines) {
+	if(strings->GetBytes() > STRING_TABLE_MAX_BYTES) {
+		strings.reset(new EnrichableStringTable());
+	}
+	while(GetInputLine(buffer, bufferLength)) {
+		lines->Add(strings, buffer, strlen(buffer));
+	}
+}
+
+void EnrichableAnalyzerSubprocess::SetStatsFile(std::string path) {
+	stats.Reset();
+	stats.SetOutputFile(path);
+}
+
+bool EnrichableAnalyzerSubprocess::StatsEnabled() {
+	return stats.Enabled();
+}
+
+void EnrichableAnalyzerSubprocess::RecordDecode(U64 duration) {
+	stats.RecordDecode(duration);
+}
+
+void EnrichableAnalyzerSubprocess::WriteStats(bool force) {
+	stats.Write(force);
+}
+
+EnrichableTrace* EnrichableAnalyzerSubprocess::GetTrace() {
+	return &trace;
+}
+
+EnrichableFrameTee* EnrichableAnalyzerSubprocess::GetFrameTee() {
+	return &frameTee;
+}
+
 bool EnrichableAnalyzerSubprocess::SendOutputLine(const char* buffer, unsigned bufferLength) {
 	#ifdef SUBPROCESS_DEBUG
 		std::cerr << ">> ";
 		std::cerr << buffer;
 	#endif
-	write(outpipefd[1], buffer, bufferLength);
+	requestBytesSent += bufferLength;
+	if(recording.GetMode() == EnrichableScriptRecording::Replay) {
+		recording.BeginReply(buffer, bufferLength);
+		return true;
+	}
+	if(recording.GetMode() == EnrichableScriptRecording::Record) {
+		recording.RecordRequest(buffer, bufferLength);
+	}
+	if(abandoned) {
+		return false;
+	}
+
+	if(sharedHost) {
+		char prefix[16];
+		int prefixLength = snprintf(prefix, sizeof(prefix), "%x%c", instanceId, UNIT_SEPARATOR);
+
+		struct iovec parts[2];
+		parts[0].iov_base = prefix;
+		parts[0].iov_len = prefixLength;
+		parts[1].iov_base = (void*)buffer;
+		parts[1].iov_len = bufferLength;
+		writev(host->outpipefd[1], parts, 2);
+		requestBytesSent += prefixLength;
+	} else {
+		write(host->outpipefd[1], buffer, bufferLength);
+	}
 
 	return true;
 }
@@ -389,8 +1055,52 @@ bool EnrichableAnalyzerSubprocess::GetInputLine(char* buffer, unsigned bufferLen
 		std::cerr << "<< ";
 	#endif
 
+	if(recording.GetMode() == EnrichableScriptRecording::Replay) {
+		result = recording.NextReplyLine(buffer, bufferLength);
+		requestBytesReceived += strlen(buffer) + 1;
+		#ifdef SUBPROCESS_DEBUG
+			std::cerr << buffer;
+			std::cerr << '\n';
+		#endif
+		return result;
+	}
+	if(abandoned) {
+		buffer[0] = '\0';
+		return false;
+	}
+
+	// Replies to requests an analyzer gave up on come first; they are
+	// dropped.
+	while(host->abandonedLines > 0) {
+		char skipped;
+		int result = ReadScriptByte(&skipped);
+		if(result < 0) {
+			abandoned = true;
+			host->abandonedLines++;
+			buffer[0] = '\0';
+			return false;
+		}
+		if(result == 0) {
+			host->abandonedLines = 0;
+		} else if(skipped == '\n') {
+			host->abandonedLines--;
+		}
+	}
+
 	while(true) {
-		int result = read(inpipefd[0], &buffer[bufferPos], 1);
+		int result = ReadScriptByte(&buffer[bufferPos]);
+		// The analyzer is stopping; the rest of the reply is left to be
+		// dropped by the next request.
+		if(result < 0) {
+			abandoned = true;
+			host->abandonedLines++;
+			bufferPos = 0;
+			break;
+		}
+		// The script has exited.
+		if(result == 0) {
+			break;
+		}
 		if(buffer[bufferPos] == '\n') {
 			break;
 		}
@@ -406,6 +1116,10 @@ bool EnrichableAnalyzerSubprocess::GetInputLine(char* buffer, unsigned bufferLen
 		}
 	}
 	buffer[bufferPos] = '\0';
+	requestBytesReceived += bufferPos + 1;
+	if(recording.GetMode() == EnrichableScriptRecording::Record && !abandoned) {
+		recording.RecordReply(buffer, bufferPos);
+	}
 
 	#ifdef SUBPROCESS_DEBUG
 		std::cerr << '\n';
@@ -418,6 +1132,26 @@ bool EnrichableAnalyzerSubprocess::GetInputLine(char* buffer, unsigned bufferLen
 	return result;
 }
 
+int EnrichableAnalyzerSubprocess::ReadScriptByte(char* byte) {
+	if(sharedHost && !Ready()) {
+		struct pollfd input;
+		input.fd = host->inpipefd[0];
+		input.events = POLLIN;
+		while(true) {
+			if(stopping.load()) {
+				return -1;
+			}
+			int ready = poll(&input, 1, START_POLL_INTERVAL_MS);
+			// End-of-file and errors are left to `read` to report.
+			if(ready > 0 || (ready < 0 && errno != EINTR)) {
+				break;
+			}
+		}
+	}
+
+	return read(host->inpipefd[0], byte, 1) > 0 ? 1 : 0;
+}
+
 AnalyzerResults::MarkerType EnrichableAnalyzerSubprocess::GetMarkerType(char* buffer, unsigned bufferLength) {
 	AnalyzerResults::MarkerType markerType = AnalyzerResults::Dot;
 
@@ -1,19 +1,76 @@
 #pragma once
 
 #include "AnalyzerResults.h"
+#include "EnrichableAnalyzerStats.h"
+#include "EnrichableFrameFilter.h"
+#include "EnrichableFrameTee.h"
+#include "EnrichableRequestScheduler.h"
+#include "EnrichableScriptRecording.h"
+#include "EnrichableStringTable.h"
+#include "EnrichableTrace.h"
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
 #include <string>
 
+#include <sys/types.h>
+
 //#define SUBPROCESS_DEBUG
 
 #define BUBBLE_PREFIX "bubble"
+#define COMBINED_BUBBLE_PREFIX "bubble2"
 #define MARKER_PREFIX "marker"
 #define TABULAR_PREFIX "tabular"
 #define FEATURE_PREFIX "feature"
+#define FEATURES_PREFIX "features"
+#define SUBSCRIPTIONS_PREFIX "subscriptions"
+#define RESET_PREFIX "reset"
+#define RESET_ACKNOWLEDGEMENT "ok"
+
+// Once the text kept for drawn frames outgrows this, it starts over.
+#define TEXT_CACHE_MAX_BYTES (U64(32) << 20)
+
+// Once the enrichment text table outgrows this, replies go into a fresh one;
+// text already handed out keeps the old table alive until it is dropped.
+#define STRING_TABLE_MAX_BYTES (U64(16) << 20)
 
 #define UNIT_SEPARATOR '\t'
 #define LINE_SEPARATOR '\n'
 
+// A running script and the pipes to it.  Each analyzer has one of its own,
+// unless it shares one with every other analyzer running the same command.
+// The script is stopped when the last analyzer using it lets go.
+struct EnrichableScriptHost {
+	EnrichableScriptHost();
+	~EnrichableScriptHost();
+
+	void StopProcess();
+	// Kills the script without waiting for it, so that a thread blocked
+	// reading its replies gets end-of-file.
+	void Interrupt();
+
+	// Held from sending a request until its reply has been read, so
+	// requests from the analyzers sharing the script don't interleave.
+	EnrichableRequestScheduler scheduler;
+	// Held while the script is started, reset or stopped.
+	std::mutex launchLock;
+
+	std::string command;
+	// Read without the launch lock by `Interrupt`.
+	std::atomic<pid_t> pid;
+	int inpipefd[2];
+	int outpipefd[2];
+	// The next analyzer to share the script gets this id.
+	U32 nextInstance;
+	// Reply lines owed to requests an analyzer stopped waiting for; the
+	// next request reads and drops them first.  Only used while holding
+	// the scheduler.
+	U32 abandonedLines;
+};
+
 class EnrichableAnalyzerSubprocess {
 	public:
 		struct Marker {
@@ -28,21 +85,84 @@ class EnrichableAnalyzerSubprocess {
 		virtual ~EnrichableAnalyzerSubprocess();
 
 		void SetParserCommand(std::string);
+		// With `share` set, one script serves every analyzer in this
+		// process that shares its command; each request it receives starts
+		// with the id of the analyzer making it.  Takes effect at `Start`.
+		void SetShareScript(bool share);
+		// Records the conversation with the script to `path`, or answers
+		// from a recording made earlier instead of starting the script;
+		// takes effect at `Start`.
+		void SetRecording(std::string path, EnrichableScriptRecording::Mode mode);
 
 		std::vector<Marker> EmitMarker(U64 packetId, U64 frameIndex, Frame& frame, U32 sampleCount);
-		std::vector<std::string> EmitBubble(U64 packetId, U64 frameIndex, Frame& frame, std::string channelName);
-		std::vector<std::string> EmitTabular(U64 packetId, U64 frameIndex, Frame& frame);
+		EnrichableTextLines EmitBubble(U64 packetId, U64 frameIndex, Frame& frame, std::string channelName);
+		// Tabular text is `Interactive` when Logic shows it and `Background`
+		// when it is exported.
+		EnrichableTextLines EmitTabular(
+			U64 packetId,
+			U64 frameIndex,
+			Frame& frame,
+			EnrichableRequestScheduler::Priority priority=EnrichableRequestScheduler::Interactive
+		);
 
+		// Frames the filter rejects are never sent to the script; callers
+		// format them natively instead.  An invalid expression is reported
+		// and selects every frame.
+		void SetFrameFilter(std::string expression);
+		// Only frames overlapping samples `firstSample` to `lastSample` are
+		// sent to the script; the others are formatted natively, as if the
+		// filter had rejected them.
+		void SetRegion(U64 firstSample, U64 lastSample);
+		// Whether a `type` request for `frame` passes the region, the filter
+		// and the script's subscriptions; the latter are only checked once
+		// the script is ready, so the `Emit` methods check again.
+		// Rejections are counted in the statistics.
+		bool FrameSelected(EnrichableAnalyzerStats::MessageType type, const Frame& frame);
+
+		// These wait for the script to finish starting.
 		bool MarkerEnabled();
 		bool BubbleEnabled();
 		bool TabularEnabled();
 
+		// Starts the parser command, or, if a script for the same command is
+		// still running from a previous run, asks it to reset and reuses it.
+		// This happens on a background thread; requests wait for it to
+		// finish, and `Ready` tells whether they would have to.
 		void Start();
-		void Stop(int exitCode=0);
+		bool Ready();
+		void WaitUntilReady();
+		// Ends the script, closes the frame output and the statistics and
+		// trace files; the script is given a second to exit before it is
+		// killed.
+		void Stop();
+
+		// Statistics are collected only while a statistics file is set;
+		// setting one starts a new collection.
+		void SetStatsFile(std::string path);
+		bool StatsEnabled();
+		void RecordDecode(U64 duration);
+		void WriteStats(bool force);
+
+		// Script requests are recorded as spans while tracing is enabled.
+		EnrichableTrace* GetTrace();
+		// Decoded frames go here while an output is set.
+		EnrichableFrameTee* GetFrameTee();
 	protected:
+		void AttachHost();
 		void Terminate();
+		void StartProcess();
+		void LaunchProcess();
+		// Asks the script which messages it wants, and for which frames.
+		void GetFeatures();
+		// Unblocks a start thread stuck on a script that doesn't answer,
+		// then waits for it.
+		void InterruptStartThread();
+		void JoinStartThread();
+		bool Reset();
+		void StopProcess();
 
 		bool GetScriptResponse(
+			EnrichableAnalyzerStats::MessageType messageType,
 			const char* outBuffer,
 			unsigned outBufferLength,
 			char* inBuffer,
@@ -50,19 +170,101 @@ class EnrichableAnalyzerSubprocess {
 		);
 		bool SendOutputLine(const char* buffer, unsigned bufferLength);
 		bool GetInputLine(char* buffer, unsigned bufferLength);
-		void LockSubprocess();
+		// Reads one byte of the script's output: returns 1, or 0 at
+		// end-of-file.  While starting on a shared script, which can't be
+		// interrupted, this polls instead of blocking, and returns -1 once
+		// the analyzer is stopping.
+		int ReadScriptByte(char* byte);
+		// Reads lines into `lines` up to the empty line ending the list.
+		void GetTextLines(char* buffer, unsigned bufferLength, EnrichableTextLines* lines);
+		// Bookkeeping holds the lock briefly and never talks to the script,
+		// so it doesn't queue behind background requests.
+		bool LockSubprocess(EnrichableRequestScheduler::Priority priority=EnrichableRequestScheduler::Interactive);
 		void UnlockSubprocess();
+		void BeginRequest(
+			EnrichableAnalyzerStats::MessageType messageType,
+			U64 frameIndex=TRACE_NO_ARG,
+			EnrichableRequestScheduler::Priority priority=EnrichableRequestScheduler::Background
+		);
+		void EndRequest();
 		bool GetFeatureEnablement(const char* feature);
+		bool GetFeatureEnablements();
+		EnrichableTextLines EmitCombinedBubble(U64 packetId, U64 frameIndex, Frame& frame, unsigned channel);
+		void GetSubscriptions();
+		const EnrichableFrameFilter& GetSubscription(EnrichableAnalyzerStats::MessageType type);
 		AnalyzerResults::MarkerType GetMarkerType(char* buffer, unsigned bufferLength);
 
 		std::string parserCommand;
 		bool enabled;
 
+		bool shareScript;
+		std::shared_ptr<EnrichableScriptHost> host;
+		// Whether `host` is shared, and this analyzer's id on it.
+		bool sharedHost;
+		U32 instanceId;
+
+		std::string recordingPath;
+		EnrichableScriptRecording::Mode recordingMode;
+		// Only used while holding the host's lock.
+		EnrichableScriptRecording recording;
+
 		bool featureMarker;
 		bool featureBubble;
 		bool featureTabular;
+		// Only scripts answering "yes" for `bubble2` get it.
+		bool featureCombinedBubble;
+
+		// Each frame's bubbles and tabular text, as the script answered for
+		// them this run.
+		EnrichableTextCache textCache;
+
+		// Only used while holding the host's lock.
+		std::shared_ptr<EnrichableStringTable> strings;
+
+		// What `FrameSelected` checks ahead of the subscriptions; selects
+		// every frame until `SetFrameFilter` and `SetRegion` say otherwise.
+		struct FrameSelection {
+			FrameSelection(): regionFirstSample(0), regionLastSample(~U64(0)) {}
+
+			EnrichableFrameFilter filter;
+			U64 regionFirstSample;
+			U64 regionLastSample;
+		};
+		std::string frameFilterExpression;
+		// Replaced whole by the worker thread's `SetFrameFilter` and
+		// `SetRegion` while Logic's UI thread may be matching bubbles
+		// against it, so only accessed with `std::atomic_load` and
+		// `std::atomic_store`.
+		std::shared_ptr<const FrameSelection> frameSelection;
+		EnrichableFrameFilter subscriptionMarker;
+		EnrichableFrameFilter subscriptionBubble;
+		EnrichableFrameFilter subscriptionTabular;
+
+		std::thread startThread;
+		std::atomic<bool> started;
+		// The host the start thread is launching, whether it is shared, and
+		// whether the start thread should give up; only used by `Start` and
+		// `InterruptStartThread`, besides the start thread's check of
+		// `stopping`.
+		std::shared_ptr<EnrichableScriptHost> startingHost;
+		bool startingShared;
+		std::atomic<bool> stopping;
+		// Set once the start thread has given up on a shared script; nothing
+		// more is sent to it or read from it this run.
+		bool abandoned;
+		std::mutex startLock;
+		std::condition_variable startCondition;
+
+		EnrichableAnalyzerStats stats;
+		EnrichableTrace trace;
+		EnrichableFrameTee frameTee;
+		EnrichableAnalyzerStats::MessageType requestType;
+		EnrichableRequestScheduler::Priority requestPriority;
+		bool requestPromoted;
+		U64 requestFrameIndex;
+		U64 requestLockStart;
+		U64 requestStart;
+		U64 requestBytesSent;
+		U64 requestBytesReceived;
 
-		pid_t commandPid = 0;
-		int inpipefd[2];
-		int outpipefd[2];
 };
@@ -0,0 +1,173 @@
+#include "EnrichableFrameFilter.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace {
+	class FilterParser {
+		public:
+			FilterParser(const std::string& expression):
+				text(expression.c_str()),
+				position(0)
+			{
+			}
+
+			void SkipSpace() {
+				while(isspace((unsigned char)text[position])) {
+					position++;
+				}
+			}
+
+			bool AtEnd() {
+				SkipSpace();
+				return text[position] == '\0';
+			}
+
+			bool Accept(const char* token) {
+				SkipSpace();
+				size_t length = strlen(token);
+				if(strncmp(text + position, token, length) != 0) {
+					return false;
+				}
+				// `&` must not swallow the first half of `&&`.
+				if(length == 1 && text[position + 1] == token[0]) {
+					return false;
+				}
+				position += length;
+				return true;
+			}
+
+			bool Word(std::string* word) {
+				SkipSpace();
+				size_t start = position;
+				while(isalpha((unsigned char)text[position])) {
+					position++;
+				}
+				word->assign(text + start, position - start);
+				return !word->empty();
+			}
+
+			bool Number(U64* number) {
+				SkipSpace();
+				const char* start = text + position;
+				int base = 10;
+				if(start[0] == '0' && (start[1] == 'x' || start[1] == 'X')) {
+					base = 16;
+					start += 2;
+				} else if(start[0] == '0' && (start[1] == 'b' || start[1] == 'B')) {
+					base = 2;
+					start += 2;
+				}
+				if(!isxdigit((unsigned char)*start)) {
+					return false;
+				}
+
+				char* end;
+				errno = 0;
+				*number = strtoull(start, &end, base);
+				if(errno != 0 || isalnum((unsigned char)*end)) {
+					return false;
+				}
+				position = end - text;
+				return true;
+			}
+
+			std::string Error(const char* message) {
+				SkipSpace();
+				std::string error = message;
+				if(text[position] == '\0') {
+					return error + " at the end of the filter";
+				}
+				return error + " at \"" + std::string(text + position) + "\"";
+			}
+
+		private:
+			const char* text;
+			size_t position;
+	};
+}
+
+EnrichableFrameFilter::EnrichableFrameFilter():
+	matchesEverything(true)
+{
+}
+
+bool EnrichableFrameFilter::Compile(const std::string& expression, std::string* error) {
+	static const char* fieldNames[FilterFieldCount] = { "mosi", "miso", "index", "flags" };
+
+	FilterParser parser(expression);
+	std::vector<Clause> compiled;
+	bool anyClause = !parser.AtEnd();
+
+	while(anyClause) {
+		Clause clause;
+		memset(&clause, 0, sizeof(clause));
+		bool satisfiable = true;
+
+		do {
+			std::string word;
+			int field = FilterFieldCount;
+			if(parser.Word(&word)) {
+				for(int i = 0; i < FilterFieldCount; i++) {
+					if(word == fieldNames[i]) {
+						field = i;
+					}
+				}
+			}
+			if(field == FilterFieldCount) {
+				*error = parser.Error("Expected mosi, miso, index or flags");
+				return false;
+			}
+
+			U64 mask = ~0ull;
+			if(parser.Accept("&") && !parser.Number(&mask)) {
+				*error = parser.Error("Expected a mask");
+				return false;
+			}
+
+			U64 value;
+			if(!parser.Accept("==")) {
+				*error = parser.Error("Expected ==");
+				return false;
+			}
+			if(!parser.Number(&value)) {
+				*error = parser.Error("Expected a value");
+				return false;
+			}
+			if((value & ~mask) != 0) {
+				*error = "The value of \"" + word + "\" has bits outside of its mask and can never match";
+				return false;
+			}
+
+			// Two terms disagreeing about a bit make the clause impossible.
+			U64 shared = clause.mask[field] & mask;
+			if((clause.value[field] & shared) != (value & shared)) {
+				satisfiable = false;
+			}
+			clause.mask[field] |= mask;
+			clause.value[field] |= value;
+		} while(parser.Accept("&&"));
+
+		if(satisfiable) {
+			compiled.push_back(clause);
+		}
+
+		if(parser.AtEnd()) {
+			break;
+		}
+		if(!parser.Accept("||")) {
+			*error = parser.Error("Expected && or ||");
+			return false;
+		}
+	}
+
+	matchesEverything = !anyClause;
+	clauses.swap(compiled);
+	return true;
+}
+
+bool EnrichableFrameFilter::MatchesEverything() const {
+	return matchesEverything;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <AnalyzerResults.h>
+#include <string>
+#include <vector>
+
+// Decides natively which frames are worth a request to the enrichment
+// script.  An expression such as
+//
+//     mosi & 0xF0 == 0x90 && index == 0 || miso == 0xFF
+//
+// is compiled into clauses of mask/value pairs, one per frame field, so
+// matching a frame costs a few ANDs and compares.  `&&` binds tighter than
+// `||`.  The fields are `mosi` (`mData1`), `miso` (`mData2`), `index` (the
+// frame's position within its packet, `mType`) and `flags` (`mFlags`);
+// numbers may be decimal, `0x` hexadecimal or `0b` binary.  An empty
+// expression matches every frame.
+class EnrichableFrameFilter {
+	public:
+		EnrichableFrameFilter();
+
+		// Replaces the filter; on a syntax error, `error` describes it and
+		// the filter is left unchanged.
+		bool Compile(const std::string& expression, std::string* error);
+		bool MatchesEverything() const;
+
+		bool Matches(const Frame& frame) const {
+			if(matchesEverything) {
+				return true;
+			}
+			for(const Clause& clause : clauses) {
+				if((U64(frame.mData1) & clause.mask[FilterMosi]) == clause.value[FilterMosi]
+					&& (U64(frame.mData2) & clause.mask[FilterMiso]) == clause.value[FilterMiso]
+					&& (U64(frame.mType) & clause.mask[FilterIndex]) == clause.value[FilterIndex]
+					&& (U64(frame.mFlags) & clause.mask[FilterFlags]) == clause.value[FilterFlags]) {
+					return true;
+				}
+			}
+			return false;
+		}
+
+	protected:
+		enum Field {
+			FilterMosi,
+			FilterMiso,
+			FilterIndex,
+			FilterFlags,
+			FilterFieldCount
+		};
+
+		// Every term of a clause must hold; the terms on one field are
+		// merged into a single mask/value pair.
+		struct Clause {
+			U64 mask[FilterFieldCount];
+			U64 value[FilterFieldCount];
+		};
+
+		bool matchesEverything;
+		std::vector<Clause> clauses;
+};
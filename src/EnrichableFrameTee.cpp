@@ -0,0 +1,304 @@
+#include "EnrichableFrameTee.h"
+
+#include <chrono>
+#include <iostream>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#define FRAME_TEE_RECONNECT_MS 100
+#define FRAME_TEE_IDLE_WAIT_MS 100
+#define FRAME_TEE_FULL_WAIT_MS 10
+#define FRAME_TEE_POLL_MS 100
+// How long `Close` keeps sending to a reader that has stopped reading.
+#define FRAME_TEE_CLOSE_TIMEOUT_MS 1000
+
+EnrichableFrameTee::EnrichableFrameTee():
+	policy(DropWhenFull),
+	enabled(false),
+	connected(false),
+	stopping(false),
+	head(0),
+	tail(0),
+	writerSleeping(false),
+	published(0),
+	dropped(0),
+	blocked(0),
+	bytesWritten(0)
+{
+}
+
+EnrichableFrameTee::~EnrichableFrameTee() {
+	Close();
+}
+
+void EnrichableFrameTee::SetOutput(std::string path, Policy newPolicy) {
+	if(enabled && path == outputPath && newPolicy == policy) {
+		return;
+	}
+
+	Close();
+	if(path.empty()) {
+		return;
+	}
+
+	if(ring.empty()) {
+		ring.resize(FRAME_TEE_RING_RECORDS);
+	}
+	outputPath = path;
+	policy = newPolicy;
+	head = 0;
+	tail = 0;
+	published = 0;
+	dropped = 0;
+	blocked = 0;
+	bytesWritten = 0;
+	stopping = false;
+	enabled = true;
+
+	// A reader that is already waiting gets every frame from the first.
+	int fd = Connect();
+	connected = fd >= 0;
+	writer = std::thread(&EnrichableFrameTee::WriterThread, this, fd);
+}
+
+bool EnrichableFrameTee::Enabled() const {
+	return enabled.load(std::memory_order_relaxed);
+}
+
+void EnrichableFrameTee::Publish(U64 frameIndex, const Frame& frame) {
+	if(!enabled.load(std::memory_order_relaxed)) {
+		return;
+	}
+	published.fetch_add(1, std::memory_order_relaxed);
+	if(!connected.load(std::memory_order_acquire)) {
+		dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	U64 position = head.load(std::memory_order_relaxed);
+	if(position - tail.load(std::memory_order_acquire) >= FRAME_TEE_RING_RECORDS) {
+		if(policy == DropWhenFull) {
+			dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		blocked.fetch_add(1, std::memory_order_relaxed);
+		std::unique_lock<std::mutex> guard(lock);
+		while(position - tail.load(std::memory_order_acquire) >= FRAME_TEE_RING_RECORDS
+			&& connected.load(std::memory_order_acquire)
+			&& !stopping.load(std::memory_order_acquire)) {
+			wake.wait_for(guard, std::chrono::milliseconds(FRAME_TEE_FULL_WAIT_MS));
+		}
+		// The reader went away while we waited.
+		if(position - tail.load(std::memory_order_acquire) >= FRAME_TEE_RING_RECORDS) {
+			dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+	}
+
+	FrameTeeRecord& record = ring[position & (FRAME_TEE_RING_RECORDS - 1)];
+	record.frameIndex = frameIndex;
+	record.startingSample = frame.mStartingSampleInclusive;
+	record.endingSample = frame.mEndingSampleInclusive;
+	record.mosi = frame.mData1;
+	record.miso = frame.mData2;
+	record.index = frame.mType;
+	record.flags = frame.mFlags;
+	memset(record.reserved, 0, sizeof(record.reserved));
+	head.store(position + 1);
+
+	if(writerSleeping.load()) {
+		Wake();
+	}
+}
+
+void EnrichableFrameTee::Close() {
+	if(!writer.joinable()) {
+		return;
+	}
+
+	stopping = true;
+	Wake();
+	writer.join();
+	enabled = false;
+	Discard();
+}
+
+U64 EnrichableFrameTee::GetPublished() const {
+	return published.load(std::memory_order_relaxed);
+}
+
+U64 EnrichableFrameTee::GetDropped() const {
+	return dropped.load(std::memory_order_relaxed);
+}
+
+U64 EnrichableFrameTee::GetBlocked() const {
+	return blocked.load(std::memory_order_relaxed);
+}
+
+U64 EnrichableFrameTee::GetBytesWritten() const {
+	return bytesWritten.load(std::memory_order_relaxed);
+}
+
+void EnrichableFrameTee::Wake() {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+	}
+	wake.notify_all();
+}
+
+void EnrichableFrameTee::Discard() {
+	U64 position = head.load();
+	dropped.fetch_add(position - tail.load(), std::memory_order_relaxed);
+	tail.store(position);
+}
+
+int EnrichableFrameTee::Connect() {
+	struct stat info;
+	if(stat(outputPath.c_str(), &info) != 0) {
+		return -1;
+	}
+
+	int fd = -1;
+	if(S_ISFIFO(info.st_mode)) {
+		// Fails with ENXIO until the pipe has a reader.
+		fd = open(outputPath.c_str(), O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+	} else if(S_ISSOCK(info.st_mode)) {
+		struct sockaddr_un address;
+		memset(&address, 0, sizeof(address));
+		address.sun_family = AF_UNIX;
+		if(outputPath.length() >= sizeof(address.sun_path)) {
+			return -1;
+		}
+		strcpy(address.sun_path, outputPath.c_str());
+
+		fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if(fd < 0) {
+			return -1;
+		}
+		if(connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+			close(fd);
+			return -1;
+		}
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	}
+	return fd;
+}
+
+bool EnrichableFrameTee::WriteAll(int fd, const char* data, size_t length) {
+	U64 waited = 0;
+	while(length > 0) {
+		ssize_t written = write(fd, data, length);
+		if(written > 0) {
+			data += written;
+			length -= written;
+			waited = 0;
+			continue;
+		}
+		if(written < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+			return false;
+		}
+
+		if(stopping.load() && waited >= FRAME_TEE_CLOSE_TIMEOUT_MS) {
+			return false;
+		}
+		struct pollfd descriptor;
+		descriptor.fd = fd;
+		descriptor.events = POLLOUT;
+		descriptor.revents = 0;
+		poll(&descriptor, 1, FRAME_TEE_POLL_MS);
+		waited += FRAME_TEE_POLL_MS;
+	}
+	return true;
+}
+
+void EnrichableFrameTee::WriterThread(int fd) {
+	// A reader closing its end must fail the write, not end the process.
+	sigset_t pipeSignal;
+	sigemptyset(&pipeSignal);
+	sigaddset(&pipeSignal, SIGPIPE);
+	pthread_sigmask(SIG_BLOCK, &pipeSignal, NULL);
+
+	bool reportedInvalid = false;
+	while(true) {
+		if(fd < 0) {
+			if(stopping.load()) {
+				break;
+			}
+			fd = Connect();
+			if(fd < 0) {
+				struct stat info;
+				if(!reportedInvalid && stat(outputPath.c_str(), &info) == 0
+					&& !S_ISFIFO(info.st_mode) && !S_ISSOCK(info.st_mode)) {
+					std::cerr << "Frame output is neither a named pipe nor a Unix domain socket: ";
+					std::cerr << outputPath;
+					std::cerr << "\n";
+					reportedInvalid = true;
+				}
+
+				std::unique_lock<std::mutex> guard(lock);
+				if(!stopping.load()) {
+					wake.wait_for(guard, std::chrono::milliseconds(FRAME_TEE_RECONNECT_MS));
+				}
+				continue;
+			}
+			connected.store(true, std::memory_order_release);
+		}
+
+		U64 position = tail.load(std::memory_order_relaxed);
+		U64 end = head.load(std::memory_order_acquire);
+		if(position == end) {
+			if(stopping.load()) {
+				break;
+			}
+
+			std::unique_lock<std::mutex> guard(lock);
+			writerSleeping.store(true);
+			if(head.load() == position && !stopping.load()) {
+				wake.wait_for(guard, std::chrono::milliseconds(FRAME_TEE_IDLE_WAIT_MS));
+			}
+			writerSleeping.store(false);
+			continue;
+		}
+
+		// Up to the end of the ring; the rest goes on the next pass.
+		size_t first = position & (FRAME_TEE_RING_RECORDS - 1);
+		size_t count = end - position;
+		if(count > FRAME_TEE_RING_RECORDS - first) {
+			count = FRAME_TEE_RING_RECORDS - first;
+		}
+
+		if(!WriteAll(fd, (const char*)&ring[first], count * sizeof(FrameTeeRecord))) {
+			if(!stopping.load()) {
+				std::cerr << "Frame output reader went away: ";
+				std::cerr << outputPath;
+				std::cerr << "\n";
+			}
+			close(fd);
+			fd = -1;
+			connected.store(false, std::memory_order_release);
+			Discard();
+			Wake();
+			continue;
+		}
+
+		bytesWritten.fetch_add(count * sizeof(FrameTeeRecord), std::memory_order_relaxed);
+		tail.store(position + count, std::memory_order_release);
+		if(policy == BlockWhenFull) {
+			Wake();
+		}
+	}
+
+	if(fd >= 0) {
+		close(fd);
+	}
+	connected.store(false, std::memory_order_release);
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <AnalyzerResults.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Records the ring holds; a power of two.
+#define FRAME_TEE_RING_RECORDS 65536
+
+// One decoded frame as written to the frame output, in host byte order.
+struct FrameTeeRecord {
+	U64 frameIndex;
+	U64 startingSample;
+	U64 endingSample;
+	U64 mosi;
+	U64 miso;
+	// The frame's position within its packet (`mType`).
+	U8 index;
+	U8 flags;
+	U8 reserved[6];
+};
+
+// Streams decoded frames to another program while decoding, through a named
+// pipe or a Unix domain socket.
+//
+// The decoder copies each frame into a bounded ring without taking a lock; a
+// writer thread sends the ring's contents on.  When the reader falls behind
+// and the ring fills, frames are either dropped or decoding waits for room,
+// as chosen.  Until a reader is connected -- the writer keeps trying -- and
+// after it goes away, frames are dropped whatever the policy, so a missing
+// reader never holds decoding up.
+class EnrichableFrameTee {
+	public:
+		enum Policy {
+			DropWhenFull,
+			BlockWhenFull
+		};
+
+		EnrichableFrameTee();
+		~EnrichableFrameTee();
+
+		// Starts streaming to `path`, which must be a named pipe or a Unix
+		// domain socket; an empty path disables the output.  The connection
+		// is kept if neither argument changed.
+		void SetOutput(std::string path, Policy policy);
+		bool Enabled() const;
+
+		// Called by the decoder, from one thread at a time.
+		void Publish(U64 frameIndex, const Frame& frame);
+
+		// Sends whatever is still queued, if a reader is connected, and
+		// stops the writer.
+		void Close();
+
+		U64 GetPublished() const;
+		U64 GetDropped() const;
+		// Frames that had to wait for room in the ring.
+		U64 GetBlocked() const;
+		U64 GetBytesWritten() const;
+
+	protected:
+		// `fd` is the output if `SetOutput` could already connect, or -1.
+		void WriterThread(int fd);
+		int Connect();
+		bool WriteAll(int fd, const char* data, size_t length);
+		// Drops everything queued; only the writer, or `Close`, may.
+		void Discard();
+		// Wakes whichever thread is sleeping on `wake`.
+		void Wake();
+
+		std::string outputPath;
+		Policy policy;
+		std::atomic<bool> enabled;
+		std::atomic<bool> connected;
+		std::atomic<bool> stopping;
+
+		std::vector<FrameTeeRecord> ring;
+		// Records published and records consumed; the ring holds the
+		// difference.
+		std::atomic<U64> head;
+		std::atomic<U64> tail;
+
+		// Only used to sleep: the writer while the ring is empty, the
+		// decoder while it is full.
+		std::mutex lock;
+		std::condition_variable wake;
+		std::atomic<bool> writerSleeping;
+
+		std::atomic<U64> published;
+		std::atomic<U64> dropped;
+		std::atomic<U64> blocked;
+		std::atomic<U64> bytesWritten;
+
+		std::thread writer;
+};
@@ -0,0 +1,51 @@
+#include "EnrichableRequestScheduler.h"
+
+EnrichableRequestScheduler::EnrichableRequestScheduler():
+	held(false),
+	interactiveStreak(0)
+{
+	for(unsigned i = 0; i < PriorityCount; i++) {
+		waiting[i] = 0;
+	}
+}
+
+EnrichableRequestScheduler::Priority EnrichableRequestScheduler::Next() {
+	if(waiting[Interactive] > 0 && !(waiting[Background] > 0 && interactiveStreak >= SCHEDULER_INTERACTIVE_STREAK)) {
+		return Interactive;
+	}
+	return waiting[Background] > 0 ? Background : Interactive;
+}
+
+bool EnrichableRequestScheduler::Lock(Priority priority) {
+	std::unique_lock<std::mutex> guard(lock);
+
+	waiting[priority]++;
+	while(held || Next() != priority) {
+		turn.wait(guard);
+	}
+	waiting[priority]--;
+
+	bool promoted = priority == Background && waiting[Interactive] > 0;
+	if(priority == Interactive && waiting[Background] > 0) {
+		interactiveStreak++;
+	} else {
+		interactiveStreak = 0;
+	}
+
+	held = true;
+	return promoted;
+}
+
+void EnrichableRequestScheduler::Unlock() {
+	bool contended;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		held = false;
+		contended = waiting[Interactive] > 0 || waiting[Background] > 0;
+	}
+	// Waiters are few: an analyzer's worker and UI threads, or a handful of
+	// analyzers sharing a script.
+	if(contended) {
+		turn.notify_all();
+	}
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <LogicPublicTypes.h>
+#include <condition_variable>
+#include <mutex>
+
+// After this many interactive requests in a row have gone ahead of a waiting
+// background request, a background request goes next.
+#define SCHEDULER_INTERACTIVE_STREAK 4
+
+// Decides who talks to the script next.  Logic asks for bubbles and tabular
+// text on its UI thread while the worker thread asks for markers, so a plain
+// mutex leaves the UI waiting behind a queue of marker requests.  Here
+// interactive requests go ahead of background ones, and background requests
+// are never passed over more than `SCHEDULER_INTERACTIVE_STREAK` times in a
+// row.  Within a priority, as with a mutex, whoever gets there first goes.
+class EnrichableRequestScheduler {
+	public:
+		enum Priority {
+			// Something Logic is waiting on to draw.
+			Interactive,
+			// Markers, exports and the script's start-up.
+			Background,
+			PriorityCount
+		};
+
+		EnrichableRequestScheduler();
+
+		// Blocks until this thread's turn.  Returns true if a background
+		// request was let through ahead of waiting interactive ones.
+		bool Lock(Priority priority);
+		void Unlock();
+
+	protected:
+		// Whose turn it is once the lock is free; only called with waiters.
+		Priority Next();
+
+		std::mutex lock;
+		std::condition_variable turn;
+		bool held;
+		// Threads waiting for their turn, per priority.
+		U32 waiting[PriorityCount];
+		U32 interactiveStreak;
+};
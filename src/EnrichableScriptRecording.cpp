@@ -0,0 +1,280 @@
+#include "EnrichableScriptRecording.h"
+
+#include <iostream>
+
+#include <string.h>
+
+EnrichableScriptRecording::EnrichableScriptRecording():
+	mode(Off),
+	requests(0),
+	misses(0),
+	output(NULL),
+	pending(false),
+	linesWritten(0),
+	replyPosition(0),
+	replyEnd(0)
+{
+}
+
+EnrichableScriptRecording::~EnrichableScriptRecording() {
+	Close();
+}
+
+bool EnrichableScriptRecording::Open(std::string newPath, Mode newMode) {
+	Close();
+	path = newPath;
+	if(newMode == Off || !path.length()) {
+		return true;
+	}
+
+	if(newMode == Replay) {
+		if(!Load(path)) {
+			lines.clear();
+			replyLines.clear();
+			replies.clear();
+			return false;
+		}
+		std::cerr << "Replaying ";
+		std::cerr << replies.size();
+		std::cerr << " recorded requests from ";
+		std::cerr << path;
+		std::cerr << "\n";
+		mode = Replay;
+		return true;
+	}
+
+	output = fopen(path.c_str(), "wb");
+	if(output == NULL) {
+		std::cerr << "Unable to write script recording: ";
+		std::cerr << path;
+		std::cerr << "\n";
+		return false;
+	}
+	fputs(SCRIPT_RECORDING_MAGIC, output);
+	WriteNumber(SCRIPT_RECORDING_VERSION);
+	mode = Record;
+	return true;
+}
+
+void EnrichableScriptRecording::Close() {
+	if(mode == Record) {
+		WriteExchange();
+		fclose(output);
+		output = NULL;
+		lineIds.clear();
+		lineTexts.clear();
+		linesWritten = 0;
+	} else if(mode == Replay && misses > 0) {
+		std::cerr << misses;
+		std::cerr << " of ";
+		std::cerr << requests;
+		std::cerr << " requests were not in the script recording: ";
+		std::cerr << path;
+		std::cerr << "\n";
+	}
+
+	lines.clear();
+	replyLines.clear();
+	replies.clear();
+	replyPosition = 0;
+	replyEnd = 0;
+	requests = 0;
+	misses = 0;
+	mode = Off;
+}
+
+EnrichableScriptRecording::Mode EnrichableScriptRecording::GetMode() const {
+	return mode;
+}
+
+U64 EnrichableScriptRecording::GetRequests() const {
+	return requests;
+}
+
+U64 EnrichableScriptRecording::GetMisses() const {
+	return misses;
+}
+
+void EnrichableScriptRecording::RecordRequest(const char* buffer, unsigned length) {
+	WriteExchange();
+
+	// Requests end with the line separator; the file doesn't keep it.
+	if(length > 0 && buffer[length - 1] == '\n') {
+		length--;
+	}
+	pendingRequest.assign(buffer, length);
+	pendingLines.clear();
+	pending = true;
+	requests++;
+}
+
+void EnrichableScriptRecording::RecordReply(const char* line, unsigned length) {
+	if(!pending) {
+		return;
+	}
+
+	std::pair<std::unordered_map<std::string, U32>::iterator, bool> found = lineIds.insert(
+		std::make_pair(std::string(line, length), U32(lineTexts.size()))
+	);
+	if(found.second) {
+		lineTexts.push_back(&found.first->first);
+	}
+	pendingLines.push_back(found.first->second);
+}
+
+void EnrichableScriptRecording::WriteNumber(U64 value) {
+	do {
+		U8 byte = value & 0x7f;
+		value >>= 7;
+		if(value) {
+			byte |= 0x80;
+		}
+		fputc(byte, output);
+	} while(value);
+}
+
+void EnrichableScriptRecording::WriteExchange() {
+	if(!pending) {
+		return;
+	}
+
+	WriteNumber(pendingRequest.length());
+	fwrite(pendingRequest.data(), 1, pendingRequest.length(), output);
+	WriteNumber(pendingLines.size());
+	for(U32 id: pendingLines) {
+		WriteNumber(id);
+		// Lines are numbered in the order they were first seen, so a new
+		// one is always the next to be written out.
+		if(id == linesWritten) {
+			const std::string* text = lineTexts[id];
+			WriteNumber(text->length());
+			fwrite(text->data(), 1, text->length(), output);
+			linesWritten++;
+		}
+	}
+	pending = false;
+}
+
+void EnrichableScriptRecording::BeginReply(const char* request, unsigned length) {
+	if(length > 0 && request[length - 1] == '\n') {
+		length--;
+	}
+	key.assign(request, length);
+	requests++;
+
+	std::unordered_map<std::string, std::pair<U32, U32>>::const_iterator found = replies.find(key);
+	if(found == replies.end()) {
+		misses++;
+		replyPosition = 0;
+		replyEnd = 0;
+		return;
+	}
+	replyPosition = found->second.first;
+	replyEnd = found->second.first + found->second.second;
+}
+
+bool EnrichableScriptRecording::NextReplyLine(char* buffer, unsigned bufferLength) {
+	size_t length = 0;
+	if(replyPosition < replyEnd) {
+		const std::string& line = lines[replyLines[replyPosition++]];
+		length = line.length();
+		if(length > bufferLength - 1) {
+			length = bufferLength - 1;
+		}
+		memcpy(buffer, line.data(), length);
+	}
+	buffer[length] = '\0';
+	return length > 0;
+}
+
+bool EnrichableScriptRecording::Load(const std::string& file) {
+	FILE* f = fopen(file.c_str(), "rb");
+	if(f == NULL) {
+		std::cerr << "Unable to read script recording: ";
+		std::cerr << file;
+		std::cerr << "\n";
+		return false;
+	}
+	std::vector<char> data;
+	char chunk[65536];
+	size_t count;
+	while((count = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+		data.insert(data.end(), chunk, chunk + count);
+	}
+	fclose(f);
+
+	const char* position = data.data();
+	const char* end = position + data.size();
+	bool valid = true;
+	auto readNumber = [&]() -> U64 {
+		U64 value = 0;
+		for(unsigned shift = 0; shift < 64; shift += 7) {
+			if(position == end) {
+				break;
+			}
+			U8 byte = *position++;
+			value |= U64(byte & 0x7f) << shift;
+			if(!(byte & 0x80)) {
+				return value;
+			}
+		}
+		valid = false;
+		return 0;
+	};
+
+	size_t magicLength = strlen(SCRIPT_RECORDING_MAGIC);
+	if(data.size() < magicLength || memcmp(position, SCRIPT_RECORDING_MAGIC, magicLength) != 0) {
+		std::cerr << "Not a script recording: ";
+		std::cerr << file;
+		std::cerr << "\n";
+		return false;
+	}
+	position += magicLength;
+	if(readNumber() != SCRIPT_RECORDING_VERSION || !valid) {
+		std::cerr << "Unsupported script recording version: ";
+		std::cerr << file;
+		std::cerr << "\n";
+		return false;
+	}
+
+	while(valid && position < end) {
+		U64 requestLength = readNumber();
+		if(!valid || requestLength > U64(end - position)) {
+			valid = false;
+			break;
+		}
+		std::string request(position, requestLength);
+		position += requestLength;
+
+		U64 lineCount = readNumber();
+		U32 first = replyLines.size();
+		for(U64 i = 0; valid && i < lineCount; i++) {
+			U64 id = readNumber();
+			if(id == lines.size()) {
+				U64 lineLength = readNumber();
+				if(!valid || lineLength > U64(end - position)) {
+					valid = false;
+					break;
+				}
+				lines.push_back(std::string(position, lineLength));
+				position += lineLength;
+			} else if(id > lines.size()) {
+				valid = false;
+				break;
+			}
+			replyLines.push_back(id);
+		}
+
+		// A request asked more than once -- `feature` and `reset`, say --
+		// keeps the reply it first got.
+		replies.insert(std::make_pair(request, std::make_pair(first, U32(replyLines.size() - first))));
+	}
+
+	if(!valid) {
+		std::cerr << "Script recording is damaged: ";
+		std::cerr << file;
+		std::cerr << "\n";
+		return false;
+	}
+	return true;
+}
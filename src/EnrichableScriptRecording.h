@@ -0,0 +1,94 @@
+#pragma once
+
+#include <LogicPublicTypes.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <stdio.h>
+
+// Identifies a script recording, followed by a format version.
+#define SCRIPT_RECORDING_MAGIC "ESPIREC"
+#define SCRIPT_RECORDING_VERSION 1
+
+// A script conversation kept in a file, so that it can later be answered
+// without the script.
+//
+// While recording, every request the analyzer sends and every line read in
+// reply is appended to the file.  Replies repeat far more than requests do,
+// so each distinct reply line is written once and afterwards referred to by
+// number; all numbers are unsigned LEB128:
+//
+//   "ESPIREC" version
+//   for each request:
+//     request length, request (without the line separator)
+//     reply line count
+//     for each reply line:
+//       line number -- if one past the last line seen, followed by
+//       line length, line (without the line separator)
+//
+// While replaying, the request is looked up and its recorded lines are
+// handed out in order; requests that were never recorded are answered with
+// an empty line, as a script answers messages it does not handle.
+//
+// Not thread-safe; the subprocess calls it while holding its request lock.
+class EnrichableScriptRecording {
+	public:
+		enum Mode {
+			Off,
+			Record,
+			Replay
+		};
+
+		EnrichableScriptRecording();
+		~EnrichableScriptRecording();
+
+		// Starts recording to, or loads a recording from, `path`; reports
+		// and returns false if the file can't be written or read.
+		bool Open(std::string path, Mode mode);
+		// Ends the recording, or forgets the loaded one.
+		void Close();
+		Mode GetMode() const;
+
+		void RecordRequest(const char* buffer, unsigned length);
+		void RecordReply(const char* line, unsigned length);
+
+		void BeginReply(const char* request, unsigned length);
+		// Behaves as reading a line from the script does: copies the next
+		// reply line, truncated to fit, into `buffer`, and returns whether
+		// it was non-empty.
+		bool NextReplyLine(char* buffer, unsigned bufferLength);
+
+		U64 GetRequests() const;
+		// Replayed requests that weren't in the recording.
+		U64 GetMisses() const;
+
+	protected:
+		void WriteNumber(U64 value);
+		void WriteExchange();
+		bool Load(const std::string& path);
+
+		Mode mode;
+		std::string path;
+		U64 requests;
+		U64 misses;
+
+		// Recording.
+		FILE* output;
+		std::unordered_map<std::string, U32> lineIds;
+		std::string pendingRequest;
+		std::vector<U32> pendingLines;
+		bool pending;
+		// Indexed by line number; the keys of `lineIds`.
+		std::vector<const std::string*> lineTexts;
+		U32 linesWritten;
+
+		// Replaying; `replies` maps a request to its first line in
+		// `replyLines` and the number of lines.
+		std::vector<std::string> lines;
+		std::vector<U32> replyLines;
+		std::unordered_map<std::string, std::pair<U32, U32>> replies;
+		std::string key;
+		U32 replyPosition;
+		U32 replyEnd;
+};
@@ -12,11 +12,8 @@ EnrichableSpiAnalyzer::EnrichableSpiAnalyzer()
 :	Analyzer2(),
 	mSettings( new EnrichableSpiAnalyzerSettings() ),
 	mSimulationInitilized( false ),
-	mMosi( NULL ),
-	mMiso( NULL ),
-	mClock( NULL ),
-	mEnable( NULL ),
-	mSubprocess( new EnrichableAnalyzerSubprocess() )
+	mSubprocess( new EnrichableAnalyzerSubprocess() ),
+	mDecoder( mSettings.get(), this )
 {	
 	SetAnalyzerSettings( mSettings.get() );
 }
@@ -24,6 +21,7 @@ EnrichableSpiAnalyzer::EnrichableSpiAnalyzer()
 EnrichableSpiAnalyzer::~EnrichableSpiAnalyzer()
 {
 	KillThread();
+	mSubprocess->Stop();
 }
 
 void EnrichableSpiAnalyzer::SetupResults()
@@ -41,296 +39,72 @@ void EnrichableSpiAnalyzer::WorkerThread()
 {
 	Setup();
 
+	// Logic kills the worker thread rather than letting it reach Stop(), so
+	// flush whatever the previous run collected before starting over.
+	mSubprocess->WriteStats( true );
+	mSubprocess->SetStatsFile( mSettings->mStatisticsFile );
+
+	EnrichableTrace* trace = mSubprocess->GetTrace();
+	trace->SetOutputFile( mSettings->mTraceFile );
+	trace->NameThread( "worker" );
+
+	mSubprocess->GetFrameTee()->SetOutput( mSettings->mFrameOutput, EnrichableFrameTee::Policy( mSettings->mFrameOutputPolicy ) );
+
+	// The script starts in the background; decoding doesn't wait for it.
 	mSubprocess->SetParserCommand(mSettings->mParserCommand);
+	mSubprocess->SetShareScript(mSettings->mShareScript);
+	mSubprocess->SetRecording(mSettings->mScriptRecording, EnrichableScriptRecording::Mode(mSettings->mScriptRecordingMode));
+	mSubprocess->SetFrameFilter(mSettings->mScriptFilter);
+	U64 regionFirst;
+	U64 regionLast;
+	mSettings->GetScriptRegion(GetTriggerSample(), &regionFirst, &regionLast);
+	mSubprocess->SetRegion(regionFirst, regionLast);
 	mSubprocess->Start();
 
-	AdvanceToActiveEnableEdgeWithCorrectClockPolarity();
+	mDecoder.AdvanceToActiveEnableEdgeWithCorrectClockPolarity();
 
 	for( ; ; )
 	{
-		GetWord();
+		if( mSubprocess->StatsEnabled() )
+		{
+			U64 start = EnrichableAnalyzerStats::Now();
+			{
+				TraceSpan span( trace, "GetWord" );
+				mDecoder.GetWord();
+			}
+			mSubprocess->RecordDecode( EnrichableAnalyzerStats::Now() - start );
+			mSubprocess->WriteStats( false );
+		}
+		else
+		{
+			TraceSpan span( trace, "GetWord" );
+			mDecoder.GetWord();
+		}
+		trace->Flush( false );
 		CheckIfThreadShouldExit();
 	}
 
 	mSubprocess->Stop();
 }
 
-void EnrichableSpiAnalyzer::AdvanceToActiveEnableEdgeWithCorrectClockPolarity()
-{
-	mResults->CommitPacketAndStartNewPacket();
-	mResults->CommitResults();
-	
-	AdvanceToActiveEnableEdge();
-
-	for( ; ; )
-	{
-		if( IsInitialClockPolarityCorrect() == true )  //if false, this function moves to the next active enable edge.
-			break;
-	}
-}
-
 void EnrichableSpiAnalyzer::Setup()
 {
-	bool allow_last_trailing_clock_edge_to_fall_outside_enable = false;
-	if( mSettings->mDataValidEdge == AnalyzerEnums::LeadingEdge )
-		allow_last_trailing_clock_edge_to_fall_outside_enable = true;
-
-	if( mSettings->mClockInactiveState == BIT_LOW )
-	{
-		if( mSettings->mDataValidEdge == AnalyzerEnums::LeadingEdge )
-			mArrowMarker = AnalyzerResults::UpArrow;
-		else
-			mArrowMarker = AnalyzerResults::DownArrow;
-
-	}else
-	{
-		if( mSettings->mDataValidEdge == AnalyzerEnums::LeadingEdge )
-			mArrowMarker = AnalyzerResults::DownArrow;
-		else
-			mArrowMarker = AnalyzerResults::UpArrow;
-	}
-
+	AnalyzerChannelData* mosi = NULL;
+	AnalyzerChannelData* miso = NULL;
+	AnalyzerChannelData* enable = NULL;
 
 	if( mSettings->mMosiChannel != UNDEFINED_CHANNEL )
-		mMosi = GetAnalyzerChannelData( mSettings->mMosiChannel );
-	else
-		mMosi = NULL;
+		mosi = GetAnalyzerChannelData( mSettings->mMosiChannel );
 
 	if( mSettings->mMisoChannel != UNDEFINED_CHANNEL )
-		mMiso = GetAnalyzerChannelData( mSettings->mMisoChannel );
-	else
-		mMiso = NULL;
+		miso = GetAnalyzerChannelData( mSettings->mMisoChannel );
 
-
-	mClock = GetAnalyzerChannelData( mSettings->mClockChannel );
+	AnalyzerChannelData* clock = GetAnalyzerChannelData( mSettings->mClockChannel );
 
 	if( mSettings->mEnableChannel != UNDEFINED_CHANNEL )
-		mEnable = GetAnalyzerChannelData( mSettings->mEnableChannel );
-	else
-		mEnable = NULL;
-
-}
-
-void EnrichableSpiAnalyzer::AdvanceToActiveEnableEdge()
-{
-	if( mEnable != NULL )
-	{
-		if( mEnable->GetBitState() != mSettings->mEnableActiveState )
-		{
-			mEnable->AdvanceToNextEdge();
-		}else
-		{
-			mEnable->AdvanceToNextEdge();
-			mEnable->AdvanceToNextEdge();
-		}
-		mCurrentSample = mEnable->GetSampleNumber();
-		mClock->AdvanceToAbsPosition( mCurrentSample );
-		packetFrameIndex = 0;
-	}else
-	{
-		mCurrentSample = mClock->GetSampleNumber();
-	}
-}
-
-bool EnrichableSpiAnalyzer::IsInitialClockPolarityCorrect()
-{
-	if( mClock->GetBitState() == mSettings->mClockInactiveState )
-		return true;
-
-	mResults->AddMarker( mCurrentSample, AnalyzerResults::ErrorSquare, mSettings->mClockChannel );
-
-	if( mEnable != NULL )
-	{
-		Frame error_frame;
-		error_frame.mStartingSampleInclusive = mCurrentSample;
-
-		mEnable->AdvanceToNextEdge();
-		mCurrentSample = mEnable->GetSampleNumber();
-
-		error_frame.mEndingSampleInclusive = mCurrentSample;
-		error_frame.mFlags = SPI_ERROR_FLAG | DISPLAY_AS_ERROR_FLAG;
-		mResults->AddFrame( error_frame );
-		mResults->CommitResults();
-		ReportProgress( error_frame.mEndingSampleInclusive );
-
-		//move to the next active-going enable edge
-		mEnable->AdvanceToNextEdge();
-		mCurrentSample = mEnable->GetSampleNumber();
-		mClock->AdvanceToAbsPosition( mCurrentSample );
-
-		return false;
-	}else
-	{
-		mClock->AdvanceToNextEdge();  //at least start with the clock in the idle state.
-		mCurrentSample = mClock->GetSampleNumber();
-		return true;
-	}
-}
-
-bool EnrichableSpiAnalyzer::WouldAdvancingTheClockToggleEnable()
-{
-	if( mEnable == NULL )
-		return false;
-
-	U64 next_edge = mClock->GetSampleOfNextEdge();
-	bool enable_will_toggle = mEnable->WouldAdvancingToAbsPositionCauseTransition( next_edge );
-
-	if( enable_will_toggle == false )
-		return false;
-	else
-		return true;
-}
-
-void EnrichableSpiAnalyzer::GetWord()
-{
-	//we're assuming we come into this function with the clock in the idle state;
-
-	U32 bits_per_transfer = mSettings->mBitsPerTransfer;
-
-	DataBuilder mosi_result;
-	U64 mosi_word = 0;
-	mosi_result.Reset( &mosi_word, mSettings->mShiftOrder, bits_per_transfer );
-
-	DataBuilder miso_result;
-	U64 miso_word = 0;
-	miso_result.Reset( &miso_word, mSettings->mShiftOrder, bits_per_transfer );
-
-	U64 first_sample = 0;
-	bool need_reset = false;
-
-	mArrowLocations.clear();
-	ReportProgress( mClock->GetSampleNumber() );
-
-	for( U32 i=0; i<bits_per_transfer; i++ )
-	{
-		if( i == 0 )
-			CheckIfThreadShouldExit();
-
-		//on every single edge, we need to check that enable doesn't toggle.
-		//note that we can't just advance the enable line to the next edge, becuase there may not be another edge
-
-		if( WouldAdvancingTheClockToggleEnable() == true )
-		{
-			AdvanceToActiveEnableEdgeWithCorrectClockPolarity();  //ok, we pretty much need to reset everything and return.
-			return;
-		}
-		
-		mClock->AdvanceToNextEdge();
-		if( i == 0 )
-			first_sample = mClock->GetSampleNumber();
-
-		if( mSettings->mDataValidEdge == AnalyzerEnums::LeadingEdge )
-		{
-			mCurrentSample = mClock->GetSampleNumber();
-			if( mMosi != NULL )
-			{
-				mMosi->AdvanceToAbsPosition( mCurrentSample );
-				mosi_result.AddBit( mMosi->GetBitState() );
-			}
-			if( mMiso != NULL )
-			{
-				mMiso->AdvanceToAbsPosition( mCurrentSample );
-				miso_result.AddBit( mMiso->GetBitState() );
-			}
-			mArrowLocations.push_back( mCurrentSample );
-		}
-
-
-		// ok, the trailing edge is messy -- but only on the very last bit.
-		// If the trialing edge isn't doesn't represent valid data, we want to allow the enable line to rise before the clock trialing edge -- and still report the frame
-		if( ( i == ( bits_per_transfer - 1 ) ) && ( mSettings->mDataValidEdge != AnalyzerEnums::TrailingEdge ) )
-		{
-			//if this is the last bit, and the trailing edge doesn't represent valid data
-			if( WouldAdvancingTheClockToggleEnable() == true )
-			{
-				//moving to the trailing edge would cause the clock to revert to inactive.  jump out, record the frame, and them move to the next active enable edge
-				need_reset = true;
-				break;
-			}
-			
-			//enable isn't going to go inactive, go ahead and advance the clock as usual.  Then we're done, jump out and record the frame.
-			mClock->AdvanceToNextEdge();
-			break;
-		}
-		
-		//this isn't the very last bit, etc, so proceed as normal
-		if( WouldAdvancingTheClockToggleEnable() == true )
-		{
-			AdvanceToActiveEnableEdgeWithCorrectClockPolarity();  //ok, we pretty much need to reset everything and return.
-			return;
-		}
-
-		mClock->AdvanceToNextEdge();
-
-		if( mSettings->mDataValidEdge == AnalyzerEnums::TrailingEdge )
-		{
-			mCurrentSample = mClock->GetSampleNumber();
-			if( mMosi != NULL )
-			{
-				mMosi->AdvanceToAbsPosition( mCurrentSample );
-				mosi_result.AddBit( mMosi->GetBitState() );
-			}
-			if( mMiso != NULL )
-			{
-				mMiso->AdvanceToAbsPosition( mCurrentSample );
-				miso_result.AddBit( mMiso->GetBitState() );
-			}
-			mArrowLocations.push_back( mCurrentSample );
-		}
-		
-	}
-
-	Frame result_frame;
-	result_frame.mStartingSampleInclusive = first_sample;
-	result_frame.mEndingSampleInclusive = mClock->GetSampleNumber();
-	result_frame.mData1 = mosi_word;
-	result_frame.mData2 = miso_word;
-	result_frame.mFlags = 0;
-	result_frame.mType = packetFrameIndex++;
-	U64 frameIndex = mResults->AddFrame( result_frame );
-
-	//save the resuls:
-	U32 count = mArrowLocations.size();
-	for( U32 i=0; i<count; i++ ) {
-		mResults->AddMarker(
-			mArrowLocations[i], mArrowMarker, mSettings->mClockChannel
-		);
-	}
-
-	if(mSubprocess->MarkerEnabled()) {
-		std::vector<EnrichableAnalyzerSubprocess::Marker> markers = mSubprocess->EmitMarker(
-			mResults->GetNumPackets(),
-			frameIndex,
-			result_frame,
-			count
-		);
-
-		Channel* channel = NULL;
-		for(const EnrichableAnalyzerSubprocess::Marker& marker : markers) {
-			if(marker.channelName == "miso") {
-				channel = &mSettings->mMisoChannel;
-			} else if (marker.channelName == "mosi") {
-				channel = &mSettings->mMosiChannel;
-			}
-			if(channel != NULL) {
-				mResults->AddMarker(
-					mArrowLocations[marker.sampleNumber],
-					marker.markerType,
-					*channel
-				);
-			} else {
-				break;
-				std::cerr << "Received marker request for invalid marker: ";
-				std::cerr << marker.channelName;
-				std::cerr << " ignoring.\n";
-			}
-		}
-	}
-	
-	mResults->CommitResults();
+		enable = GetAnalyzerChannelData( mSettings->mEnableChannel );
 
-	if( need_reset == true )
-		AdvanceToActiveEnableEdgeWithCorrectClockPolarity();
+	mDecoder.Setup( mResults.get(), mSubprocess.get(), mSubprocess->GetTrace(), mSubprocess->GetFrameTee(), mosi, miso, clock, enable );
 }
 
 bool EnrichableSpiAnalyzer::NeedsRerun()
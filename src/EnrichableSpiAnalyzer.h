@@ -5,6 +5,9 @@
 #include "EnrichableSpiAnalyzerResults.h"
 #include "EnrichableSpiSimulationDataGenerator.h"
 #include "EnrichableAnalyzerSubprocess.h"
+#include "EnrichableSpiDecoder.h"
+
+class AnalyzerChannelData;
 
 class EnrichableSpiAnalyzerSettings;
 class EnrichableSpiAnalyzer : public Analyzer2
@@ -23,11 +26,6 @@ public:
 
 protected: //functions
 	void Setup();
-	void AdvanceToActiveEnableEdge();
-	bool IsInitialClockPolarityCorrect();
-	void AdvanceToActiveEnableEdgeWithCorrectClockPolarity();
-	bool WouldAdvancingTheClockToggleEnable();
-	void GetWord();
 
 #pragma warning( push )
 #pragma warning( disable : 4251 ) //warning C4251: 'SerialAnalyzer::<...>' : class <...> needs to have dll-interface to be used by clients of class
@@ -37,17 +35,7 @@ protected:  //vars
 	bool mSimulationInitilized;
 	std::auto_ptr< EnrichableAnalyzerSubprocess > mSubprocess;
 	EnrichableSpiSimulationDataGenerator mSimulationDataGenerator;
-
-	AnalyzerChannelData* mMosi; 
-	AnalyzerChannelData* mMiso;
-	AnalyzerChannelData* mClock;
-	AnalyzerChannelData* mEnable;
-
-	U64 mCurrentSample;
-	AnalyzerResults::MarkerType mArrowMarker;
-	std::vector<U64> mArrowLocations;
-
-	U8 packetFrameIndex = 0;
+	EnrichableSpiDecoder< AnalyzerChannelData, EnrichableSpiAnalyzerResults, EnrichableSpiAnalyzer > mDecoder;
 
 #pragma warning( pop )
 };
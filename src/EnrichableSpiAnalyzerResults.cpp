@@ -2,6 +2,7 @@
 #include <AnalyzerHelpers.h>
 #include "EnrichableSpiAnalyzer.h"
 #include "EnrichableSpiAnalyzerSettings.h"
+#include "EnrichableSpiExport.h"
 
 #include <iostream>
 #include <sstream>
@@ -22,6 +23,8 @@ EnrichableSpiAnalyzerResults::~EnrichableSpiAnalyzerResults()
 
 void EnrichableSpiAnalyzerResults::GenerateBubbleText( U64 frame_index, Channel& channel, DisplayBase display_base )  //unrefereced vars commented out to remove warnings.
 {
+	TraceSpan span( mSubprocess->GetTrace(), "GenerateBubbleText", frame_index );
+
 	ClearResultStrings();
 	Frame frame = GetFrame( frame_index );
 
@@ -29,7 +32,7 @@ void EnrichableSpiAnalyzerResults::GenerateBubbleText( U64 frame_index, Channel&
 
 	if( ( frame.mFlags & SPI_ERROR_FLAG ) == 0 )
 	{
-		if(mSubprocess->BubbleEnabled()) {
+		if(mSubprocess->BubbleEnabled() && mSubprocess->FrameSelected(EnrichableAnalyzerStats::Bubble, frame)) {
 			std::string channelName;
 			if(channel == mSettings->mMosiChannel) {
 				channelName = "mosi";
@@ -37,14 +40,14 @@ void EnrichableSpiAnalyzerResults::GenerateBubbleText( U64 frame_index, Channel&
 				channelName = "miso";
 			}
 
-			std::vector<std::string> bubbles = mSubprocess->EmitBubble(
+			EnrichableTextLines bubbles = mSubprocess->EmitBubble(
 				GetPacketContainingFrameSequential(frame_index),
 				frame_index,
 				frame,
 				channelName
 			);
-			for(const std::string& bubbleText: bubbles) {
-				AddResultString(bubbleText.c_str());
+			for(size_t i = 0; i < bubbles.size(); i++) {
+				AddResultString(bubbles[i]);
 			}
 		} else {
 			if( channel == mSettings->mMosiChannel )
@@ -67,79 +70,41 @@ void EnrichableSpiAnalyzerResults::GenerateBubbleText( U64 frame_index, Channel&
 	}
 }
 
-void EnrichableSpiAnalyzerResults::GenerateExportFile( const char* file, DisplayBase display_base, U32 /*export_type_user_id*/ )
+void EnrichableSpiAnalyzerResults::GenerateExportFile( const char* file, DisplayBase display_base, U32 export_type_user_id )
 {
-	//export_type_user_id is only important if we have more than one export type.
+	TraceSpan span( mSubprocess->GetTrace(), "GenerateExportFile" );
 
-	std::stringstream ss;
 	void* f = AnalyzerHelpers::StartFile( file );
 
-	U64 trigger_sample = mAnalyzer->GetTriggerSample();
-	U32 sample_rate = mAnalyzer->GetSampleRate();
-
-	ss << "Time [s],Packet ID,MOSI,MISO" << std::endl;
-
-	bool mosi_used = true;
-	bool miso_used = true;
-
-	if( mSettings->mMosiChannel == UNDEFINED_CHANNEL )
-		mosi_used = false;
-
-	if( mSettings->mMisoChannel == UNDEFINED_CHANNEL )
-		miso_used = false;
-
-	U64 num_frames = GetNumFrames();
-	for( U32 i=0; i < num_frames; i++ )
-	{
-		Frame frame = GetFrame( i );
-
-		if( ( frame.mFlags & SPI_ERROR_FLAG ) != 0 )
-			continue;
-		
-		char time_str[128];
-		AnalyzerHelpers::GetTimeString( frame.mStartingSampleInclusive, trigger_sample, sample_rate, time_str, 128 );
+	WriteSpiExport(
+		this,
+		mSettings,
+		mSubprocess,
+		mAnalyzer->GetTriggerSample(),
+		mAnalyzer->GetSampleRate(),
+		display_base,
+		export_type_user_id,
+		f
+	);
 
-		char mosi_str[128] = "";
-		if( mosi_used == true )
-			AnalyzerHelpers::GetNumberString( frame.mData1, display_base, mSettings->mBitsPerTransfer, mosi_str, 128 );
-
-		char miso_str[128] = "";
-		if( miso_used == true )
-			AnalyzerHelpers::GetNumberString( frame.mData2, display_base, mSettings->mBitsPerTransfer, miso_str, 128 );
-
-		U64 packet_id = GetPacketContainingFrameSequential( i ); 
-		if( packet_id != INVALID_RESULT_INDEX )
-			ss << time_str << "," << packet_id << "," << mosi_str << "," << miso_str << std::endl;
-		else
-			ss << time_str << ",," << mosi_str << "," << miso_str << std::endl;  //it's ok for a frame not to be included in a packet.
-	
-		AnalyzerHelpers::AppendToFile( (U8*)ss.str().c_str(), ss.str().length(), f );
-		ss.str( std::string() );
-							
-		if( UpdateExportProgressAndCheckForCancel( i, num_frames ) == true )
-		{
-			AnalyzerHelpers::EndFile( f );
-			return;
-		}
-	}
-
-	UpdateExportProgressAndCheckForCancel( num_frames, num_frames );
 	AnalyzerHelpers::EndFile( f );
 }
 
 void EnrichableSpiAnalyzerResults::GenerateFrameTabularText( U64 frame_index, DisplayBase display_base )
 {
+	TraceSpan span( mSubprocess->GetTrace(), "GenerateFrameTabularText", frame_index );
+
 	ClearTabularText();
 	Frame frame = GetFrame( frame_index );
 
-	if(mSubprocess->TabularEnabled()) {
-		std::vector<std::string> tabularLines = mSubprocess->EmitTabular(
+	if(mSubprocess->TabularEnabled() && mSubprocess->FrameSelected(EnrichableAnalyzerStats::Tabular, frame)) {
+		EnrichableTextLines tabularLines = mSubprocess->EmitTabular(
 			GetPacketContainingFrameSequential( frame_index ),
 			frame_index,
 			frame
 		);
-		for(const std::string& tabularText: tabularLines) {
-			AddTabularText(tabularText.c_str());
+		for(size_t i = 0; i < tabularLines.size(); i++) {
+			AddTabularText(tabularLines[i]);
 		}
 	} else {
 		bool mosi_used = true;
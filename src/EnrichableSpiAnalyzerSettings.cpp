@@ -1,12 +1,67 @@
 #include "EnrichableSpiAnalyzerSettings.h"
+#include "EnrichableFrameFilter.h"
+#include "EnrichableFrameTee.h"
+#include "EnrichableScriptRecording.h"
 
 #include <AnalyzerHelpers.h>
 #include <sstream>
 #include <cstring>
+#include <cstdlib>
+#include <cerrno>
 
 #include <iostream>
 #include <fstream>
 
+namespace
+{
+	// The script region's ends are entered as text, since sample numbers in
+	// a long capture are beyond what an integer setting holds.
+	bool ParseSampleNumber( const char* text, S64* value )
+	{
+		char* end;
+		errno = 0;
+		long long parsed = strtoll( text, &end, 10 );
+		while( *end == ' ' )
+			end++;
+		if( end == text || *end != '\0' || errno == ERANGE )
+			return false;
+
+		*value = parsed;
+		return true;
+	}
+
+	std::string FormatSampleNumber( S64 value )
+	{
+		std::stringstream text;
+		text << value;
+		return text.str();
+	}
+
+	// `sample` moved by `offset`, held between the first sample and the last
+	// one a U64 can number.
+	U64 OffsetSample( U64 sample, S64 offset )
+	{
+		if( offset < 0 )
+		{
+			U64 back = U64( -( offset + 1 ) ) + 1;
+			return back > sample ? 0 : sample - back;
+		}
+
+		U64 forward = U64( offset );
+		return forward > ~U64( 0 ) - sample ? ~U64( 0 ) : sample + forward;
+	}
+
+	// Text read from an archive points into the archive, so it is copied
+	// out; settings saved before a text setting was added read as empty.
+	std::string ReadText( SimpleArchive& archive )
+	{
+		const char* text;
+		if( !( archive >> &text ) )
+			return "";
+		return text;
+	}
+}
+
 EnrichableSpiAnalyzerSettings::EnrichableSpiAnalyzerSettings()
 :	mMosiChannel( UNDEFINED_CHANNEL ),
 	mMisoChannel( UNDEFINED_CHANNEL ),
@@ -17,7 +72,21 @@ EnrichableSpiAnalyzerSettings::EnrichableSpiAnalyzerSettings()
 	mClockInactiveState( BIT_LOW ),
 	mDataValidEdge( AnalyzerEnums::LeadingEdge ), 
 	mEnableActiveState( BIT_LOW ),
-	mParserCommand("")
+	mParserCommand(""),
+	mShareScript( false ),
+	mScriptFilter(""),
+	mStatisticsFile(""),
+	mTraceFile(""),
+	mFrameOutput(""),
+	mFrameOutputPolicy( EnrichableFrameTee::DropWhenFull ),
+	mScriptRecording(""),
+	mScriptRecordingMode( EnrichableScriptRecording::Record ),
+	mScriptRegion( ScriptRegionWholeCapture ),
+	mScriptRegionStart( 0 ),
+	mScriptRegionEnd( 0 ),
+	mSimulationProfile( SimulationCounting ),
+	mSimulationClockHz( 0 ),
+	mSimulationSeed( 1 )
 {
 	mMosiChannelInterface.reset( new AnalyzerSettingInterfaceChannel() );
 	mMosiChannelInterface->SetTitleAndTooltip( "MOSI", "Master Out, Slave In" );
@@ -80,8 +149,89 @@ EnrichableSpiAnalyzerSettings::EnrichableSpiAnalyzerSettings()
 	mParserCommandInterface.reset(new AnalyzerSettingInterfaceText());
 	mParserCommandInterface->SetTitleAndTooltip("Enrichment Script", "Command to run for enriching displayed SPI data.");
 	mParserCommandInterface->SetTextType(AnalyzerSettingInterfaceText::NormalText);
-	mParserCommandInterface->SetText(mParserCommand);
-
+	mParserCommandInterface->SetText(mParserCommand.c_str());
+
+	mShareScriptInterface.reset( new AnalyzerSettingInterfaceNumberList() );
+	mShareScriptInterface->SetTitleAndTooltip( "", "Whether analyzers running the same enrichment script share one copy of it" );
+	mShareScriptInterface->AddNumber( 0, "Start a script for this analyzer (Standard)", "" );
+	mShareScriptInterface->AddNumber( 1, "Share one script between analyzers running the same command", "Every request then starts with the id of the analyzer making it" );
+	mShareScriptInterface->SetNumber( mShareScript );
+
+	mScriptFilterInterface.reset(new AnalyzerSettingInterfaceText());
+	mScriptFilterInterface->SetTitleAndTooltip("Script Filter", "If set, only frames matching this expression are sent to the enrichment script, e.g. \"mosi & 0xF0 == 0x90 && index == 0 || miso == 0xFF\"; others are displayed as usual.");
+	mScriptFilterInterface->SetTextType(AnalyzerSettingInterfaceText::NormalText);
+	mScriptFilterInterface->SetText(mScriptFilter.c_str());
+
+	mStatisticsFileInterface.reset(new AnalyzerSettingInterfaceText());
+	mStatisticsFileInterface->SetTitleAndTooltip("Statistics File", "If set, request counts and latency histograms for the enrichment script and the decoder are written to this file while analyzing.");
+	mStatisticsFileInterface->SetTextType(AnalyzerSettingInterfaceText::NormalText);
+	mStatisticsFileInterface->SetText(mStatisticsFile.c_str());
+
+	mTraceFileInterface.reset(new AnalyzerSettingInterfaceText());
+	mTraceFileInterface->SetTitleAndTooltip("Trace File", "If set, a timeline of decoding and enrichment script requests is written to this file in Chrome trace-event format while analyzing.");
+	mTraceFileInterface->SetTextType(AnalyzerSettingInterfaceText::NormalText);
+	mTraceFileInterface->SetText(mTraceFile.c_str());
+
+	mFrameOutputInterface.reset(new AnalyzerSettingInterfaceText());
+	mFrameOutputInterface->SetTitleAndTooltip("Frame Output", "If set, the named pipe or Unix domain socket to which decoded frames are streamed, as 48-byte binary records, while analyzing.");
+	mFrameOutputInterface->SetTextType(AnalyzerSettingInterfaceText::NormalText);
+	mFrameOutputInterface->SetText(mFrameOutput.c_str());
+
+	mFrameOutputPolicyInterface.reset( new AnalyzerSettingInterfaceNumberList() );
+	mFrameOutputPolicyInterface->SetTitleAndTooltip( "", "What to do when the frame output's reader falls behind" );
+	mFrameOutputPolicyInterface->AddNumber( EnrichableFrameTee::DropWhenFull, "Drop frames the output reader can't keep up with (Standard)", "" );
+	mFrameOutputPolicyInterface->AddNumber( EnrichableFrameTee::BlockWhenFull, "Wait for the output reader to catch up", "Decoding pauses while the reader is behind" );
+	mFrameOutputPolicyInterface->SetNumber( mFrameOutputPolicy );
+
+	mScriptRecordingInterface.reset(new AnalyzerSettingInterfaceText());
+	mScriptRecordingInterface->SetTitleAndTooltip("Script Recording", "If set, the file to which the enrichment script's requests and replies are recorded, or from which they are replayed.");
+	mScriptRecordingInterface->SetTextType(AnalyzerSettingInterfaceText::NormalText);
+	mScriptRecordingInterface->SetText(mScriptRecording.c_str());
+
+	mScriptRecordingModeInterface.reset( new AnalyzerSettingInterfaceNumberList() );
+	mScriptRecordingModeInterface->SetTitleAndTooltip( "", "Whether the script recording is written or replayed" );
+	mScriptRecordingModeInterface->AddNumber( EnrichableScriptRecording::Record, "Record the script's replies (Standard)", "" );
+	mScriptRecordingModeInterface->AddNumber( EnrichableScriptRecording::Replay, "Answer from the recording instead of running the script", "Requests that were not recorded are answered as a script answers messages it does not handle" );
+	mScriptRecordingModeInterface->SetNumber( mScriptRecordingMode );
+
+	mScriptRegionInterface.reset( new AnalyzerSettingInterfaceNumberList() );
+	mScriptRegionInterface->SetTitleAndTooltip( "Script Region", "Which frames are sent to the enrichment script; the others are displayed as usual" );
+	mScriptRegionInterface->AddNumber( ScriptRegionWholeCapture, "Enrich the whole capture (Standard)", "" );
+	mScriptRegionInterface->AddNumber( ScriptRegionAroundTrigger, "Enrich frames around the trigger", "From Script Region Start to Script Region End samples after the trigger; negative values are before it" );
+	mScriptRegionInterface->AddNumber( ScriptRegionSampleRange, "Enrich frames within a range of samples", "From sample Script Region Start to sample Script Region End, counted from the start of the capture" );
+	mScriptRegionInterface->SetNumber( mScriptRegion );
+
+	mScriptRegionStartInterface.reset( new AnalyzerSettingInterfaceText() );
+	mScriptRegionStartInterface->SetTitleAndTooltip( "Script Region Start", "First sample of the script region, as a whole number; frames overlapping it are enriched" );
+	mScriptRegionStartInterface->SetTextType( AnalyzerSettingInterfaceText::NormalText );
+	mScriptRegionStartInterface->SetText( FormatSampleNumber( mScriptRegionStart ).c_str() );
+
+	mScriptRegionEndInterface.reset( new AnalyzerSettingInterfaceText() );
+	mScriptRegionEndInterface->SetTitleAndTooltip( "Script Region End", "Last sample of the script region, as a whole number; frames overlapping it are enriched" );
+	mScriptRegionEndInterface->SetTextType( AnalyzerSettingInterfaceText::NormalText );
+	mScriptRegionEndInterface->SetText( FormatSampleNumber( mScriptRegionEnd ).c_str() );
+
+	mSimulationProfileInterface.reset( new AnalyzerSettingInterfaceNumberList() );
+	mSimulationProfileInterface->SetTitleAndTooltip( "Simulation", "Traffic generated when simulating a capture" );
+	mSimulationProfileInterface->AddNumber( SimulationCounting, "Simulate short transactions of counting words (Standard)", "" );
+	mSimulationProfileInterface->AddNumber( SimulationBursts, "Simulate back-to-back bursts at the full clock rate", "Long transactions with no gap between words" );
+	mSimulationProfileInterface->AddNumber( SimulationRegisterAccess, "Simulate register reads and writes", "A command word (bit 7 set for reads) followed by one to four data words" );
+	mSimulationProfileInterface->AddNumber( SimulationLongTransactions, "Simulate long transactions", "256 to 4096 words per transaction" );
+	mSimulationProfileInterface->AddNumber( SimulationRandomGaps, "Simulate random gaps between words and transactions", "" );
+	mSimulationProfileInterface->AddNumber( SimulationClockErrors, "Simulate transactions with the wrong idle clock state", "One transaction in eight starts with the clock in the wrong state; requires an enable channel" );
+	mSimulationProfileInterface->SetNumber( mSimulationProfile );
+
+	mSimulationClockHzInterface.reset( new AnalyzerSettingInterfaceInteger() );
+	mSimulationClockHzInterface->SetTitleAndTooltip( "Simulation Clock (Hz)", "SPI clock frequency used when simulating; 0 uses one fifth of the simulation sample rate.  Limited to a quarter of the simulation sample rate." );
+	mSimulationClockHzInterface->SetMin( 0 );
+	mSimulationClockHzInterface->SetMax( 2000000000 );
+	mSimulationClockHzInterface->SetInteger( mSimulationClockHz );
+
+	mSimulationSeedInterface.reset( new AnalyzerSettingInterfaceInteger() );
+	mSimulationSeedInterface->SetTitleAndTooltip( "Simulation Seed", "Seed for the random data, lengths and gaps of simulated traffic" );
+	mSimulationSeedInterface->SetMin( 0 );
+	mSimulationSeedInterface->SetMax( 2147483647 );
+	mSimulationSeedInterface->SetInteger( mSimulationSeed );
 
 	AddInterface( mMosiChannelInterface.get() );
 	AddInterface( mMisoChannelInterface.get() );
@@ -93,6 +243,20 @@ EnrichableSpiAnalyzerSettings::EnrichableSpiAnalyzerSettings()
 	AddInterface( mDataValidEdgeInterface.get() );
 	AddInterface( mEnableActiveStateInterface.get() );
 	AddInterface( mParserCommandInterface.get() );
+	AddInterface( mShareScriptInterface.get() );
+	AddInterface( mScriptFilterInterface.get() );
+	AddInterface( mStatisticsFileInterface.get() );
+	AddInterface( mTraceFileInterface.get() );
+	AddInterface( mFrameOutputInterface.get() );
+	AddInterface( mFrameOutputPolicyInterface.get() );
+	AddInterface( mScriptRecordingInterface.get() );
+	AddInterface( mScriptRecordingModeInterface.get() );
+	AddInterface( mScriptRegionInterface.get() );
+	AddInterface( mScriptRegionStartInterface.get() );
+	AddInterface( mScriptRegionEndInterface.get() );
+	AddInterface( mSimulationProfileInterface.get() );
+	AddInterface( mSimulationClockHzInterface.get() );
+	AddInterface( mSimulationSeedInterface.get() );
 
 
 	//AddExportOption( 0, "Export as text/csv file", "text (*.txt);;csv (*.csv)" );
@@ -100,6 +264,10 @@ EnrichableSpiAnalyzerSettings::EnrichableSpiAnalyzerSettings()
 	AddExportExtension( 0, "text", "txt" );
 	AddExportExtension( 0, "csv", "csv" );
 
+	AddExportOption( 1, "Export as enriched text/csv file" );
+	AddExportExtension( 1, "text", "txt" );
+	AddExportExtension( 1, "csv", "csv" );
+
 	ClearChannels();
 	AddChannel( mMosiChannel, "MOSI", false );
 	AddChannel( mMisoChannel, "MISO", false );
@@ -136,6 +304,36 @@ bool EnrichableSpiAnalyzerSettings::SetSettingsFromInterfaces()
 		return false;
 	}
 
+	EnrichableFrameFilter filter;
+	std::string filterError;
+	if( !filter.Compile( mScriptFilterInterface->GetText(), &filterError ) )
+	{
+		SetErrorText( filterError.c_str() );
+		return false;
+	}
+
+	U32 region = U32( mScriptRegionInterface->GetNumber() );
+	// Unused ends are kept as they were if they don't parse.
+	S64 regionStart = mScriptRegionStart;
+	S64 regionEnd = mScriptRegionEnd;
+	bool regionParsed = ParseSampleNumber( mScriptRegionStartInterface->GetText(), &regionStart )
+		&& ParseSampleNumber( mScriptRegionEndInterface->GetText(), &regionEnd );
+	if( region != ScriptRegionWholeCapture && !regionParsed )
+	{
+		SetErrorText( "Script Region Start and End must be whole numbers of samples." );
+		return false;
+	}
+	if( region != ScriptRegionWholeCapture && regionStart > regionEnd )
+	{
+		SetErrorText( "The script region must not end before it starts." );
+		return false;
+	}
+	if( region == ScriptRegionSampleRange && regionStart < 0 )
+	{
+		SetErrorText( "Samples are numbered from 0; please choose a script region within the capture." );
+		return false;
+	}
+
 	mMosiChannel = mMosiChannelInterface->GetChannel();
 	mMisoChannel = mMisoChannelInterface->GetChannel();
 	mClockChannel = mClockChannelInterface->GetChannel();
@@ -147,6 +345,20 @@ bool EnrichableSpiAnalyzerSettings::SetSettingsFromInterfaces()
 	mDataValidEdge =		(AnalyzerEnums::Edge)  U32( mDataValidEdgeInterface->GetNumber() );
 	mEnableActiveState =	(BitState) U32( mEnableActiveStateInterface->GetNumber() );
 	mParserCommand =		mParserCommandInterface->GetText();
+	mShareScript =			mShareScriptInterface->GetNumber() != 0;
+	mScriptFilter =			mScriptFilterInterface->GetText();
+	mStatisticsFile =		mStatisticsFileInterface->GetText();
+	mTraceFile =			mTraceFileInterface->GetText();
+	mFrameOutput =			mFrameOutputInterface->GetText();
+	mFrameOutputPolicy =	U32( mFrameOutputPolicyInterface->GetNumber() );
+	mScriptRecording =		mScriptRecordingInterface->GetText();
+	mScriptRecordingMode =	U32( mScriptRecordingModeInterface->GetNumber() );
+	mScriptRegion =			region;
+	mScriptRegionStart =	regionStart;
+	mScriptRegionEnd =		regionEnd;
+	mSimulationProfile =	U32( mSimulationProfileInterface->GetNumber() );
+	mSimulationClockHz =	U32( mSimulationClockHzInterface->GetInteger() );
+	mSimulationSeed =		U32( mSimulationSeedInterface->GetInteger() );
 
 	ClearChannels();
 	AddChannel( mMosiChannel, "MOSI", mMosiChannel != UNDEFINED_CHANNEL );
@@ -176,11 +388,34 @@ void EnrichableSpiAnalyzerSettings::LoadSettings( const char* settings )
 	text_archive >>  *(U32*)&mClockInactiveState;
 	text_archive >>  *(U32*)&mDataValidEdge;
 	text_archive >>  *(U32*)&mEnableActiveState;
-	text_archive >>  &mParserCommand;
+	mParserCommand = ReadText( text_archive );
 
 	//bool success = text_archive >> mUsePackets;  //new paramater added -- do this for backwards compatibility
 	//if( success == false )
 	//	mUsePackets = false; //if the archive fails, set the default value
+	mStatisticsFile = ReadText( text_archive );
+	mTraceFile = ReadText( text_archive );
+	if( !( text_archive >> mSimulationProfile ) )
+		mSimulationProfile = SimulationCounting;
+	if( !( text_archive >> mSimulationClockHz ) )
+		mSimulationClockHz = 0;
+	if( !( text_archive >> mSimulationSeed ) )
+		mSimulationSeed = 1;
+	mScriptFilter = ReadText( text_archive );
+	mFrameOutput = ReadText( text_archive );
+	if( !( text_archive >> mFrameOutputPolicy ) )
+		mFrameOutputPolicy = EnrichableFrameTee::DropWhenFull;
+	if( !( text_archive >> mShareScript ) )
+		mShareScript = false;
+	mScriptRecording = ReadText( text_archive );
+	if( !( text_archive >> mScriptRecordingMode ) )
+		mScriptRecordingMode = EnrichableScriptRecording::Record;
+	if( !( text_archive >> mScriptRegion ) )
+		mScriptRegion = ScriptRegionWholeCapture;
+	if( !( text_archive >> mScriptRegionStart ) )
+		mScriptRegionStart = 0;
+	if( !( text_archive >> mScriptRegionEnd ) )
+		mScriptRegionEnd = 0;
 
 	ClearChannels();
 	AddChannel( mMosiChannel, "MOSI", mMosiChannel != UNDEFINED_CHANNEL );
@@ -205,7 +440,21 @@ const char* EnrichableSpiAnalyzerSettings::SaveSettings()
 	text_archive <<  mClockInactiveState;
 	text_archive <<  mDataValidEdge;
 	text_archive <<  mEnableActiveState;
-	text_archive <<  mParserCommand;
+	text_archive <<  mParserCommand.c_str();
+	text_archive <<  mStatisticsFile.c_str();
+	text_archive <<  mTraceFile.c_str();
+	text_archive <<  mSimulationProfile;
+	text_archive <<  mSimulationClockHz;
+	text_archive <<  mSimulationSeed;
+	text_archive <<  mScriptFilter.c_str();
+	text_archive <<  mFrameOutput.c_str();
+	text_archive <<  mFrameOutputPolicy;
+	text_archive <<  mShareScript;
+	text_archive <<  mScriptRecording.c_str();
+	text_archive <<  mScriptRecordingMode;
+	text_archive <<  mScriptRegion;
+	text_archive <<  mScriptRegionStart;
+	text_archive <<  mScriptRegionEnd;
 
 	return SetReturnString( text_archive.GetString() );
 }
@@ -221,5 +470,43 @@ void EnrichableSpiAnalyzerSettings::UpdateInterfacesFromSettings()
 	mClockInactiveStateInterface->SetNumber( mClockInactiveState );
 	mDataValidEdgeInterface->SetNumber( mDataValidEdge );
 	mEnableActiveStateInterface->SetNumber( mEnableActiveState );
-	mParserCommandInterface->SetText( mParserCommand );
+	mParserCommandInterface->SetText( mParserCommand.c_str() );
+	mShareScriptInterface->SetNumber( mShareScript );
+	mScriptFilterInterface->SetText( mScriptFilter.c_str() );
+	mStatisticsFileInterface->SetText( mStatisticsFile.c_str() );
+	mTraceFileInterface->SetText( mTraceFile.c_str() );
+	mFrameOutputInterface->SetText( mFrameOutput.c_str() );
+	mFrameOutputPolicyInterface->SetNumber( mFrameOutputPolicy );
+	mScriptRecordingInterface->SetText( mScriptRecording.c_str() );
+	mScriptRecordingModeInterface->SetNumber( mScriptRecordingMode );
+	mScriptRegionInterface->SetNumber( mScriptRegion );
+	mScriptRegionStartInterface->SetText( FormatSampleNumber( mScriptRegionStart ).c_str() );
+	mScriptRegionEndInterface->SetText( FormatSampleNumber( mScriptRegionEnd ).c_str() );
+	mSimulationProfileInterface->SetNumber( mSimulationProfile );
+	mSimulationClockHzInterface->SetInteger( mSimulationClockHz );
+	mSimulationSeedInterface->SetInteger( mSimulationSeed );
+}
+
+void EnrichableSpiAnalyzerSettings::GetScriptRegion( U64 trigger_sample, U64* first_sample, U64* last_sample )
+{
+	if( mScriptRegion == ScriptRegionWholeCapture )
+	{
+		*first_sample = 0;
+		*last_sample = ~U64( 0 );
+		return;
+	}
+
+	U64 origin = 0;
+	if( mScriptRegion == ScriptRegionAroundTrigger )
+		origin = trigger_sample;
+
+	*first_sample = OffsetSample( origin, mScriptRegionStart );
+	*last_sample = OffsetSample( origin, mScriptRegionEnd );
+
+	// A region ending before the capture starts holds no frames.
+	if( mScriptRegionEnd < 0 && U64( -( mScriptRegionEnd + 1 ) ) >= origin )
+	{
+		*first_sample = 1;
+		*last_sample = 0;
+	}
 }
@@ -3,6 +3,25 @@
 
 #include <AnalyzerSettings.h>
 #include <AnalyzerTypes.h>
+#include <string>
+
+enum SpiSimulationProfile
+{
+	SimulationCounting,
+	SimulationBursts,
+	SimulationRegisterAccess,
+	SimulationLongTransactions,
+	SimulationRandomGaps,
+	SimulationClockErrors
+};
+
+// Which frames the enrichment script is asked about.
+enum SpiScriptRegion
+{
+	ScriptRegionWholeCapture,
+	ScriptRegionAroundTrigger,
+	ScriptRegionSampleRange
+};
 
 class EnrichableSpiAnalyzerSettings : public AnalyzerSettings
 {
@@ -15,6 +34,10 @@ public:
 	virtual const char* SaveSettings();
 
 	void UpdateInterfacesFromSettings();
+
+	// The first and last sample of the frames sent to the enrichment
+	// script, in a capture triggered at `trigger_sample`.
+	void GetScriptRegion( U64 trigger_sample, U64* first_sample, U64* last_sample );
 	
 	Channel mMosiChannel;
 	Channel mMisoChannel;
@@ -25,7 +48,23 @@ public:
 	BitState mClockInactiveState;
 	AnalyzerEnums::Edge mDataValidEdge;
 	BitState mEnableActiveState;
-	const char* mParserCommand;
+	std::string mParserCommand;
+	bool mShareScript;
+	std::string mScriptFilter;
+	std::string mStatisticsFile;
+	std::string mTraceFile;
+	std::string mFrameOutput;
+	U32 mFrameOutputPolicy;
+	std::string mScriptRecording;
+	U32 mScriptRecordingMode;
+	U32 mScriptRegion;
+	// Offsets from the trigger, or sample numbers, depending on
+	// `mScriptRegion`; both ends are included.
+	S64 mScriptRegionStart;
+	S64 mScriptRegionEnd;
+	U32 mSimulationProfile;
+	U32 mSimulationClockHz;
+	U32 mSimulationSeed;
 
 
 protected:
@@ -39,6 +78,20 @@ protected:
 	std::auto_ptr< AnalyzerSettingInterfaceNumberList > mDataValidEdgeInterface;
 	std::auto_ptr< AnalyzerSettingInterfaceNumberList > mEnableActiveStateInterface;
 	std::auto_ptr< AnalyzerSettingInterfaceText >		mParserCommandInterface;
+	std::auto_ptr< AnalyzerSettingInterfaceNumberList > mShareScriptInterface;
+	std::auto_ptr< AnalyzerSettingInterfaceText >		mScriptFilterInterface;
+	std::auto_ptr< AnalyzerSettingInterfaceText >		mStatisticsFileInterface;
+	std::auto_ptr< AnalyzerSettingInterfaceText >		mTraceFileInterface;
+	std::auto_ptr< AnalyzerSettingInterfaceText >		mFrameOutputInterface;
+	std::auto_ptr< AnalyzerSettingInterfaceNumberList > mFrameOutputPolicyInterface;
+	std::auto_ptr< AnalyzerSettingInterfaceText >		mScriptRecordingInterface;
+	std::auto_ptr< AnalyzerSettingInterfaceNumberList > mScriptRecordingModeInterface;
+	std::auto_ptr< AnalyzerSettingInterfaceNumberList > mScriptRegionInterface;
+	std::auto_ptr< AnalyzerSettingInterfaceText >		mScriptRegionStartInterface;
+	std::auto_ptr< AnalyzerSettingInterfaceText >		mScriptRegionEndInterface;
+	std::auto_ptr< AnalyzerSettingInterfaceNumberList > mSimulationProfileInterface;
+	std::auto_ptr< AnalyzerSettingInterfaceInteger >	mSimulationClockHzInterface;
+	std::auto_ptr< AnalyzerSettingInterfaceInteger >	mSimulationSeedInterface;
 };
 
 #endif //SPI_ANALYZER_SETTINGS
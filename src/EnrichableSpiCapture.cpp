@@ -0,0 +1,153 @@
+#include "EnrichableSpiCapture.h"
+
+#include <algorithm>
+
+CaptureChannel::CaptureChannel()
+:	mInitialState( BIT_LOW )
+{
+}
+
+void CaptureChannel::AddTransition( U64 sample )
+{
+	mTransitions.push_back( sample );
+}
+
+EnrichableSpiCapture::EnrichableSpiCapture()
+:	mSampleRate( 0 ),
+	mTriggerSample( 0 )
+{
+}
+
+CaptureChannel* EnrichableSpiCapture::GetChannel( const Channel& channel )
+{
+	if( channel == UNDEFINED_CHANNEL || channel.mChannelIndex >= mChannels.size() )
+		return NULL;
+
+	return &mChannels[channel.mChannelIndex];
+}
+
+CaptureChannel& EnrichableSpiCapture::AddChannel( U32 channelIndex )
+{
+	if( channelIndex >= mChannels.size() )
+		mChannels.resize( channelIndex + 1 );
+
+	return mChannels[channelIndex];
+}
+
+U64 EnrichableSpiCapture::GetEdgeCount() const
+{
+	U64 count = 0;
+	for( const CaptureChannel& channel : mChannels )
+		count += channel.mTransitions.size();
+
+	return count;
+}
+
+const char* CaptureExhausted::what() const throw()
+{
+	return "end of capture data";
+}
+
+CaptureChannelData::CaptureChannelData( const CaptureChannel* channel )
+:	mTransitions( channel->mTransitions.data() ),
+	mTransitionCount( channel->mTransitions.size() ),
+	mInitialState( channel->mInitialState ),
+	mNextTransition( 0 ),
+	mCurrentSample( 0 ),
+	mExhausted( false )
+{
+}
+
+CaptureChannelData::CaptureChannelData( const CaptureChannel* channel, U64 end_sample )
+:	mTransitions( channel->mTransitions.data() ),
+	mTransitionCount( std::lower_bound( channel->mTransitions.begin(), channel->mTransitions.end(), end_sample ) - channel->mTransitions.begin() ),
+	mInitialState( channel->mInitialState ),
+	mNextTransition( 0 ),
+	mCurrentSample( 0 ),
+	mExhausted( false )
+{
+}
+
+U64 CaptureChannelData::GetSampleNumber()
+{
+	return mCurrentSample;
+}
+
+BitState CaptureChannelData::GetBitState()
+{
+	if( ( mNextTransition & 1 ) == 0 )
+		return mInitialState;
+
+	return Invert( mInitialState );
+}
+
+U32 CaptureChannelData::Advance( U32 num_samples )
+{
+	return AdvanceToAbsPosition( mCurrentSample + num_samples );
+}
+
+U32 CaptureChannelData::AdvanceToAbsPosition( U64 sample_number )
+{
+	size_t start = mNextTransition;
+
+	// Data lines are usually advanced by a clock period or less, so a short
+	// linear scan wins; fall back to a binary search for long jumps.
+	for( U32 i = 0; i < 8; i++ )
+	{
+		if( mNextTransition == mTransitionCount || mTransitions[mNextTransition] > sample_number )
+		{
+			mCurrentSample = sample_number;
+			return U32( mNextTransition - start );
+		}
+		mNextTransition++;
+	}
+
+	const U64* next = std::upper_bound( mTransitions + mNextTransition, mTransitions + mTransitionCount, sample_number );
+	mNextTransition = next - mTransitions;
+	mCurrentSample = sample_number;
+
+	return U32( mNextTransition - start );
+}
+
+void CaptureChannelData::AdvanceToNextEdge()
+{
+	if( mNextTransition == mTransitionCount )
+	{
+		mExhausted = true;
+		throw CaptureExhausted();
+	}
+
+	mCurrentSample = mTransitions[mNextTransition];
+	mNextTransition++;
+}
+
+U64 CaptureChannelData::GetSampleOfNextEdge()
+{
+	if( mNextTransition == mTransitionCount )
+	{
+		mExhausted = true;
+		throw CaptureExhausted();
+	}
+
+	return mTransitions[mNextTransition];
+}
+
+bool CaptureChannelData::WouldAdvancingCauseTransition( U32 num_samples )
+{
+	return WouldAdvancingToAbsPositionCauseTransition( mCurrentSample + num_samples );
+}
+
+bool CaptureChannelData::WouldAdvancingToAbsPositionCauseTransition( U64 sample_number )
+{
+	return mNextTransition < mTransitionCount && mTransitions[mNextTransition] <= sample_number;
+}
+
+bool CaptureChannelData::DoMoreTransitionsExistInCurrentData()
+{
+	return mNextTransition < mTransitionCount;
+}
+
+bool CaptureChannelData::IsExhausted()
+{
+	return mExhausted;
+}
@@ -0,0 +1,79 @@
+#ifndef SPI_CAPTURE_H
+#define SPI_CAPTURE_H
+
+#include <LogicPublicTypes.h>
+
+#include <exception>
+#include <vector>
+
+// Recorded transitions of one digital channel: the state at sample zero and
+// the sample number of every following edge, in increasing order.
+struct CaptureChannel
+{
+	CaptureChannel();
+
+	void AddTransition( U64 sample );
+
+	BitState mInitialState;
+	std::vector<U64> mTransitions;
+};
+
+// A capture held in memory for decoding outside of Logic.  Channels are
+// addressed by their channel index; the device id is ignored.
+class EnrichableSpiCapture
+{
+public:
+	EnrichableSpiCapture();
+
+	CaptureChannel* GetChannel( const Channel& channel );
+	CaptureChannel& AddChannel( U32 channelIndex );
+	U64 GetEdgeCount() const;
+
+	U32 mSampleRate;
+	U64 mTriggerSample;
+	std::vector<CaptureChannel> mChannels;
+};
+
+// Thrown when the decoder asks for an edge beyond the end of the capture.
+// Inside Logic the worker thread simply waits for more data until it is
+// killed; outside of it this is how a decode run finishes.
+class CaptureExhausted : public std::exception
+{
+public:
+	virtual const char* what() const throw();
+};
+
+// Walks a `CaptureChannel` through the subset of the `AnalyzerChannelData`
+// interface used by `EnrichableSpiDecoder`.
+class CaptureChannelData
+{
+public:
+	CaptureChannelData( const CaptureChannel* channel );
+	// Only transitions before `end_sample` are visible; asking for a later
+	// edge throws `CaptureExhausted` as if the capture ended there.
+	CaptureChannelData( const CaptureChannel* channel, U64 end_sample );
+
+	U64 GetSampleNumber();
+	BitState GetBitState();
+	U32 Advance( U32 num_samples );
+	U32 AdvanceToAbsPosition( U64 sample_number );
+	void AdvanceToNextEdge();
+	U64 GetSampleOfNextEdge();
+	bool WouldAdvancingCauseTransition( U32 num_samples );
+	bool WouldAdvancingToAbsPositionCauseTransition( U64 sample_number );
+	bool DoMoreTransitionsExistInCurrentData();
+
+	// True once an edge past the last visible one has been asked for.
+	bool IsExhausted();
+
+protected:
+	const U64* mTransitions;
+	size_t mTransitionCount;
+	BitState mInitialState;
+
+	size_t mNextTransition;
+	U64 mCurrentSample;
+	bool mExhausted;
+};
+
+#endif //SPI_CAPTURE_H
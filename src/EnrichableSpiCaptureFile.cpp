@@ -0,0 +1,286 @@
+#include "EnrichableSpiCaptureFile.h"
+#include "EnrichableSpiPackedSamples.h"
+
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define LOGIC2_BINARY_IDENTIFIER "<SALEAE>"
+#define LOGIC2_BINARY_DIGITAL 0
+#define PACKED_SAMPLES_PER_READ ( 1 << 20 )
+
+namespace
+{
+	struct RawChannel
+	{
+		U32 index;
+		BitState initialState;
+		double beginTime;
+		std::vector<double> transitionTimes;
+	};
+
+	U64 TimeToSample( double time, double startTime, U32 sampleRate )
+	{
+		double sample = std::floor( ( time - startTime ) * sampleRate + 0.5 );
+		return sample < 0 ? 0 : U64( sample );
+	}
+
+	// Adds a transition, dropping pulses that are shorter than one sample
+	// once rounded: both of their edges land on the same sample.
+	void AddRoundedTransition( CaptureChannel* channel, U64 sample )
+	{
+		if( !channel->mTransitions.empty() && channel->mTransitions.back() >= sample )
+		{
+			channel->mTransitions.pop_back();
+			return;
+		}
+		channel->AddTransition( sample );
+	}
+
+	void BuildCapture( std::vector<RawChannel>& raw, U32 sampleRate, EnrichableSpiCapture* capture )
+	{
+		double startTime = 0;
+		for( size_t i = 0; i < raw.size(); i++ )
+		{
+			if( i == 0 || raw[i].beginTime < startTime )
+				startTime = raw[i].beginTime;
+		}
+
+		capture->mChannels.clear();
+		capture->mSampleRate = sampleRate;
+		capture->mTriggerSample = TimeToSample( 0.0, startTime, sampleRate );
+
+		for( RawChannel& channel : raw )
+		{
+			CaptureChannel& target = capture->AddChannel( channel.index );
+			target.mInitialState = channel.initialState;
+			target.mTransitions.reserve( channel.transitionTimes.size() );
+
+			for( double time : channel.transitionTimes )
+				AddRoundedTransition( &target, TimeToSample( time, startTime, sampleRate ) );
+
+			std::vector<double>().swap( channel.transitionTimes );
+		}
+	}
+
+	bool ReadBinaryChannel( const std::string& path, RawChannel* channel, std::string* error )
+	{
+		FILE* f = fopen( path.c_str(), "rb" );
+		if( f == NULL )
+		{
+			*error = "Unable to open " + path;
+			return false;
+		}
+
+		char identifier[8];
+		S32 version;
+		S32 type;
+		U32 initialState;
+		double endTime;
+		U64 transitionCount;
+
+		bool ok = fread( identifier, sizeof( identifier ), 1, f ) == 1
+			&& memcmp( identifier, LOGIC2_BINARY_IDENTIFIER, sizeof( identifier ) ) == 0
+			&& fread( &version, sizeof( version ), 1, f ) == 1
+			&& fread( &type, sizeof( type ), 1, f ) == 1
+			&& ( version == 0 || version == 1 )
+			&& type == LOGIC2_BINARY_DIGITAL
+			&& fread( &initialState, sizeof( initialState ), 1, f ) == 1
+			&& fread( &channel->beginTime, sizeof( channel->beginTime ), 1, f ) == 1
+			&& fread( &endTime, sizeof( endTime ), 1, f ) == 1
+			&& fread( &transitionCount, sizeof( transitionCount ), 1, f ) == 1;
+
+		if( ok )
+		{
+			channel->initialState = initialState ? BIT_HIGH : BIT_LOW;
+			channel->transitionTimes.resize( transitionCount );
+			ok = transitionCount == 0
+				|| fread( &channel->transitionTimes[0], sizeof( double ), transitionCount, f ) == transitionCount;
+		}
+		fclose( f );
+
+		if( !ok )
+			*error = path + " is not a Logic 2 digital binary export";
+
+		return ok;
+	}
+
+	std::vector<std::string> SplitCsvLine( const std::string& line )
+	{
+		std::vector<std::string> fields;
+		std::stringstream ss( line );
+		std::string field;
+
+		while( std::getline( ss, field, ',' ) )
+			fields.push_back( field );
+
+		return fields;
+	}
+}
+
+bool LoadLogicBinaryExport( const std::string& directory, U32 sampleRate, EnrichableSpiCapture* capture, std::string* error )
+{
+	DIR* dir = opendir( directory.c_str() );
+	if( dir == NULL )
+	{
+		*error = "Unable to open directory " + directory;
+		return false;
+	}
+
+	std::vector<RawChannel> raw;
+	struct dirent* entry;
+	bool ok = true;
+	while( ok && ( entry = readdir( dir ) ) != NULL )
+	{
+		unsigned index;
+		char suffix[8];
+		if( sscanf( entry->d_name, "digital_%u.%7s", &index, suffix ) != 2 || strcmp( suffix, "bin" ) != 0 )
+			continue;
+
+		raw.push_back( RawChannel() );
+		raw.back().index = index;
+		ok = ReadBinaryChannel( directory + "/" + entry->d_name, &raw.back(), error );
+	}
+	closedir( dir );
+
+	if( ok && raw.empty() )
+	{
+		*error = "No digital_N.bin files found in " + directory;
+		ok = false;
+	}
+	if( !ok )
+		return false;
+
+	BuildCapture( raw, sampleRate, capture );
+	return true;
+}
+
+bool LoadLogicCsvExport( const std::string& path, U32 sampleRate, EnrichableSpiCapture* capture, std::string* error )
+{
+	std::ifstream in( path.c_str() );
+	if( !in )
+	{
+		*error = "Unable to open " + path;
+		return false;
+	}
+
+	std::string line;
+	if( !std::getline( in, line ) )
+	{
+		*error = path + " is empty";
+		return false;
+	}
+
+	// Columns are named "Channel N"; fall back to their position otherwise.
+	std::vector<std::string> header = SplitCsvLine( line );
+	std::vector<RawChannel> raw( header.size() > 0 ? header.size() - 1 : 0 );
+	for( size_t i = 0; i < raw.size(); i++ )
+	{
+		const char* name = header[i + 1].c_str();
+		const char* digits = name + strcspn( name, "0123456789" );
+		raw[i].index = *digits ? strtoul( digits, NULL, 10 ) : U32( i );
+		raw[i].beginTime = 0;
+		raw[i].initialState = BIT_LOW;
+	}
+	if( raw.empty() )
+	{
+		*error = path + " has no channel columns";
+		return false;
+	}
+
+	bool first = true;
+	while( std::getline( in, line ) )
+	{
+		if( line.empty() || line == "\r" )
+			continue;
+
+		std::vector<std::string> fields = SplitCsvLine( line );
+		if( fields.size() < raw.size() + 1 )
+		{
+			*error = "Malformed row in " + path + ": " + line;
+			return false;
+		}
+
+		double time = strtod( fields[0].c_str(), NULL );
+		for( size_t i = 0; i < raw.size(); i++ )
+		{
+			BitState state = strtol( fields[i + 1].c_str(), NULL, 10 ) ? BIT_HIGH : BIT_LOW;
+			if( first )
+			{
+				raw[i].beginTime = time;
+				raw[i].initialState = state;
+				continue;
+			}
+
+			bool odd = raw[i].transitionTimes.size() & 1;
+			BitState current = odd ? Invert( raw[i].initialState ) : raw[i].initialState;
+			if( state != current )
+				raw[i].transitionTimes.push_back( time );
+		}
+		first = false;
+	}
+
+	BuildCapture( raw, sampleRate, capture );
+	return true;
+}
+
+bool LoadPackedSampleFile( const std::string& path, U32 sampleRate, U32 bytesPerSample, U64 channelMask, EnrichableSpiCapture* capture, std::string* error )
+{
+	if( bytesPerSample != 1 && bytesPerSample != 2 && bytesPerSample != 4 && bytesPerSample != 8 )
+	{
+		*error = "Packed samples must be 1, 2, 4 or 8 bytes wide";
+		return false;
+	}
+
+	FILE* f = fopen( path.c_str(), "rb" );
+	if( f == NULL )
+	{
+		*error = "Unable to open " + path;
+		return false;
+	}
+
+	capture->mChannels.clear();
+	capture->mSampleRate = sampleRate;
+	capture->mTriggerSample = 0;
+
+	PackedSampleReader reader( capture, bytesPerSample, channelMask );
+	std::vector<U8> buffer( size_t( PACKED_SAMPLES_PER_READ ) * bytesPerSample );
+	size_t count;
+	while( ( count = fread( &buffer[0], bytesPerSample, PACKED_SAMPLES_PER_READ, f ) ) > 0 )
+		reader.AddSamples( &buffer[0], count );
+
+	bool ok = !ferror( f );
+	fclose( f );
+
+	if( !ok )
+		*error = "Unable to read " + path;
+	else if( reader.GetSampleCount() == 0 )
+	{
+		*error = path + " holds no samples";
+		ok = false;
+	}
+
+	return ok;
+}
+
+bool LoadLogicExport( const std::string& path, U32 sampleRate, EnrichableSpiCapture* capture, std::string* error )
+{
+	struct stat info;
+	if( stat( path.c_str(), &info ) != 0 )
+	{
+		*error = "Unable to open " + path;
+		return false;
+	}
+
+	if( S_ISDIR( info.st_mode ) )
+		return LoadLogicBinaryExport( path, sampleRate, capture, error );
+
+	return LoadLogicCsvExport( path, sampleRate, capture, error );
+}
@@ -0,0 +1,29 @@
+#ifndef SPI_CAPTURE_FILE_H
+#define SPI_CAPTURE_FILE_H
+
+#include "EnrichableSpiCapture.h"
+
+#include <string>
+
+// Readers for digital data exported from Logic.  Transition times are
+// converted to sample numbers at `sampleRate`; sample zero is the start of
+// the export and `mTriggerSample` is set to time zero.  On failure they
+// return false and describe the problem in `error`.
+
+// A Logic 2 binary export directory holding one `digital_N.bin` per channel.
+bool LoadLogicBinaryExport( const std::string& directory, U32 sampleRate, EnrichableSpiCapture* capture, std::string* error );
+
+// A CSV export with a time column followed by one column per channel, with
+// one row per transition ("Time [s],Channel 0,Channel 1,...").
+bool LoadLogicCsvExport( const std::string& path, U32 sampleRate, EnrichableSpiCapture* capture, std::string* error );
+
+// Raw packed samples: every sample is `bytesPerSample` (1, 2, 4 or 8)
+// little-endian bytes with bit N holding channel N.  Only the channels in
+// `channelMask` are read.
+bool LoadPackedSampleFile( const std::string& path, U32 sampleRate, U32 bytesPerSample, U64 channelMask, EnrichableSpiCapture* capture, std::string* error );
+
+// Picks the reader from the path: directories are binary exports, anything
+// else is read as CSV.
+bool LoadLogicExport( const std::string& path, U32 sampleRate, EnrichableSpiCapture* capture, std::string* error );
+
+#endif //SPI_CAPTURE_FILE_H
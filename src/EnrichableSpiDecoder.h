@@ -0,0 +1,503 @@
+#ifndef SPI_DECODER_H
+#define SPI_DECODER_H
+
+#include <AnalyzerHelpers.h>
+#include <AnalyzerResults.h>
+#include "EnrichableSpiAnalyzerSettings.h"
+#include "EnrichableSpiAnalyzerResults.h"
+#include "EnrichableAnalyzerSubprocess.h"
+#include "EnrichableTrace.h"
+#include "EnrichableFrameTee.h"
+
+#include <deque>
+#include <iostream>
+#include <vector>
+
+// Frames whose `marker` requests may wait for the script to finish starting
+// before decoding waits for it too.
+#define MAX_PENDING_MARKER_FRAMES 16384
+
+// SPI framing shared by the Logic plugin and the headless tools.
+//
+// `ChannelData` is `AnalyzerChannelData` inside Logic, or any class offering
+// the same navigation methods (see `CaptureChannelData`).
+//
+// `Results` receives decoded frames; it must provide `AddFrame`, `AddMarker`,
+// `CommitPacketAndStartNewPacket`, `CommitResults` and `GetNumPackets` with
+// the same meaning as their `AnalyzerResults` counterparts.
+//
+// `Host` provides `ReportProgress` and `CheckIfThreadShouldExit`, as
+// `Analyzer` does.
+//
+// `trace`, which may be NULL, receives spans for enable seeks and commits.
+// `tee`, which may be NULL, receives every frame added to the results.
+//
+// While the enrichment script is still starting, decoding carries on and the
+// `marker` requests for the frames it produces are queued; they are sent once
+// the script is ready, or once the decoder has caught up with the data.
+template< class ChannelData, class Results, class Host >
+class EnrichableSpiDecoder
+{
+public:
+	EnrichableSpiDecoder( EnrichableSpiAnalyzerSettings* settings, Host* host );
+
+	void Setup(
+		Results* results,
+		EnrichableAnalyzerSubprocess* subprocess,
+		EnrichableTrace* trace,
+		EnrichableFrameTee* tee,
+		ChannelData* mosi,
+		ChannelData* miso,
+		ChannelData* clock,
+		ChannelData* enable
+	);
+	void AdvanceToActiveEnableEdgeWithCorrectClockPolarity();
+	void GetWord();
+	// Waits for the script and sends any queued `marker` requests.
+	void FlushPendingMarkers();
+
+protected: //functions
+	void AdvanceToActiveEnableEdge();
+	bool IsInitialClockPolarityCorrect();
+	bool WouldAdvancingTheClockToggleEnable();
+	// One bit loop per data-valid edge, channel set and shift order, so none
+	// of them is decided per bit; `Setup` picks the one to use.
+	typedef void ( EnrichableSpiDecoder::*WordDecoder )();
+	WordDecoder SelectWordDecoder();
+	template< bool LeadingEdge, bool HasMosi, bool HasMiso, bool MsbFirst >
+	void DecodeWordAs();
+	template< bool HasMosi, bool HasMiso, bool MsbFirst >
+	void SampleBit( U32 index, U64& mosi_word, U64& miso_word );
+	U64 AddFrame( const Frame& frame );
+	void EmitMarkers( U64 frameIndex, Frame& frame );
+	void EmitMarkers( U64 packetId, U64 frameIndex, Frame& frame, const std::vector<U64>& arrowLocations );
+
+	struct PendingMarkers
+	{
+		U64 mPacketId;
+		U64 mFrameIndex;
+		Frame mFrame;
+		std::vector<U64> mArrowLocations;
+	};
+
+protected:  //vars
+	EnrichableSpiAnalyzerSettings* mSettings;
+	Host* mHost;
+	Results* mResults;
+	EnrichableAnalyzerSubprocess* mSubprocess;
+	EnrichableTrace* mTrace;
+	EnrichableFrameTee* mTee;
+
+	ChannelData* mMosi;
+	ChannelData* mMiso;
+	ChannelData* mClock;
+	ChannelData* mEnable;
+	WordDecoder mDecodeWord;
+
+	U64 mCurrentSample;
+	AnalyzerResults::MarkerType mArrowMarker;
+	std::vector<U64> mArrowLocations;
+	std::deque<PendingMarkers> mPendingMarkers;
+
+	U8 packetFrameIndex;
+};
+
+template< class ChannelData, class Results, class Host >
+EnrichableSpiDecoder< ChannelData, Results, Host >::EnrichableSpiDecoder( EnrichableSpiAnalyzerSettings* settings, Host* host )
+:	mSettings( settings ),
+	mHost( host ),
+	mResults( NULL ),
+	mSubprocess( NULL ),
+	mTrace( NULL ),
+	mTee( NULL ),
+	mMosi( NULL ),
+	mMiso( NULL ),
+	mClock( NULL ),
+	mEnable( NULL ),
+	mDecodeWord( NULL ),
+	mCurrentSample( 0 ),
+	mArrowMarker( AnalyzerResults::UpArrow ),
+	packetFrameIndex( 0 )
+{
+}
+
+template< class ChannelData, class Results, class Host >
+void EnrichableSpiDecoder< ChannelData, Results, Host >::Setup(
+	Results* results,
+	EnrichableAnalyzerSubprocess* subprocess,
+	EnrichableTrace* trace,
+	EnrichableFrameTee* tee,
+	ChannelData* mosi,
+	ChannelData* miso,
+	ChannelData* clock,
+	ChannelData* enable
+) {
+	mResults = results;
+	mSubprocess = subprocess;
+	mTrace = trace;
+	mTee = tee;
+
+	if( mSettings->mClockInactiveState == BIT_LOW )
+	{
+		if( mSettings->mDataValidEdge == AnalyzerEnums::LeadingEdge )
+			mArrowMarker = AnalyzerResults::UpArrow;
+		else
+			mArrowMarker = AnalyzerResults::DownArrow;
+
+	}else
+	{
+		if( mSettings->mDataValidEdge == AnalyzerEnums::LeadingEdge )
+			mArrowMarker = AnalyzerResults::DownArrow;
+		else
+			mArrowMarker = AnalyzerResults::UpArrow;
+	}
+
+	mMosi = mosi;
+	mMiso = miso;
+	mClock = clock;
+	mEnable = enable;
+	mDecodeWord = SelectWordDecoder();
+
+	mCurrentSample = 0;
+	packetFrameIndex = 0;
+	mPendingMarkers.clear();
+}
+
+template< class ChannelData, class Results, class Host >
+void EnrichableSpiDecoder< ChannelData, Results, Host >::AdvanceToActiveEnableEdgeWithCorrectClockPolarity()
+{
+	TraceSpan span( mTrace, "enable seek" );
+
+	mResults->CommitPacketAndStartNewPacket();
+	mResults->CommitResults();
+
+	AdvanceToActiveEnableEdge();
+
+	for( ; ; )
+	{
+		if( IsInitialClockPolarityCorrect() == true )  //if false, this function moves to the next active enable edge.
+			break;
+	}
+}
+
+template< class ChannelData, class Results, class Host >
+void EnrichableSpiDecoder< ChannelData, Results, Host >::AdvanceToActiveEnableEdge()
+{
+	if( mEnable != NULL )
+	{
+		if( mEnable->GetBitState() != mSettings->mEnableActiveState )
+		{
+			mEnable->AdvanceToNextEdge();
+		}else
+		{
+			mEnable->AdvanceToNextEdge();
+			mEnable->AdvanceToNextEdge();
+		}
+		mCurrentSample = mEnable->GetSampleNumber();
+		mClock->AdvanceToAbsPosition( mCurrentSample );
+		packetFrameIndex = 0;
+	}else
+	{
+		mCurrentSample = mClock->GetSampleNumber();
+	}
+}
+
+template< class ChannelData, class Results, class Host >
+bool EnrichableSpiDecoder< ChannelData, Results, Host >::IsInitialClockPolarityCorrect()
+{
+	if( mClock->GetBitState() == mSettings->mClockInactiveState )
+		return true;
+
+	mResults->AddMarker( mCurrentSample, AnalyzerResults::ErrorSquare, mSettings->mClockChannel );
+
+	if( mEnable != NULL )
+	{
+		Frame error_frame;
+		error_frame.mStartingSampleInclusive = mCurrentSample;
+
+		mEnable->AdvanceToNextEdge();
+		mCurrentSample = mEnable->GetSampleNumber();
+
+		error_frame.mEndingSampleInclusive = mCurrentSample;
+		error_frame.mFlags = SPI_ERROR_FLAG | DISPLAY_AS_ERROR_FLAG;
+		AddFrame( error_frame );
+		mResults->CommitResults();
+		mHost->ReportProgress( error_frame.mEndingSampleInclusive );
+
+		//move to the next active-going enable edge
+		mEnable->AdvanceToNextEdge();
+		mCurrentSample = mEnable->GetSampleNumber();
+		mClock->AdvanceToAbsPosition( mCurrentSample );
+
+		return false;
+	}else
+	{
+		mClock->AdvanceToNextEdge();  //at least start with the clock in the idle state.
+		mCurrentSample = mClock->GetSampleNumber();
+		return true;
+	}
+}
+
+template< class ChannelData, class Results, class Host >
+bool EnrichableSpiDecoder< ChannelData, Results, Host >::WouldAdvancingTheClockToggleEnable()
+{
+	if( mEnable == NULL )
+		return false;
+
+	U64 next_edge = mClock->GetSampleOfNextEdge();
+	bool enable_will_toggle = mEnable->WouldAdvancingToAbsPositionCauseTransition( next_edge );
+
+	if( enable_will_toggle == false )
+		return false;
+	else
+		return true;
+}
+
+template< class ChannelData, class Results, class Host >
+void EnrichableSpiDecoder< ChannelData, Results, Host >::GetWord()
+{
+	( this->*mDecodeWord )();
+}
+
+template< class ChannelData, class Results, class Host >
+typename EnrichableSpiDecoder< ChannelData, Results, Host >::WordDecoder EnrichableSpiDecoder< ChannelData, Results, Host >::SelectWordDecoder()
+{
+	static const WordDecoder decoders[ 16 ] =
+	{
+		&EnrichableSpiDecoder::DecodeWordAs< false, false, false, false >,
+		&EnrichableSpiDecoder::DecodeWordAs< false, false, false, true >,
+		&EnrichableSpiDecoder::DecodeWordAs< false, false, true, false >,
+		&EnrichableSpiDecoder::DecodeWordAs< false, false, true, true >,
+		&EnrichableSpiDecoder::DecodeWordAs< false, true, false, false >,
+		&EnrichableSpiDecoder::DecodeWordAs< false, true, false, true >,
+		&EnrichableSpiDecoder::DecodeWordAs< false, true, true, false >,
+		&EnrichableSpiDecoder::DecodeWordAs< false, true, true, true >,
+		&EnrichableSpiDecoder::DecodeWordAs< true, false, false, false >,
+		&EnrichableSpiDecoder::DecodeWordAs< true, false, false, true >,
+		&EnrichableSpiDecoder::DecodeWordAs< true, false, true, false >,
+		&EnrichableSpiDecoder::DecodeWordAs< true, false, true, true >,
+		&EnrichableSpiDecoder::DecodeWordAs< true, true, false, false >,
+		&EnrichableSpiDecoder::DecodeWordAs< true, true, false, true >,
+		&EnrichableSpiDecoder::DecodeWordAs< true, true, true, false >,
+		&EnrichableSpiDecoder::DecodeWordAs< true, true, true, true >,
+	};
+
+	U32 index = 0;
+	if( mSettings->mDataValidEdge == AnalyzerEnums::LeadingEdge )
+		index |= 8;
+	if( mMosi != NULL )
+		index |= 4;
+	if( mMiso != NULL )
+		index |= 2;
+	if( mSettings->mShiftOrder == AnalyzerEnums::MsbFirst )
+		index |= 1;
+	return decoders[ index ];
+}
+
+template< class ChannelData, class Results, class Host >
+template< bool LeadingEdge, bool HasMosi, bool HasMiso, bool MsbFirst >
+void EnrichableSpiDecoder< ChannelData, Results, Host >::DecodeWordAs()
+{
+	//we're assuming we come into this function with the clock in the idle state;
+
+	U32 bits_per_transfer = mSettings->mBitsPerTransfer;
+
+	U64 mosi_word = 0;
+	U64 miso_word = 0;
+
+	U64 first_sample = 0;
+	bool need_reset = false;
+
+	mArrowLocations.clear();
+	mHost->ReportProgress( mClock->GetSampleNumber() );
+
+	for( U32 i=0; i<bits_per_transfer; i++ )
+	{
+		if( i == 0 )
+			mHost->CheckIfThreadShouldExit();
+
+		//on every single edge, we need to check that enable doesn't toggle.
+		//note that we can't just advance the enable line to the next edge, becuase there may not be another edge
+
+		if( WouldAdvancingTheClockToggleEnable() == true )
+		{
+			AdvanceToActiveEnableEdgeWithCorrectClockPolarity();  //ok, we pretty much need to reset everything and return.
+			return;
+		}
+
+		mClock->AdvanceToNextEdge();
+		if( i == 0 )
+			first_sample = mClock->GetSampleNumber();
+
+		if( LeadingEdge )
+			SampleBit< HasMosi, HasMiso, MsbFirst >( i, mosi_word, miso_word );
+
+
+		// ok, the trailing edge is messy -- but only on the very last bit.
+		// If the trialing edge isn't doesn't represent valid data, we want to allow the enable line to rise before the clock trialing edge -- and still report the frame
+		if( LeadingEdge && ( i == ( bits_per_transfer - 1 ) ) )
+		{
+			//if this is the last bit, and the trailing edge doesn't represent valid data
+			if( WouldAdvancingTheClockToggleEnable() == true )
+			{
+				//moving to the trailing edge would cause the clock to revert to inactive.  jump out, record the frame, and them move to the next active enable edge
+				need_reset = true;
+				break;
+			}
+
+			//enable isn't going to go inactive, go ahead and advance the clock as usual.  Then we're done, jump out and record the frame.
+			mClock->AdvanceToNextEdge();
+			break;
+		}
+
+		//this isn't the very last bit, etc, so proceed as normal
+		if( WouldAdvancingTheClockToggleEnable() == true )
+		{
+			AdvanceToActiveEnableEdgeWithCorrectClockPolarity();  //ok, we pretty much need to reset everything and return.
+			return;
+		}
+
+		mClock->AdvanceToNextEdge();
+
+		if( !LeadingEdge )
+			SampleBit< HasMosi, HasMiso, MsbFirst >( i, mosi_word, miso_word );
+
+	}
+
+	Frame result_frame;
+	result_frame.mStartingSampleInclusive = first_sample;
+	result_frame.mEndingSampleInclusive = mClock->GetSampleNumber();
+	result_frame.mData1 = mosi_word;
+	result_frame.mData2 = miso_word;
+	result_frame.mFlags = 0;
+	result_frame.mType = packetFrameIndex++;
+	U64 frameIndex = AddFrame( result_frame );
+
+	//save the resuls:
+	U32 count = mArrowLocations.size();
+	for( U32 i=0; i<count; i++ ) {
+		mResults->AddMarker(
+			mArrowLocations[i], mArrowMarker, mSettings->mClockChannel
+		);
+	}
+
+	EmitMarkers( frameIndex, result_frame );
+
+	{
+		TraceSpan span( mTrace, "commit", frameIndex );
+		mResults->CommitResults();
+	}
+
+	if( need_reset == true )
+		AdvanceToActiveEnableEdgeWithCorrectClockPolarity();
+}
+
+template< class ChannelData, class Results, class Host >
+template< bool HasMosi, bool HasMiso, bool MsbFirst >
+void EnrichableSpiDecoder< ChannelData, Results, Host >::SampleBit( U32 index, U64& mosi_word, U64& miso_word )
+{
+	mCurrentSample = mClock->GetSampleNumber();
+	// BIT_LOW and BIT_HIGH are 0 and 1; MSB-first words are shifted up as
+	// bits arrive, LSB-first bits go straight to their place.
+	if( HasMosi )
+	{
+		mMosi->AdvanceToAbsPosition( mCurrentSample );
+		U64 bit = U64( mMosi->GetBitState() == BIT_HIGH );
+		mosi_word = MsbFirst ? ( mosi_word << 1 ) | bit : mosi_word | ( bit << index );
+	}
+	if( HasMiso )
+	{
+		mMiso->AdvanceToAbsPosition( mCurrentSample );
+		U64 bit = U64( mMiso->GetBitState() == BIT_HIGH );
+		miso_word = MsbFirst ? ( miso_word << 1 ) | bit : miso_word | ( bit << index );
+	}
+	mArrowLocations.push_back( mCurrentSample );
+}
+
+template< class ChannelData, class Results, class Host >
+U64 EnrichableSpiDecoder< ChannelData, Results, Host >::AddFrame( const Frame& frame )
+{
+	U64 frameIndex = mResults->AddFrame( frame );
+	if( mTee != NULL )
+		mTee->Publish( frameIndex, frame );
+	return frameIndex;
+}
+
+template< class ChannelData, class Results, class Host >
+void EnrichableSpiDecoder< ChannelData, Results, Host >::FlushPendingMarkers()
+{
+	if( mSubprocess == NULL || mPendingMarkers.empty() )
+		return;
+
+	bool enabled = mSubprocess->MarkerEnabled();
+	for( PendingMarkers& pending : mPendingMarkers )
+	{
+		if( enabled )
+			EmitMarkers( pending.mPacketId, pending.mFrameIndex, pending.mFrame, pending.mArrowLocations );
+	}
+	mPendingMarkers.clear();
+}
+
+template< class ChannelData, class Results, class Host >
+void EnrichableSpiDecoder< ChannelData, Results, Host >::EmitMarkers( U64 frameIndex, Frame& frame )
+{
+	if( mSubprocess == NULL || !mSubprocess->FrameSelected( EnrichableAnalyzerStats::Marker, frame ) )
+		return;
+
+	if( !mSubprocess->Ready() && mPendingMarkers.size() < MAX_PENDING_MARKER_FRAMES )
+	{
+		mPendingMarkers.push_back( PendingMarkers() );
+		PendingMarkers& pending = mPendingMarkers.back();
+		pending.mPacketId = mResults->GetNumPackets();
+		pending.mFrameIndex = frameIndex;
+		pending.mFrame = frame;
+		pending.mArrowLocations = mArrowLocations;
+
+		// Nothing is left to decode until more data arrives, so the
+		// script may as well be waited for now.
+		if( !mClock->DoMoreTransitionsExistInCurrentData() )
+			FlushPendingMarkers();
+		return;
+	}
+
+	// Earlier frames go first, so each channel's markers stay in order.
+	FlushPendingMarkers();
+	if( !mSubprocess->MarkerEnabled() )
+		return;
+
+	EmitMarkers( mResults->GetNumPackets(), frameIndex, frame, mArrowLocations );
+}
+
+template< class ChannelData, class Results, class Host >
+void EnrichableSpiDecoder< ChannelData, Results, Host >::EmitMarkers( U64 packetId, U64 frameIndex, Frame& frame, const std::vector<U64>& arrowLocations )
+{
+	std::vector<EnrichableAnalyzerSubprocess::Marker> markers = mSubprocess->EmitMarker(
+		packetId,
+		frameIndex,
+		frame,
+		arrowLocations.size()
+	);
+
+	Channel* channel = NULL;
+	for(const EnrichableAnalyzerSubprocess::Marker& marker : markers) {
+		if(marker.channelName == "miso") {
+			channel = &mSettings->mMisoChannel;
+		} else if (marker.channelName == "mosi") {
+			channel = &mSettings->mMosiChannel;
+		}
+		if(channel != NULL) {
+			mResults->AddMarker(
+				arrowLocations[marker.sampleNumber],
+				marker.markerType,
+				*channel
+			);
+		} else {
+			break;
+			std::cerr << "Received marker request for invalid marker: ";
+			std::cerr << marker.channelName;
+			std::cerr << " ignoring.\n";
+		}
+	}
+}
+
+#endif //SPI_DECODER_H
@@ -0,0 +1,130 @@
+#ifndef SPI_EXPORT_H
+#define SPI_EXPORT_H
+
+#include <AnalyzerHelpers.h>
+#include "EnrichableSpiAnalyzerSettings.h"
+#include "EnrichableSpiAnalyzerResults.h"
+#include "EnrichableAnalyzerSubprocess.h"
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Export types registered by EnrichableSpiAnalyzerSettings.
+#define SPI_EXPORT_CSV 0
+#define SPI_EXPORT_ENRICHED_CSV 1
+
+// Appends the header line of the "Export as text/csv file" CSV to `ss`;
+// `enriched` adds the "Enrichment" column.
+inline void FormatSpiExportHeader( std::stringstream& ss, bool enriched )
+{
+	if( enriched )
+		ss << "Time [s],Packet ID,MOSI,MISO,Enrichment" << std::endl;
+	else
+		ss << "Time [s],Packet ID,MOSI,MISO" << std::endl;
+}
+
+// Appends the CSV line of frame `frame_index` to `ss`.  `packet_id` is
+// `INVALID_RESULT_INDEX` for frames outside of a packet.  With `enriched`,
+// the script's tabular text for the frame fills the last column;
+// `subprocess` may be NULL, leaving it empty.
+inline void FormatSpiExportRow(
+	std::stringstream& ss,
+	Frame frame,
+	U64 frame_index,
+	U64 packet_id,
+	EnrichableSpiAnalyzerSettings* settings,
+	EnrichableAnalyzerSubprocess* subprocess,
+	U64 trigger_sample,
+	U32 sample_rate,
+	DisplayBase display_base,
+	bool enriched
+) {
+	char time_str[128];
+	AnalyzerHelpers::GetTimeString( frame.mStartingSampleInclusive, trigger_sample, sample_rate, time_str, 128 );
+
+	char mosi_str[128] = "";
+	if( settings->mMosiChannel != UNDEFINED_CHANNEL )
+		AnalyzerHelpers::GetNumberString( frame.mData1, display_base, settings->mBitsPerTransfer, mosi_str, 128 );
+
+	char miso_str[128] = "";
+	if( settings->mMisoChannel != UNDEFINED_CHANNEL )
+		AnalyzerHelpers::GetNumberString( frame.mData2, display_base, settings->mBitsPerTransfer, miso_str, 128 );
+
+	if( packet_id != INVALID_RESULT_INDEX )
+		ss << time_str << "," << packet_id << "," << mosi_str << "," << miso_str;
+	else
+		ss << time_str << ",," << mosi_str << "," << miso_str;  //it's ok for a frame not to be included in a packet.
+
+	if( enriched )
+	{
+		ss << ",\"";
+		if( subprocess != NULL )
+		{
+			EnrichableTextLines lines = subprocess->EmitTabular( packet_id, frame_index, frame, EnrichableRequestScheduler::Background );
+			for( size_t line = 0; line < lines.size(); line++ )
+			{
+				if( line > 0 )
+					ss << "; ";
+				for( const char* c = lines[line]; *c != '\0'; c++ )
+				{
+					if( *c == '"' )
+						ss << '"';
+					ss << *c;
+				}
+			}
+		}
+		ss << "\"";
+	}
+	ss << std::endl;
+}
+
+// Writes frames as CSV in the format of the "Export as text/csv file" menu.
+// `SPI_EXPORT_ENRICHED_CSV` adds a column with the script's tabular text for
+// every frame.
+//
+// `Results` is `AnalyzerResults` inside Logic or `HeadlessSpiResults`
+// outside of it; `subprocess` may be NULL.  Returns false if the export was
+// cancelled.
+template< class Results >
+bool WriteSpiExport(
+	Results* results,
+	EnrichableSpiAnalyzerSettings* settings,
+	EnrichableAnalyzerSubprocess* subprocess,
+	U64 trigger_sample,
+	U32 sample_rate,
+	DisplayBase display_base,
+	U32 export_type_user_id,
+	void* f
+) {
+	std::stringstream ss;
+
+	bool enriched = export_type_user_id == SPI_EXPORT_ENRICHED_CSV;
+	if( enriched && ( subprocess == NULL || !subprocess->TabularEnabled() ) )
+		subprocess = NULL;
+
+	FormatSpiExportHeader( ss, enriched );
+
+	U64 num_frames = results->GetNumFrames();
+	for( U64 i=0; i < num_frames; i++ )
+	{
+		Frame frame = results->GetFrame( i );
+
+		if( ( frame.mFlags & SPI_ERROR_FLAG ) != 0 )
+			continue;
+
+		U64 packet_id = results->GetPacketContainingFrameSequential( i );
+		FormatSpiExportRow( ss, frame, i, packet_id, settings, subprocess, trigger_sample, sample_rate, display_base, enriched );
+
+		AnalyzerHelpers::AppendToFile( (U8*)ss.str().c_str(), ss.str().length(), f );
+		ss.str( std::string() );
+
+		if( results->UpdateExportProgressAndCheckForCancel( i, num_frames ) == true )
+			return false;
+	}
+
+	results->UpdateExportProgressAndCheckForCancel( num_frames, num_frames );
+	return true;
+}
+
+#endif //SPI_EXPORT_H
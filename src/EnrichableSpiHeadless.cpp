@@ -0,0 +1,421 @@
+#include "EnrichableSpiHeadless.h"
+#include "EnrichableSpiAnalyzerSettings.h"
+#include "EnrichableAnalyzerSubprocess.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace
+{
+	// One segment's output, kept aside until it can be appended to the full
+	// results in capture order.
+	class HeadlessSegmentResults
+	{
+	public:
+		HeadlessSegmentResults()
+		:	mReachedEnd( false )
+		{
+		}
+
+		U64 AddFrame( const Frame& frame )
+		{
+			mFrames.push_back( frame );
+			return mFrames.size() - 1;
+		}
+
+		void AddMarker( U64 sample_number, AnalyzerResults::MarkerType marker_type, Channel& channel )
+		{
+			HeadlessSpiResults::Marker marker;
+			marker.mSample = sample_number;
+			marker.mType = marker_type;
+			marker.mChannel = channel;
+			mMarkers.push_back( marker );
+		}
+
+		U64 CommitPacketAndStartNewPacket()
+		{
+			mCommits.push_back( mFrames.size() );
+			return INVALID_RESULT_INDEX;
+		}
+
+		void CommitResults()
+		{
+		}
+
+		U64 GetNumPackets()
+		{
+			return mCommits.size();
+		}
+
+		std::vector<Frame> mFrames;
+		std::vector<HeadlessSpiResults::Marker> mMarkers;
+		// Number of frames at every `CommitPacketAndStartNewPacket` call.
+		std::vector<U64> mCommits;
+		// Whether decoding stopped at the segment's end rather than at the
+		// end of the capture.
+		bool mReachedEnd;
+	};
+}
+
+HeadlessSpiResults::HeadlessSpiResults()
+:	mOpenPacketFirstFrame( 0 )
+{
+}
+
+U64 HeadlessSpiResults::AddFrame( const Frame& frame )
+{
+	mFrames.push_back( frame );
+	return mFrames.size() - 1;
+}
+
+void HeadlessSpiResults::AddMarker( U64 sample_number, AnalyzerResults::MarkerType marker_type, Channel& channel )
+{
+	Marker marker;
+	marker.mSample = sample_number;
+	marker.mType = marker_type;
+	marker.mChannel = channel;
+	mMarkers.push_back( marker );
+}
+
+U64 HeadlessSpiResults::CommitPacketAndStartNewPacket()
+{
+	if( mOpenPacketFirstFrame == mFrames.size() )
+		return INVALID_RESULT_INDEX;
+
+	mPacketFirstFrames.push_back( mOpenPacketFirstFrame );
+	mOpenPacketFirstFrame = mFrames.size();
+
+	return mPacketFirstFrames.size() - 1;
+}
+
+void HeadlessSpiResults::CommitResults()
+{
+}
+
+U64 HeadlessSpiResults::GetNumFrames()
+{
+	return mFrames.size();
+}
+
+U64 HeadlessSpiResults::GetNumPackets()
+{
+	return mPacketFirstFrames.size();
+}
+
+Frame HeadlessSpiResults::GetFrame( U64 frame_id )
+{
+	return mFrames[frame_id];
+}
+
+U64 HeadlessSpiResults::GetPacketContainingFrameSequential( U64 frame_id )
+{
+	if( frame_id >= mOpenPacketFirstFrame )
+		return INVALID_RESULT_INDEX;
+
+	std::vector<U64>::iterator packet = std::upper_bound( mPacketFirstFrames.begin(), mPacketFirstFrames.end(), frame_id );
+	return ( packet - mPacketFirstFrames.begin() ) - 1;
+}
+
+bool HeadlessSpiResults::UpdateExportProgressAndCheckForCancel( U64 /*completed_frames*/, U64 /*total_frames*/ )
+{
+	return false;
+}
+
+EnrichableSpiHeadlessAnalyzer::EnrichableSpiHeadlessAnalyzer( EnrichableSpiAnalyzerSettings* settings, EnrichableSpiCapture* capture )
+:	mSettings( settings ),
+	mCapture( capture ),
+	mThreadCount( 1 ),
+	mDecoder( settings, this )
+{
+}
+
+EnrichableSpiHeadlessAnalyzer::~EnrichableSpiHeadlessAnalyzer()
+{
+}
+
+HeadlessRunSetup SetUpHeadlessRun( EnrichableSpiAnalyzerSettings* settings, EnrichableAnalyzerSubprocess* subprocess, U64 trigger_sample )
+{
+	HeadlessRunSetup setup;
+	setup.mStats = false;
+	setup.mTrace = NULL;
+	setup.mTee = NULL;
+	setup.mEnrichment = NULL;
+	if( subprocess != NULL ) {
+		subprocess->SetStatsFile( settings->mStatisticsFile );
+		setup.mStats = subprocess->StatsEnabled();
+
+		setup.mTrace = subprocess->GetTrace();
+		setup.mTrace->SetOutputFile( settings->mTraceFile );
+		setup.mTrace->NameThread( "decoder" );
+
+		setup.mTee = subprocess->GetFrameTee();
+		setup.mTee->SetOutput( settings->mFrameOutput, EnrichableFrameTee::Policy( settings->mFrameOutputPolicy ) );
+	}
+
+	// A replayed recording stands in for the script.
+	bool replay = settings->mScriptRecording.length() > 0 && settings->mScriptRecordingMode == EnrichableScriptRecording::Replay;
+	if( subprocess != NULL && ( settings->mParserCommand.length() > 0 || replay ) ) {
+		subprocess->SetParserCommand( settings->mParserCommand );
+		subprocess->SetShareScript( settings->mShareScript );
+		subprocess->SetRecording( settings->mScriptRecording, EnrichableScriptRecording::Mode( settings->mScriptRecordingMode ) );
+		subprocess->SetFrameFilter( settings->mScriptFilter );
+		U64 regionFirst;
+		U64 regionLast;
+		settings->GetScriptRegion( trigger_sample, &regionFirst, &regionLast );
+		subprocess->SetRegion( regionFirst, regionLast );
+		subprocess->Start();
+		setup.mEnrichment = subprocess;
+	}
+
+	return setup;
+}
+
+void EnrichableSpiHeadlessAnalyzer::Run( EnrichableAnalyzerSubprocess* subprocess )
+{
+	std::auto_ptr< CaptureChannelData > mosi;
+	std::auto_ptr< CaptureChannelData > miso;
+	std::auto_ptr< CaptureChannelData > enable;
+
+	if( mCapture->GetChannel( mSettings->mMosiChannel ) != NULL )
+		mosi.reset( new CaptureChannelData( mCapture->GetChannel( mSettings->mMosiChannel ) ) );
+	if( mCapture->GetChannel( mSettings->mMisoChannel ) != NULL )
+		miso.reset( new CaptureChannelData( mCapture->GetChannel( mSettings->mMisoChannel ) ) );
+	if( mCapture->GetChannel( mSettings->mEnableChannel ) != NULL )
+		enable.reset( new CaptureChannelData( mCapture->GetChannel( mSettings->mEnableChannel ) ) );
+
+	CaptureChannel* clockChannel = mCapture->GetChannel( mSettings->mClockChannel );
+	if( clockChannel == NULL )
+		return;
+	CaptureChannelData clock( clockChannel );
+
+	HeadlessRunSetup setup = SetUpHeadlessRun( mSettings, subprocess, mCapture->mTriggerSample );
+	bool stats = setup.mStats;
+	EnrichableTrace* trace = setup.mTrace;
+	EnrichableFrameTee* tee = setup.mTee;
+	EnrichableAnalyzerSubprocess* enrichment = setup.mEnrichment;
+
+	bool parallel = mThreadCount > 1
+		&& enable.get() != NULL
+		&& !stats
+		&& ( tee == NULL || !tee->Enabled() )
+		&& ( enrichment == NULL || !enrichment->MarkerEnabled() );
+	if( parallel && RunSegments( trace ) )
+	{
+		if( trace != NULL )
+			trace->Flush( true );
+		return;
+	}
+
+	mDecoder.Setup( &mResults, enrichment, trace, tee, mosi.get(), miso.get(), &clock, enable.get() );
+
+	try
+	{
+		mDecoder.AdvanceToActiveEnableEdgeWithCorrectClockPolarity();
+
+		for( ; ; )
+		{
+			TraceSpan span( trace, "GetWord" );
+			if( stats )
+			{
+				U64 start = EnrichableAnalyzerStats::Now();
+				mDecoder.GetWord();
+				subprocess->RecordDecode( EnrichableAnalyzerStats::Now() - start );
+			}
+			else
+			{
+				mDecoder.GetWord();
+			}
+			CheckIfThreadShouldExit();
+		}
+	}
+	catch( CaptureExhausted& )
+	{
+	}
+
+	mDecoder.FlushPendingMarkers();
+	mResults.CommitResults();
+	if( stats )
+		subprocess->WriteStats( true );
+	if( trace != NULL )
+		trace->Flush( true );
+}
+
+void EnrichableSpiHeadlessAnalyzer::SetThreadCount( U32 threads )
+{
+	mThreadCount = threads > 0 ? threads : 1;
+}
+
+std::vector<U64> EnrichableSpiHeadlessAnalyzer::PlanSegments( const CaptureChannel* clock, const CaptureChannel* enable, U32 count )
+{
+	// The decoder lands on every active-going enable edge and starts over
+	// there, so what it produces after one depends only on the capture.
+	// Segments start at such edges, spaced to hold similar numbers of clock
+	// edges.  The first active edge is where decoding starts anyway.
+	const std::vector<U64>& clockEdges = clock->mTransitions;
+	const std::vector<U64>& enableEdges = enable->mTransitions;
+	size_t firstActive = ( enable->mInitialState == mSettings->mEnableActiveState ) ? 1 : 0;
+
+	std::vector<U64> boundaries;
+	if( clockEdges.empty() )
+		return boundaries;
+
+	for( U32 i = 1; i < count; i++ )
+	{
+		U64 target = clockEdges[ clockEdges.size() * i / count ];
+		size_t edge = std::lower_bound( enableEdges.begin(), enableEdges.end(), target ) - enableEdges.begin();
+		if( ( edge & 1 ) != firstActive )
+			edge++;
+
+		if( edge <= firstActive || edge >= enableEdges.size() )
+			continue;
+		if( !boundaries.empty() && enableEdges[edge] <= boundaries.back() )
+			continue;
+
+		boundaries.push_back( enableEdges[edge] );
+	}
+
+	return boundaries;
+}
+
+bool EnrichableSpiHeadlessAnalyzer::RunSegments( EnrichableTrace* trace )
+{
+	CaptureChannel* mosiChannel = mCapture->GetChannel( mSettings->mMosiChannel );
+	CaptureChannel* misoChannel = mCapture->GetChannel( mSettings->mMisoChannel );
+	CaptureChannel* clockChannel = mCapture->GetChannel( mSettings->mClockChannel );
+	CaptureChannel* enableChannel = mCapture->GetChannel( mSettings->mEnableChannel );
+
+	std::vector<U64> boundaries = PlanSegments( clockChannel, enableChannel, mThreadCount * 4 );
+	if( boundaries.empty() )
+		return false;
+
+	size_t segmentCount = boundaries.size() + 1;
+	std::vector<HeadlessSegmentResults> segments( segmentCount );
+	std::atomic<size_t> nextSegment( 0 );
+	std::exception_ptr failure;
+	std::mutex failureLock;
+
+	std::vector<std::thread> threads;
+	U32 threadCount = std::min<size_t>( mThreadCount, segmentCount );
+	for( U32 t = 0; t < threadCount; t++ )
+	{
+		threads.push_back( std::thread( [&]()
+		{
+			if( trace != NULL )
+				trace->NameThread( "segment decoder" );
+
+			for( ; ; )
+			{
+				size_t i = nextSegment++;
+				if( i >= segmentCount )
+					break;
+
+				bool last = ( i + 1 == segmentCount );
+				HeadlessSegmentResults& segment = segments[i];
+
+				try
+				{
+					std::auto_ptr< CaptureChannelData > mosi;
+					std::auto_ptr< CaptureChannelData > miso;
+					if( mosiChannel != NULL )
+						mosi.reset( new CaptureChannelData( mosiChannel ) );
+					if( misoChannel != NULL )
+						miso.reset( new CaptureChannelData( misoChannel ) );
+					CaptureChannelData clock( clockChannel );
+
+					// The segment ends where the next one starts: the decoder
+					// runs out of enable edges there.
+					std::auto_ptr< CaptureChannelData > enable;
+					if( last )
+						enable.reset( new CaptureChannelData( enableChannel ) );
+					else
+						enable.reset( new CaptureChannelData( enableChannel, boundaries[i] ) );
+					if( i > 0 )
+						enable->AdvanceToAbsPosition( boundaries[i - 1] - 1 );
+
+					EnrichableSpiDecoder< CaptureChannelData, HeadlessSegmentResults, EnrichableSpiHeadlessAnalyzer > decoder( mSettings, this );
+					decoder.Setup( &segment, NULL, trace, NULL, mosi.get(), miso.get(), &clock, enable.get() );
+
+					try
+					{
+						decoder.AdvanceToActiveEnableEdgeWithCorrectClockPolarity();
+
+						for( ; ; )
+						{
+							TraceSpan span( trace, "GetWord" );
+							decoder.GetWord();
+						}
+					}
+					catch( CaptureExhausted& )
+					{
+					}
+
+					segment.mReachedEnd = !last && enable->IsExhausted();
+				}
+				catch( ... )
+				{
+					std::lock_guard<std::mutex> guard( failureLock );
+					failure = std::current_exception();
+				}
+			}
+		} ) );
+	}
+	for( std::thread& thread : threads )
+		thread.join();
+
+	if( failure )
+		std::rethrow_exception( failure );
+
+	// Stitch the segments together as a sequential run would have produced
+	// them.  Each segment's first commit is the decoder starting up; the
+	// previous segment already committed whatever it finished, and an error
+	// frame left open at its end shares a packet with what follows.
+	for( size_t i = 0; i < segmentCount; i++ )
+	{
+		HeadlessSegmentResults& segment = segments[i];
+
+		U64 appended = 0;
+		for( size_t c = 1; c < segment.mCommits.size(); c++ )
+		{
+			mResults.mFrames.insert( mResults.mFrames.end(), segment.mFrames.begin() + appended, segment.mFrames.begin() + segment.mCommits[c] );
+			mResults.CommitPacketAndStartNewPacket();
+			appended = segment.mCommits[c];
+		}
+		mResults.mFrames.insert( mResults.mFrames.end(), segment.mFrames.begin() + appended, segment.mFrames.end() );
+		mResults.mMarkers.insert( mResults.mMarkers.end(), segment.mMarkers.begin(), segment.mMarkers.end() );
+
+		// A segment that ran out of clock edges ran out of capture; a
+		// sequential run would have stopped there too.
+		if( !segment.mReachedEnd )
+			break;
+	}
+
+	mResults.CommitResults();
+	return true;
+}
+
+HeadlessSpiResults& EnrichableSpiHeadlessAnalyzer::GetResults()
+{
+	return mResults;
+}
+
+U32 EnrichableSpiHeadlessAnalyzer::GetSampleRate()
+{
+	return mCapture->mSampleRate;
+}
+
+U64 EnrichableSpiHeadlessAnalyzer::GetTriggerSample()
+{
+	return mCapture->mTriggerSample;
+}
+
+void EnrichableSpiHeadlessAnalyzer::ReportProgress( U64 /*sample_number*/ )
+{
+}
+
+void EnrichableSpiHeadlessAnalyzer::CheckIfThreadShouldExit()
+{
+}
@@ -0,0 +1,102 @@
+#ifndef SPI_HEADLESS_H
+#define SPI_HEADLESS_H
+
+#include <AnalyzerResults.h>
+#include "EnrichableSpiCapture.h"
+#include "EnrichableSpiDecoder.h"
+
+#include <vector>
+
+class EnrichableSpiAnalyzerSettings;
+class EnrichableAnalyzerSubprocess;
+
+// What a headless run decodes with, once `SetUpHeadlessRun` has applied the
+// settings to its subprocess.
+struct HeadlessRunSetup
+{
+	bool mStats;
+	EnrichableTrace* mTrace;
+	EnrichableFrameTee* mTee;
+	// The subprocess, if a script or replayed recording was started.
+	EnrichableAnalyzerSubprocess* mEnrichment;
+};
+
+// Points `subprocess`'s statistics, trace and frame output at the files in
+// `settings`, and starts the enrichment script if one is set, for a capture
+// triggered at `trigger_sample`.  `subprocess` may be NULL, which leaves
+// everything off.  Shared by `EnrichableSpiHeadlessAnalyzer` and
+// `EnrichableSpiStreamingAnalyzer`.
+HeadlessRunSetup SetUpHeadlessRun( EnrichableSpiAnalyzerSettings* settings, EnrichableAnalyzerSubprocess* subprocess, U64 trigger_sample );
+
+// Stands in for `AnalyzerResults` when decoding outside of Logic: frames,
+// markers and packet boundaries are kept in plain vectors.
+class HeadlessSpiResults
+{
+public:
+	struct Marker {
+		U64 mSample;
+		AnalyzerResults::MarkerType mType;
+		Channel mChannel;
+	};
+
+	HeadlessSpiResults();
+
+	U64 AddFrame( const Frame& frame );
+	void AddMarker( U64 sample_number, AnalyzerResults::MarkerType marker_type, Channel& channel );
+	U64 CommitPacketAndStartNewPacket();
+	void CommitResults();
+
+	U64 GetNumFrames();
+	U64 GetNumPackets();
+	Frame GetFrame( U64 frame_id );
+	U64 GetPacketContainingFrameSequential( U64 frame_id );
+	bool UpdateExportProgressAndCheckForCancel( U64 completed_frames, U64 total_frames );
+
+	std::vector<Frame> mFrames;
+	std::vector<Marker> mMarkers;
+
+protected:
+	std::vector<U64> mPacketFirstFrames;
+	U64 mOpenPacketFirstFrame;
+};
+
+// Runs the same decoding as `EnrichableSpiAnalyzer::WorkerThread` over an
+// `EnrichableSpiCapture`, without Logic.
+class EnrichableSpiHeadlessAnalyzer
+{
+public:
+	EnrichableSpiHeadlessAnalyzer( EnrichableSpiAnalyzerSettings* settings, EnrichableSpiCapture* capture );
+	virtual ~EnrichableSpiHeadlessAnalyzer();
+
+	// Decodes the whole capture.  `subprocess` may be NULL, in which case no
+	// enrichment script is started, no statistics or trace are collected
+	// and no frame output is written.
+	void Run( EnrichableAnalyzerSubprocess* subprocess );
+
+	// Lets `Run` split the capture at active-going enable edges and decode
+	// the pieces on up to `threads` threads, with the same results as a
+	// sequential run.  This needs an enable channel, and is skipped while
+	// statistics are collected, frames are streamed to a frame output or the
+	// script wants `marker` messages, since those follow decoding order.
+	// The default, 1, always decodes sequentially.
+	void SetThreadCount( U32 threads );
+
+	HeadlessSpiResults& GetResults();
+	U32 GetSampleRate();
+	U64 GetTriggerSample();
+
+	void ReportProgress( U64 sample_number );
+	void CheckIfThreadShouldExit();
+
+protected:
+	std::vector<U64> PlanSegments( const CaptureChannel* clock, const CaptureChannel* enable, U32 count );
+	bool RunSegments( EnrichableTrace* trace );
+
+	EnrichableSpiAnalyzerSettings* mSettings;
+	EnrichableSpiCapture* mCapture;
+	U32 mThreadCount;
+	HeadlessSpiResults mResults;
+	EnrichableSpiDecoder< CaptureChannelData, HeadlessSpiResults, EnrichableSpiHeadlessAnalyzer > mDecoder;
+};
+
+#endif //SPI_HEADLESS_H
@@ -0,0 +1,329 @@
+#include "EnrichableSpiMappedCapture.h"
+#include "EnrichableSpiCapture.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define LOGIC2_BINARY_IDENTIFIER "<SALEAE>"
+#define LOGIC2_BINARY_DIGITAL 0
+// Identifier, version, type, initial state, begin and end time and
+// transition count.
+#define LOGIC2_BINARY_HEADER_BYTES 44
+
+MappedCaptureChannel::MappedCaptureChannel()
+:	mInitialState( BIT_LOW ),
+	mBeginTime( 0 ),
+	mTransitionCount( 0 ),
+	mData( NULL ),
+	mSize( 0 )
+{
+}
+
+MappedCaptureChannel::~MappedCaptureChannel()
+{
+	if( mData != NULL )
+		munmap( (void*)mData, mSize );
+}
+
+bool MappedCaptureChannel::Open( const std::string& path, std::string* error )
+{
+	int fd = open( path.c_str(), O_RDONLY | O_CLOEXEC );
+	if( fd < 0 )
+	{
+		*error = "Unable to open " + path;
+		return false;
+	}
+
+	struct stat info;
+	if( fstat( fd, &info ) != 0 || info.st_size < LOGIC2_BINARY_HEADER_BYTES )
+	{
+		close( fd );
+		*error = path + " is not a Logic 2 digital binary export";
+		return false;
+	}
+
+	void* data = mmap( NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+	close( fd );
+	if( data == MAP_FAILED )
+	{
+		*error = "Unable to map " + path;
+		return false;
+	}
+	mData = (const char*)data;
+	mSize = info.st_size;
+	madvise( data, mSize, MADV_SEQUENTIAL );
+
+	S32 version;
+	S32 type;
+	U32 initialState;
+	memcpy( &version, mData + 8, sizeof( version ) );
+	memcpy( &type, mData + 12, sizeof( type ) );
+	memcpy( &initialState, mData + 16, sizeof( initialState ) );
+	memcpy( &mBeginTime, mData + 20, sizeof( mBeginTime ) );
+	memcpy( &mTransitionCount, mData + 36, sizeof( mTransitionCount ) );
+
+	if( memcmp( mData, LOGIC2_BINARY_IDENTIFIER, 8 ) != 0
+		|| ( version != 0 && version != 1 )
+		|| type != LOGIC2_BINARY_DIGITAL
+		|| mTransitionCount > ( mSize - LOGIC2_BINARY_HEADER_BYTES ) / sizeof( double ) )
+	{
+		*error = path + " is not a Logic 2 digital binary export";
+		return false;
+	}
+	mInitialState = initialState ? BIT_HIGH : BIT_LOW;
+	return true;
+}
+
+double MappedCaptureChannel::GetTime( U64 index ) const
+{
+	// Transition times follow the 44-byte header, so they aren't aligned.
+	double time;
+	memcpy( &time, mData + LOGIC2_BINARY_HEADER_BYTES + index * sizeof( double ), sizeof( time ) );
+	return time;
+}
+
+void MappedCaptureChannel::Advise( U64 index, U64* advised ) const
+{
+	size_t offset = LOGIC2_BINARY_HEADER_BYTES + index * sizeof( double );
+	if( offset < *advised || offset >= mSize )
+		return;
+
+	size_t page = sysconf( _SC_PAGESIZE );
+	size_t start = offset / page * page;
+	size_t ahead = std::min( size_t( MAPPED_READ_AHEAD_BYTES ), mSize - start );
+
+	// Pages behind the decoder are dropped rather than left for memory
+	// pressure to evict, so resident memory stays flat.
+	if( start > 0 )
+		madvise( (void*)mData, start, MADV_DONTNEED );
+	madvise( (void*)( mData + start ), ahead, MADV_WILLNEED );
+	*advised = start + ahead / 2;
+}
+
+EnrichableSpiMappedCapture::EnrichableSpiMappedCapture()
+:	mSampleRate( 0 ),
+	mTriggerSample( 0 ),
+	mStartTime( 0 )
+{
+}
+
+bool EnrichableSpiMappedCapture::Open( const std::string& directory, U32 sampleRate, std::string* error )
+{
+	DIR* dir = opendir( directory.c_str() );
+	if( dir == NULL )
+	{
+		*error = "Unable to open directory " + directory;
+		return false;
+	}
+
+	mChannels.clear();
+	bool found = false;
+	bool ok = true;
+	struct dirent* entry;
+	while( ok && ( entry = readdir( dir ) ) != NULL )
+	{
+		unsigned index;
+		char suffix[8];
+		if( sscanf( entry->d_name, "digital_%u.%7s", &index, suffix ) != 2 || strcmp( suffix, "bin" ) != 0 )
+			continue;
+
+		std::shared_ptr< MappedCaptureChannel > channel( new MappedCaptureChannel() );
+		ok = channel->Open( directory + "/" + entry->d_name, error );
+		if( !ok )
+			break;
+
+		if( !found || channel->mBeginTime < mStartTime )
+			mStartTime = channel->mBeginTime;
+		found = true;
+
+		if( index >= mChannels.size() )
+			mChannels.resize( index + 1 );
+		mChannels[index] = channel;
+	}
+	closedir( dir );
+
+	if( ok && !found )
+	{
+		*error = "No digital_N.bin files found in " + directory;
+		ok = false;
+	}
+	if( !ok )
+	{
+		mChannels.clear();
+		return false;
+	}
+
+	mSampleRate = sampleRate;
+	mTriggerSample = GetSampleFromTime( 0.0 );
+	return true;
+}
+
+const MappedCaptureChannel* EnrichableSpiMappedCapture::GetChannel( const Channel& channel ) const
+{
+	if( channel == UNDEFINED_CHANNEL || channel.mChannelIndex >= mChannels.size() )
+		return NULL;
+
+	return mChannels[channel.mChannelIndex].get();
+}
+
+U64 EnrichableSpiMappedCapture::GetSampleFromTime( double time ) const
+{
+	double sample = std::floor( ( time - mStartTime ) * mSampleRate + 0.5 );
+	return sample < 0 ? 0 : U64( sample );
+}
+
+MappedChannelData::MappedChannelData( const MappedCaptureChannel* channel, const EnrichableSpiMappedCapture* capture )
+:	mChannel( channel ),
+	mCapture( capture ),
+	mRawNext( 0 ),
+	mHeld( 0 ),
+	mHolding( false ),
+	mAdvised( 0 ),
+	mWindow( MAPPED_WINDOW_TRANSITIONS ),
+	mWindowBase( 0 ),
+	mWindowCount( 0 ),
+	mInitialState( channel->mInitialState ),
+	mNextTransition( 0 ),
+	mCurrentSample( 0 ),
+	mExhausted( false )
+{
+}
+
+bool MappedChannelData::LoadNext()
+{
+	if( mNextTransition < mWindowBase + mWindowCount )
+		return true;
+
+	// Transitions are only ever consumed in order, so the whole window is
+	// behind the decoder by now.
+	mWindowBase += mWindowCount;
+	mWindowCount = 0;
+
+	// The last transition converted is held back for the next window, in
+	// case the one after it cancels it out.
+	if( mHolding )
+		mWindow[mWindowCount++] = mHeld;
+	mHolding = false;
+
+	while( mWindowCount < mWindow.size() && mRawNext < mChannel->mTransitionCount )
+	{
+		// Both edges of a pulse shorter than one sample land on the same
+		// sample once rounded; neither is kept.
+		U64 sample = mCapture->GetSampleFromTime( mChannel->GetTime( mRawNext++ ) );
+		if( mWindowCount > 0 && mWindow[mWindowCount - 1] >= sample )
+			mWindowCount--;
+		else
+			mWindow[mWindowCount++] = sample;
+	}
+	if( mRawNext < mChannel->mTransitionCount && mWindowCount > 0 )
+	{
+		mHeld = mWindow[--mWindowCount];
+		mHolding = true;
+	}
+	mChannel->Advise( mRawNext, &mAdvised );
+
+	return mWindowCount > 0;
+}
+
+U64 MappedChannelData::Next() const
+{
+	return mWindow[mNextTransition - mWindowBase];
+}
+
+U64 MappedChannelData::GetSampleNumber()
+{
+	return mCurrentSample;
+}
+
+BitState MappedChannelData::GetBitState()
+{
+	if( ( mNextTransition & 1 ) == 0 )
+		return mInitialState;
+
+	return Invert( mInitialState );
+}
+
+U32 MappedChannelData::Advance( U32 num_samples )
+{
+	return AdvanceToAbsPosition( mCurrentSample + num_samples );
+}
+
+U32 MappedChannelData::AdvanceToAbsPosition( U64 sample_number )
+{
+	U64 start = mNextTransition;
+
+	while( LoadNext() )
+	{
+		const U64* first = &mWindow[mNextTransition - mWindowBase];
+		const U64* last = &mWindow[mWindowCount];
+		if( last[-1] <= sample_number )
+		{
+			mNextTransition = mWindowBase + mWindowCount;
+			continue;
+		}
+
+		// As in `CaptureChannelData`: a short scan for the usual small
+		// steps, a binary search for long jumps.
+		const U64* next = first;
+		for( U32 i = 0; i < 8 && next != last && *next <= sample_number; i++ )
+			next++;
+		if( next != last && *next <= sample_number )
+			next = std::upper_bound( next, last, sample_number );
+		mNextTransition += next - first;
+		break;
+	}
+	mCurrentSample = sample_number;
+
+	return U32( mNextTransition - start );
+}
+
+void MappedChannelData::AdvanceToNextEdge()
+{
+	if( !LoadNext() )
+	{
+		mExhausted = true;
+		throw CaptureExhausted();
+	}
+
+	mCurrentSample = Next();
+	mNextTransition++;
+}
+
+U64 MappedChannelData::GetSampleOfNextEdge()
+{
+	if( !LoadNext() )
+	{
+		mExhausted = true;
+		throw CaptureExhausted();
+	}
+
+	return Next();
+}
+
+bool MappedChannelData::WouldAdvancingCauseTransition( U32 num_samples )
+{
+	return WouldAdvancingToAbsPositionCauseTransition( mCurrentSample + num_samples );
+}
+
+bool MappedChannelData::WouldAdvancingToAbsPositionCauseTransition( U64 sample_number )
+{
+	return LoadNext() && Next() <= sample_number;
+}
+
+bool MappedChannelData::DoMoreTransitionsExistInCurrentData()
+{
+	return LoadNext();
+}
+
+bool MappedChannelData::IsExhausted()
+{
+	return mExhausted;
+}
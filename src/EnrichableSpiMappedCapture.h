@@ -0,0 +1,117 @@
+#ifndef SPI_MAPPED_CAPTURE_H
+#define SPI_MAPPED_CAPTURE_H
+
+#include <LogicPublicTypes.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// Transitions converted to sample numbers at a time, per channel.
+#define MAPPED_WINDOW_TRANSITIONS 16384
+// How far ahead of the decoder the file is read, and how much of it is
+// let go of at once behind it.
+#define MAPPED_READ_AHEAD_BYTES ( 8 << 20 )
+
+// One `digital_N.bin` of a Logic 2 binary export, mapped into memory rather
+// than read.  The operating system pages the transition times in as they
+// are walked, so captures larger than memory can be decoded.
+class MappedCaptureChannel
+{
+public:
+	MappedCaptureChannel();
+	~MappedCaptureChannel();
+
+	// On failure returns false and describes the problem in `error`.
+	bool Open( const std::string& path, std::string* error );
+
+	// The time of transition `index`, in seconds.
+	double GetTime( U64 index ) const;
+	// Tells the operating system that transitions before `index` won't be
+	// needed again and that the following ones soon will.
+	void Advise( U64 index, U64* advised ) const;
+
+	BitState mInitialState;
+	double mBeginTime;
+	U64 mTransitionCount;
+
+protected:
+	MappedCaptureChannel( const MappedCaptureChannel& );
+	MappedCaptureChannel& operator=( const MappedCaptureChannel& );
+
+	const char* mData;
+	size_t mSize;
+};
+
+// A Logic 2 binary export directory, mapped channel by channel.  Sample
+// numbers are counted from the earliest channel's start, as
+// `LoadLogicBinaryExport` counts them.
+class EnrichableSpiMappedCapture
+{
+public:
+	EnrichableSpiMappedCapture();
+
+	// On failure returns false and describes the problem in `error`.
+	bool Open( const std::string& directory, U32 sampleRate, std::string* error );
+
+	const MappedCaptureChannel* GetChannel( const Channel& channel ) const;
+	U64 GetSampleFromTime( double time ) const;
+
+	U32 mSampleRate;
+	U64 mTriggerSample;
+	double mStartTime;
+
+protected:
+	std::vector< std::shared_ptr< MappedCaptureChannel > > mChannels;
+};
+
+// Walks a `MappedCaptureChannel` through the same interface as
+// `CaptureChannelData`.  Transition times are converted to sample numbers a
+// window at a time, dropping pulses shorter than a sample as
+// `LoadLogicBinaryExport` does, so memory use doesn't grow with the capture.
+class MappedChannelData
+{
+public:
+	MappedChannelData( const MappedCaptureChannel* channel, const EnrichableSpiMappedCapture* capture );
+
+	U64 GetSampleNumber();
+	BitState GetBitState();
+	U32 Advance( U32 num_samples );
+	U32 AdvanceToAbsPosition( U64 sample_number );
+	void AdvanceToNextEdge();
+	U64 GetSampleOfNextEdge();
+	bool WouldAdvancingCauseTransition( U32 num_samples );
+	bool WouldAdvancingToAbsPositionCauseTransition( U64 sample_number );
+	bool DoMoreTransitionsExistInCurrentData();
+
+	bool IsExhausted();
+
+protected:
+	// Whether transition `mNextTransition` exists; converts the next
+	// window if it isn't in the current one.
+	bool LoadNext();
+	U64 Next() const;
+
+	const MappedCaptureChannel* mChannel;
+	const EnrichableSpiMappedCapture* mCapture;
+
+	// Raw transitions read, and the last one converted, held back in case
+	// the next one lands on the same sample.
+	U64 mRawNext;
+	U64 mHeld;
+	bool mHolding;
+	U64 mAdvised;
+
+	std::vector<U64> mWindow;
+	// The index of `mWindow[0]` among the converted transitions, and how
+	// many the window holds.
+	U64 mWindowBase;
+	size_t mWindowCount;
+
+	BitState mInitialState;
+	U64 mNextTransition;
+	U64 mCurrentSample;
+	bool mExhausted;
+};
+
+#endif //SPI_MAPPED_CAPTURE_H
@@ -0,0 +1,285 @@
+#include "EnrichableSpiPackedSamples.h"
+
+#include <string.h>
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <immintrin.h>
+#define PACKED_SAMPLES_X86
+#endif
+#if defined( __ARM_NEON ) && defined( __aarch64__ )
+#include <arm_neon.h>
+#define PACKED_SAMPLES_NEON
+#endif
+
+// Samples scanned per kernel call; bounds the size of the change list.
+#define PACKED_SAMPLES_BLOCK 4096
+
+namespace
+{
+	// Finds the samples in `samples[0, count)` that differ from the one
+	// before them on a channel in `mask`; `samples - width` must be readable.
+	// Writes their indexes to `changes` and returns how many there were.
+	typedef U32 ( *FindChangesFunction )( const U8* samples, U32 count, U32 width, const U8* pattern, U64 mask, U32* changes );
+
+	U64 LoadPackedSample( const U8* sample, U32 width )
+	{
+		U64 value = 0;
+		memcpy( &value, sample, width );
+		return value;
+	}
+
+	// `bits` holds `stride` bits for each byte of the samples starting at
+	// `first`; records every sample with a set bit once.
+	inline U32 AddChangedSamples( U64 bits, U32 stride, U32 width, U32 first, U32* changes, U32 n )
+	{
+		while( bits )
+		{
+			U32 sample = U32( __builtin_ctzll( bits ) ) / stride / width;
+			changes[n++] = first + sample;
+
+			U32 end = ( sample + 1 ) * width * stride;
+			bits = end < 64 ? bits & ~( ( 1ull << end ) - 1 ) : 0;
+		}
+		return n;
+	}
+
+	U32 FindChangesScalarFrom( const U8* samples, U32 start, U32 count, U32 width, U64 mask, U32* changes, U32 n )
+	{
+		U64 previous = LoadPackedSample( samples + ( S64( start ) - 1 ) * width, width );
+		for( U32 i = start; i < count; i++ )
+		{
+			U64 sample = LoadPackedSample( samples + U64( i ) * width, width );
+			if( ( sample ^ previous ) & mask )
+				changes[n++] = i;
+			previous = sample;
+		}
+		return n;
+	}
+
+	U32 FindChangesScalar( const U8* samples, U32 count, U32 width, const U8*, U64 mask, U32* changes )
+	{
+		return FindChangesScalarFrom( samples, 0, count, width, mask, changes, 0 );
+	}
+
+#ifdef PACKED_SAMPLES_X86
+	__attribute__(( target( "sse2" ) ))
+	U32 FindChangesSse2( const U8* samples, U32 count, U32 width, const U8* pattern, U64 mask, U32* changes )
+	{
+		const U32 perVector = 16 / width;
+		const __m128i selected = _mm_loadu_si128( ( const __m128i* )pattern );
+		const __m128i zero = _mm_setzero_si128();
+
+		U32 n = 0;
+		U32 i = 0;
+		for( ; i + perVector <= count; i += perVector )
+		{
+			const U8* p = samples + U64( i ) * width;
+			__m128i current = _mm_loadu_si128( ( const __m128i* )p );
+			__m128i previous = _mm_loadu_si128( ( const __m128i* )( p - width ) );
+			__m128i changed = _mm_and_si128( _mm_xor_si128( current, previous ), selected );
+
+			U64 bits = ~U32( _mm_movemask_epi8( _mm_cmpeq_epi8( changed, zero ) ) ) & 0xFFFF;
+			n = AddChangedSamples( bits, 1, width, i, changes, n );
+		}
+
+		return FindChangesScalarFrom( samples, i, count, width, mask, changes, n );
+	}
+
+	__attribute__(( target( "avx2" ) ))
+	U32 FindChangesAvx2( const U8* samples, U32 count, U32 width, const U8* pattern, U64 mask, U32* changes )
+	{
+		const U32 perVector = 32 / width;
+		const __m256i selected = _mm256_loadu_si256( ( const __m256i* )pattern );
+		const __m256i zero = _mm256_setzero_si256();
+
+		U32 n = 0;
+		U32 i = 0;
+		for( ; i + perVector <= count; i += perVector )
+		{
+			const U8* p = samples + U64( i ) * width;
+			__m256i current = _mm256_loadu_si256( ( const __m256i* )p );
+			__m256i previous = _mm256_loadu_si256( ( const __m256i* )( p - width ) );
+			__m256i changed = _mm256_and_si256( _mm256_xor_si256( current, previous ), selected );
+
+			U64 bits = ~U32( _mm256_movemask_epi8( _mm256_cmpeq_epi8( changed, zero ) ) );
+			n = AddChangedSamples( bits, 1, width, i, changes, n );
+		}
+
+		return FindChangesScalarFrom( samples, i, count, width, mask, changes, n );
+	}
+#endif
+
+#ifdef PACKED_SAMPLES_NEON
+	U32 FindChangesNeon( const U8* samples, U32 count, U32 width, const U8* pattern, U64 mask, U32* changes )
+	{
+		const U32 perVector = 16 / width;
+		const uint8x16_t selected = vld1q_u8( pattern );
+
+		U32 n = 0;
+		U32 i = 0;
+		for( ; i + perVector <= count; i += perVector )
+		{
+			const U8* p = samples + U64( i ) * width;
+			uint8x16_t changed = vandq_u8( veorq_u8( vld1q_u8( p ), vld1q_u8( p - width ) ), selected );
+
+			// NEON has no movemask; narrowing the 0x00/0xFF bytes leaves
+			// four bits per byte instead.
+			uint8x16_t nonzero = vtstq_u8( changed, changed );
+			U64 bits = vget_lane_u64( vreinterpret_u64_u8( vshrn_n_u16( vreinterpretq_u16_u8( nonzero ), 4 ) ), 0 );
+			n = AddChangedSamples( bits, 4, width, i, changes, n );
+		}
+
+		return FindChangesScalarFrom( samples, i, count, width, mask, changes, n );
+	}
+#endif
+
+	FindChangesFunction GetFindChangesFunction( PackedSampleKernel kernel )
+	{
+		switch( kernel )
+		{
+#ifdef PACKED_SAMPLES_X86
+		case PackedSampleSse2:
+			return FindChangesSse2;
+		case PackedSampleAvx2:
+			return FindChangesAvx2;
+#endif
+#ifdef PACKED_SAMPLES_NEON
+		case PackedSampleNeon:
+			return FindChangesNeon;
+#endif
+		default:
+			return FindChangesScalar;
+		}
+	}
+}
+
+bool IsPackedSampleKernelSupported( PackedSampleKernel kernel )
+{
+	switch( kernel )
+	{
+	case PackedSampleScalar:
+		return true;
+#ifdef PACKED_SAMPLES_X86
+	case PackedSampleSse2:
+		return __builtin_cpu_supports( "sse2" );
+	case PackedSampleAvx2:
+		return __builtin_cpu_supports( "avx2" );
+#endif
+#ifdef PACKED_SAMPLES_NEON
+	// Advanced SIMD is part of every AArch64 CPU.
+	case PackedSampleNeon:
+		return true;
+#endif
+	default:
+		return false;
+	}
+}
+
+PackedSampleKernel GetBestPackedSampleKernel()
+{
+	const PackedSampleKernel preferred[] = { PackedSampleAvx2, PackedSampleNeon, PackedSampleSse2 };
+	for( PackedSampleKernel kernel : preferred )
+	{
+		if( IsPackedSampleKernelSupported( kernel ) )
+			return kernel;
+	}
+	return PackedSampleScalar;
+}
+
+const char* GetPackedSampleKernelName( PackedSampleKernel kernel )
+{
+	switch( kernel )
+	{
+	case PackedSampleSse2:
+		return "sse2";
+	case PackedSampleAvx2:
+		return "avx2";
+	case PackedSampleNeon:
+		return "neon";
+	default:
+		return "scalar";
+	}
+}
+
+PackedSampleReader::PackedSampleReader( EnrichableSpiCapture* capture, U32 bytesPerSample, U64 channelMask, PackedSampleKernel kernel )
+:	mBytesPerSample( bytesPerSample ),
+	mChannelMask( channelMask ),
+	mKernel( IsPackedSampleKernelSupported( kernel ) ? kernel : PackedSampleScalar ),
+	mSampleCount( 0 ),
+	mPreviousSample( 0 ),
+	mChanges( PACKED_SAMPLES_BLOCK )
+{
+	if( mBytesPerSample < 8 )
+		mChannelMask &= ( 1ull << ( mBytesPerSample * 8 ) ) - 1;
+
+	for( U32 i = 0; i < sizeof( mMaskPattern ); i++ )
+		mMaskPattern[i] = U8( mChannelMask >> ( ( i % mBytesPerSample ) * 8 ) );
+
+	// Add the highest channel first so later additions don't move the others.
+	for( int bit = 63; bit >= 0; bit-- )
+	{
+		if( ( mChannelMask >> bit ) & 1 )
+			capture->AddChannel( bit );
+	}
+	for( U32 bit = 0; bit < 64; bit++ )
+		mChannels[bit] = ( ( mChannelMask >> bit ) & 1 ) ? capture->GetChannel( Channel( 0, bit ) ) : NULL;
+}
+
+void PackedSampleReader::AddSamples( const U8* samples, U64 count )
+{
+	if( count == 0 )
+		return;
+
+	// The first sample is compared against the end of the previous call.
+	U64 first = LoadSample( samples );
+	if( mSampleCount == 0 )
+	{
+		for( U32 bit = 0; bit < 64; bit++ )
+		{
+			if( mChannels[bit] != NULL )
+				mChannels[bit]->mInitialState = ( ( first >> bit ) & 1 ) ? BIT_HIGH : BIT_LOW;
+		}
+	}
+	else
+	{
+		AddTransitions( mSampleCount, ( first ^ mPreviousSample ) & mChannelMask );
+	}
+
+	FindChangesFunction findChanges = GetFindChangesFunction( mKernel );
+	for( U64 start = 1; start < count; start += PACKED_SAMPLES_BLOCK )
+	{
+		U32 blockCount = U32( count - start < PACKED_SAMPLES_BLOCK ? count - start : PACKED_SAMPLES_BLOCK );
+		const U8* block = samples + start * mBytesPerSample;
+
+		U32 changeCount = findChanges( block, blockCount, mBytesPerSample, mMaskPattern, mChannelMask, &mChanges[0] );
+		for( U32 i = 0; i < changeCount; i++ )
+		{
+			const U8* sample = block + U64( mChanges[i] ) * mBytesPerSample;
+			U64 changed = LoadSample( sample ) ^ LoadSample( sample - mBytesPerSample );
+			AddTransitions( mSampleCount + start + mChanges[i], changed & mChannelMask );
+		}
+	}
+
+	mPreviousSample = LoadSample( samples + ( count - 1 ) * mBytesPerSample );
+	mSampleCount += count;
+}
+
+U64 PackedSampleReader::GetSampleCount()
+{
+	return mSampleCount;
+}
+
+U64 PackedSampleReader::LoadSample( const U8* sample )
+{
+	return LoadPackedSample( sample, mBytesPerSample );
+}
+
+void PackedSampleReader::AddTransitions( U64 sample_number, U64 changed )
+{
+	while( changed )
+	{
+		U32 bit = __builtin_ctzll( changed );
+		mChannels[bit]->AddTransition( sample_number );
+		changed &= changed - 1;
+	}
+}
@@ -0,0 +1,55 @@
+#ifndef SPI_PACKED_SAMPLES_H
+#define SPI_PACKED_SAMPLES_H
+
+#include "EnrichableSpiCapture.h"
+
+#include <vector>
+
+// Implementations of the change-finding kernel; `GetBestPackedSampleKernel`
+// picks the fastest one the running CPU supports.
+enum PackedSampleKernel
+{
+	PackedSampleScalar,
+	PackedSampleSse2,
+	PackedSampleAvx2,
+	PackedSampleNeon
+};
+
+PackedSampleKernel GetBestPackedSampleKernel();
+bool IsPackedSampleKernelSupported( PackedSampleKernel kernel );
+const char* GetPackedSampleKernelName( PackedSampleKernel kernel );
+
+// Converts packed logic samples -- every sample is 1, 2, 4 or 8 little-endian
+// bytes with bit N holding channel N -- into the transitions of a capture.
+//
+// Samples are compared a SIMD register at a time and only the few that differ
+// from their predecessor on a selected channel are looked at individually,
+// so long runs of idle or oversampled data cost a compare per 16 or 32 bytes.
+class PackedSampleReader
+{
+public:
+	// `bytesPerSample` is 1, 2, 4 or 8.  Only channels in `channelMask` are
+	// added to `capture`, which must not gain other channels while reading.
+	PackedSampleReader( EnrichableSpiCapture* capture, U32 bytesPerSample, U64 channelMask, PackedSampleKernel kernel = GetBestPackedSampleKernel() );
+
+	// Appends `count` samples, continuing from those added before.
+	void AddSamples( const U8* samples, U64 count );
+	U64 GetSampleCount();
+
+protected:
+	U64 LoadSample( const U8* sample );
+	void AddTransitions( U64 sample_number, U64 changed );
+
+	U32 mBytesPerSample;
+	U64 mChannelMask;
+	PackedSampleKernel mKernel;
+	U64 mSampleCount;
+	U64 mPreviousSample;
+
+	// Indexed by bit; NULL for channels outside of the mask.
+	CaptureChannel* mChannels[64];
+	U8 mMaskPattern[32];
+	std::vector<U32> mChanges;
+};
+
+#endif //SPI_PACKED_SAMPLES_H
@@ -14,7 +14,18 @@ void EnrichableSpiSimulationDataGenerator::Initialize( U32 simulation_sample_rat
 	mSimulationSampleRateHz = simulation_sample_rate;
 	mSettings = settings;
 
-	mClockGenerator.Init( simulation_sample_rate / 10, simulation_sample_rate );
+	//each bit takes half a period of the clock generator, so SCK runs at twice the generator's rate: one fifth of the sample rate unless a clock is configured.
+	//a configured clock is limited to a quarter of the sample rate, so every half-bit is at least two samples.
+	U32 clock_hz = 2 * ( simulation_sample_rate / 10 );
+	if( settings->mSimulationClockHz != 0 )
+	{
+		clock_hz = settings->mSimulationClockHz;
+		if( clock_hz > simulation_sample_rate / 4 )
+			clock_hz = simulation_sample_rate / 4;
+	}
+
+	mClockGenerator.Init( clock_hz / 2.0, simulation_sample_rate );
+	mFixedSchedule = false;
 
 	if( settings->mMisoChannel != UNDEFINED_CHANNEL )
 		mMiso = mEnrichableSpiSimulationChannels.Add( settings->mMisoChannel, mSimulationSampleRateHz, BIT_LOW );
@@ -36,6 +47,25 @@ void EnrichableSpiSimulationDataGenerator::Initialize( U32 simulation_sample_rat
 	mEnrichableSpiSimulationChannels.AdvanceAll( mClockGenerator.AdvanceByHalfPeriod( 10.0 ) ); //insert 10 bit-periods of idle
 
 	mValue = 0;
+
+	if( mSettings->mBitsPerTransfer >= 64 )
+		mWordMask = ~U64( 0 );
+	else
+		mWordMask = ( U64( 1 ) << mSettings->mBitsPerTransfer ) - 1;
+
+	mRandom.seed( mSettings->mSimulationSeed );
+	for( U32 i=0; i<128; i++ )
+		mRegisters[i] = U8( mRandom() );
+
+	BuildToggleTable();
+
+	if( simulation_sample_rate % ( U64( 2 ) * clock_hz ) == 0 )
+	{
+		U64 quarter = simulation_sample_rate / ( U64( 2 ) * clock_hz );
+		for( U32 k=0; k<=2 * mSettings->mBitsPerTransfer; k++ )
+			mEdgeOffsets[ k ] = k * quarter;
+		mFixedSchedule = true;
+	}
 }
 
 U32 EnrichableSpiSimulationDataGenerator::GenerateSimulationData( U64 largest_sample_requested, U32 sample_rate, SimulationChannelDescriptor** simulation_channels )
@@ -46,7 +76,7 @@ U32 EnrichableSpiSimulationDataGenerator::GenerateSimulationData( U64 largest_sa
 	{
 		CreateSpiTransaction();
 
-		mEnrichableSpiSimulationChannels.AdvanceAll( mClockGenerator.AdvanceByHalfPeriod( 10.0 ) ); //insert 10 bit-periods of idle
+		mEnrichableSpiSimulationChannels.AdvanceAll( mClockGenerator.AdvanceByHalfPeriod( GetIdleHalfPeriods() ) );
 	}
 
 	*simulation_channels = mEnrichableSpiSimulationChannels.GetArray();
@@ -54,101 +84,274 @@ U32 EnrichableSpiSimulationDataGenerator::GenerateSimulationData( U64 largest_sa
 }
 
 void EnrichableSpiSimulationDataGenerator::CreateSpiTransaction()
+{
+	switch( mSettings->mSimulationProfile )
+	{
+	case SimulationBursts:
+		CreateBurstTransaction();
+		break;
+	case SimulationRegisterAccess:
+		CreateRegisterTransaction();
+		break;
+	case SimulationLongTransactions:
+		CreateLongTransaction();
+		break;
+	case SimulationRandomGaps:
+		CreateRandomGapTransaction();
+		break;
+	case SimulationClockErrors:
+		CreateClockErrorTransaction();
+		break;
+	default:
+		CreateCountingTransaction();
+		break;
+	}
+}
+
+double EnrichableSpiSimulationDataGenerator::GetIdleHalfPeriods()
+{
+	if( mSettings->mSimulationProfile == SimulationRandomGaps )
+		return RandomBetween( 2, 400 );
+
+	return 10.0; //insert 10 bit-periods of idle
+}
+
+void EnrichableSpiSimulationDataGenerator::CreateCountingTransaction()
 {
 	if( mEnable != NULL )
 		mEnable->Transition();
 
 	mEnrichableSpiSimulationChannels.AdvanceAll( mClockGenerator.AdvanceByHalfPeriod( 2.0 ) );
 	
-	if( mSettings->mDataValidEdge == AnalyzerEnums::LeadingEdge )
-	{
-		OutputWord_CPHA0( mValue, mValue+1 );
-		mValue++;
+	OutputWord( mValue, mValue+1 );
+	mValue++;
 
-		OutputWord_CPHA0( mValue, mValue+1 );
-		mValue++;
+	OutputWord( mValue, mValue+1 );
+	mValue++;
 
-		OutputWord_CPHA0( mValue, mValue+1 );
-		mValue++;
+	OutputWord( mValue, mValue+1 );
+	mValue++;
 
-		if( mEnable != NULL )
-			mEnable->Transition();
-	
-		OutputWord_CPHA0( mValue, mValue+1 );
-		mValue++;
-	}else
-	{
-		OutputWord_CPHA1( mValue, mValue+1 );
-		mValue++;
+	if( mEnable != NULL )
+		mEnable->Transition();
+
+	OutputWord( mValue, mValue+1 );
+	mValue++;
+}
 
-		OutputWord_CPHA1( mValue, mValue+1 );
-		mValue++;
+void EnrichableSpiSimulationDataGenerator::CreateBurstTransaction()
+{
+	SetEnable( true );
+	mEnrichableSpiSimulationChannels.AdvanceAll( mClockGenerator.AdvanceByHalfPeriod( .5 ) );
 
-		OutputWord_CPHA1( mValue, mValue+1 );
-		mValue++;
+	//words follow each other without returning the data lines low or waiting between them.
+	U32 count = 64;
+	for( U32 i=0; i<count; i++ )
+		OutputWord( RandomWord(), RandomWord(), i + 1 == count ? 2.0 : 0.0 );
 
-		if( mEnable != NULL )
-			mEnable->Transition();
-	
-		OutputWord_CPHA1( mValue, mValue+1 );
-		mValue++;
+	SetEnable( false );
+}
+
+void EnrichableSpiSimulationDataGenerator::CreateRegisterTransaction()
+{
+	bool read = RandomBetween( 0, 1 ) == 1;
+	U32 address = RandomBetween( 0, 127 );
+	U32 count = RandomBetween( 1, 4 );
+
+	SetEnable( true );
+	mEnrichableSpiSimulationChannels.AdvanceAll( mClockGenerator.AdvanceByHalfPeriod( 2.0 ) );
+
+	OutputWord( ( ( read ? 0x80 : 0x00 ) | address ) & mWordMask, 0 );
+	for( U32 i=0; i<count; i++ )
+	{
+		U8& value = mRegisters[ ( address + i ) & 0x7F ];
+		if( read )
+		{
+			OutputWord( 0, value & mWordMask );
+		}else
+		{
+			value = U8( RandomWord() );
+			OutputWord( value & mWordMask, 0 );
+		}
 	}
+
+	SetEnable( false );
 }
 
-void EnrichableSpiSimulationDataGenerator::OutputWord_CPHA0( U64 mosi_data, U64 miso_data )
+void EnrichableSpiSimulationDataGenerator::CreateLongTransaction()
 {
-	BitExtractor mosi_bits( mosi_data, mSettings->mShiftOrder, mSettings->mBitsPerTransfer );
-	BitExtractor miso_bits( miso_data, mSettings->mShiftOrder, mSettings->mBitsPerTransfer );
+	SetEnable( true );
+	mEnrichableSpiSimulationChannels.AdvanceAll( mClockGenerator.AdvanceByHalfPeriod( 2.0 ) );
 
-	U32 count = mSettings->mBitsPerTransfer;
+	U32 count = RandomBetween( 256, 4096 );
+	for( U32 i=0; i<count; i++ )
+		OutputWord( RandomWord(), RandomWord() );
+
+	SetEnable( false );
+}
+
+void EnrichableSpiSimulationDataGenerator::CreateRandomGapTransaction()
+{
+	SetEnable( true );
+	mEnrichableSpiSimulationChannels.AdvanceAll( mClockGenerator.AdvanceByHalfPeriod( RandomBetween( 1, 8 ) ) );
+
+	//the last word always leaves some idle time, so enable never toggles on a clock edge.
+	U32 count = RandomBetween( 1, 8 );
 	for( U32 i=0; i<count; i++ )
+		OutputWord( RandomWord(), RandomWord(), i + 1 == count ? 2.0 : RandomBetween( 0, 16 ) );
+
+	SetEnable( false );
+}
+
+void EnrichableSpiSimulationDataGenerator::CreateClockErrorTransaction()
+{
+	//the decoder reports a transaction that starts with the clock in the wrong state as an error frame; that needs an enable line.
+	bool error = mEnable != NULL && RandomBetween( 0, 7 ) == 0;
+
+	if( error )
 	{
-		if( mMosi != NULL )
-			mMosi->TransitionIfNeeded( mosi_bits.GetNextBit() );
+		mClock->Transition();
+		mEnrichableSpiSimulationChannels.AdvanceAll( mClockGenerator.AdvanceByHalfPeriod( 2.0 ) );
+	}
 
-		if( mMiso != NULL )
-			mMiso->TransitionIfNeeded( miso_bits.GetNextBit() );
+	SetEnable( true );
+	mEnrichableSpiSimulationChannels.AdvanceAll( mClockGenerator.AdvanceByHalfPeriod( 2.0 ) );
+
+	U32 count = RandomBetween( 1, 4 );
+	for( U32 i=0; i<count; i++ )
+		OutputWord( RandomWord(), RandomWord() );
 
-		mEnrichableSpiSimulationChannels.AdvanceAll( mClockGenerator.AdvanceByHalfPeriod( .5 ) );
-		mClock->Transition();  //data valid
+	SetEnable( false );
 
-		mEnrichableSpiSimulationChannels.AdvanceAll( mClockGenerator.AdvanceByHalfPeriod( .5 ) );
-		mClock->Transition();  //data invalid
+	if( error )
+	{
+		mEnrichableSpiSimulationChannels.AdvanceAll( mClockGenerator.AdvanceByHalfPeriod( 2.0 ) );
+		mClock->Transition();
 	}
+}
 
-	if( mMosi != NULL )
-		mMosi->TransitionIfNeeded( BIT_LOW );
+U64 EnrichableSpiSimulationDataGenerator::RandomWord()
+{
+	return mRandom() & mWordMask;
+}
 
-	if( mMiso != NULL )
-		mMiso->TransitionIfNeeded( BIT_LOW );
+U32 EnrichableSpiSimulationDataGenerator::RandomBetween( U32 min, U32 max )
+{
+	return min + U32( mRandom() % ( max - min + 1 ) );
+}
 
-	mEnrichableSpiSimulationChannels.AdvanceAll( mClockGenerator.AdvanceByHalfPeriod( 2.0 ) );
+void EnrichableSpiSimulationDataGenerator::SetEnable( bool active )
+{
+	if( mEnable == NULL )
+		return;
+
+	if( active == true )
+		mEnable->TransitionIfNeeded( mSettings->mEnableActiveState );
+	else
+		mEnable->TransitionIfNeeded( Invert( mSettings->mEnableActiveState ) );
 }
 
-void EnrichableSpiSimulationDataGenerator::OutputWord_CPHA1( U64 mosi_data, U64 miso_data )
+void EnrichableSpiSimulationDataGenerator::BuildToggleTable()
 {
-	BitExtractor mosi_bits( mosi_data, mSettings->mShiftOrder, mSettings->mBitsPerTransfer );
-	BitExtractor miso_bits( miso_data, mSettings->mShiftOrder, mSettings->mBitsPerTransfer );
+	for( U32 value=0; value<256; value++ )
+	{
+		U8 mask = 0;
+		U32 previous = 0;
+		for( U32 p=0; p<8; p++ )
+		{
+			U32 bit;
+			if( mSettings->mShiftOrder == AnalyzerEnums::MsbFirst )
+				bit = ( value >> ( 7 - p ) ) & 1;
+			else
+				bit = ( value >> p ) & 1;
+
+			if( bit != previous )
+				mask |= 1 << p;
+			previous = bit;
+		}
+		mToggleTable[ value ] = mask;
+	}
+}
 
+void EnrichableSpiSimulationDataGenerator::OutputWord( U64 mosi_data, U64 miso_data, double idle_half_periods )
+{
+	//the whole word is scheduled up front, then each channel is written on its own: only its edges are visited, rather than advancing every channel on every half-bit.
 	U32 count = mSettings->mBitsPerTransfer;
-	for( U32 i=0; i<count; i++ )
+	U32 quarters = 2 * count;
+
+	if( mFixedSchedule == false )
 	{
-		mClock->Transition();  //data invalid
-		if( mMosi != NULL )
-			mMosi->TransitionIfNeeded( mosi_bits.GetNextBit() );
-		if( mMiso != NULL )
-			mMiso->TransitionIfNeeded( miso_bits.GetNextBit() );
+		mEdgeOffsets[ 0 ] = 0;
+		for( U32 k=0; k<quarters; k++ )
+			mEdgeOffsets[ k + 1 ] = mEdgeOffsets[ k ] + mClockGenerator.AdvanceByHalfPeriod( .5 );
+	}
 
-		mEnrichableSpiSimulationChannels.AdvanceAll( mClockGenerator.AdvanceByHalfPeriod( .5 ) );
-		mClock->Transition();  //data valid
+	U64 word_start = mClock->GetCurrentSampleNumber();
+	U64 word_length = mEdgeOffsets[ quarters ];
 
-		mEnrichableSpiSimulationChannels.AdvanceAll( mClockGenerator.AdvanceByHalfPeriod( .5 ) );
+	//CPHA = 0: data is set at the start of each bit and the clock toggles a quarter and a half period later.
+	//CPHA = 1: the clock toggles as the data is set, and again a quarter period later.
+	U32 first_edge = ( mSettings->mDataValidEdge == AnalyzerEnums::LeadingEdge ) ? 1 : 0;
+	U64 position = 0;
+	for( U32 k=first_edge; k<first_edge + quarters; k++ )
+	{
+		mClock->Advance( U32( mEdgeOffsets[ k ] - position ) );
+		mClock->Transition();
+		position = mEdgeOffsets[ k ];
 	}
+	mClock->Advance( U32( word_length - position ) );
+
+	if( mMosi != NULL )
+		OutputDataLine( mMosi, mosi_data, word_start );
+	if( mMiso != NULL )
+		OutputDataLine( mMiso, miso_data, word_start );
+	if( mEnable != NULL )
+		mEnable->Advance( U32( word_length ) );
+
+	if( idle_half_periods == 0.0 )  //back-to-back; the next word sets the data lines itself
+		return;
 
 	if( mMosi != NULL )
 		mMosi->TransitionIfNeeded( BIT_LOW );
 	if( mMiso != NULL )
 		mMiso->TransitionIfNeeded( BIT_LOW );
 
-	mEnrichableSpiSimulationChannels.AdvanceAll( mClockGenerator.AdvanceByHalfPeriod( 2.0 ) );
+	mEnrichableSpiSimulationChannels.AdvanceAll( mClockGenerator.AdvanceByHalfPeriod( idle_half_periods ) );
+}
+
+void EnrichableSpiSimulationDataGenerator::OutputDataLine( SimulationChannelDescriptor* channel, U64 data, U64 word_start )
+{
+	U32 count = mSettings->mBitsPerTransfer;
+	U32 state = channel->GetCurrentBitState() == BIT_HIGH ? 1 : 0;
+	U64 position = 0;
+
+	//walk the word a byte at a time in the order it is sent; bit i is set at the start of its clock period, offset 2 * i.
+	for( U32 sent=0; sent<count; sent+=8 )
+	{
+		U32 remaining = count - sent;
+		U32 bits = remaining < 8 ? remaining : 8;
+
+		U32 value;
+		if( mSettings->mShiftOrder == AnalyzerEnums::MsbFirst )
+			value = U32( ( ( data << ( 64 - count ) ) << sent ) >> 56 );  //the next 8 bits down from the top of the word
+		else
+			value = U32( ( data >> sent ) & 0xFF );
+
+		U32 toggles = mToggleTable[ value ] ^ state;  //a high line toggles on the first bit if it is low, and vice versa
+		toggles &= ( 1u << bits ) - 1;
+
+		while( toggles != 0 )
+		{
+			U32 p = __builtin_ctz( toggles );
+			toggles &= toggles - 1;
+
+			U64 offset = mEdgeOffsets[ 2 * ( sent + p ) ];
+			channel->Advance( U32( offset - position ) );
+			channel->Transition();
+			position = offset;
+			state ^= 1;
+		}
+	}
+
+	channel->Advance( U32( ( mClock->GetCurrentSampleNumber() - word_start ) - position ) );
 }
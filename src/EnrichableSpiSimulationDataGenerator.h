@@ -2,6 +2,7 @@
 #define SPI_SIMULATION_DATA_GENERATOR
 
 #include <AnalyzerHelpers.h>
+#include <random>
 
 class EnrichableSpiAnalyzerSettings;
 
@@ -18,13 +19,35 @@ protected:
 	EnrichableSpiAnalyzerSettings* mSettings;
 	U32 mSimulationSampleRateHz;
 	U64 mValue;
+	U64 mWordMask;
+	std::mt19937_64 mRandom;
+	U8 mRegisters[128];
+
+	//for each byte value, bit p is set if the data line toggles before the p-th bit sent (starting from a low line), in the configured shift order.
+	U8 mToggleTable[256];
+	//sample offsets of the quarter clock periods of the word being output, from its start.
+	U64 mEdgeOffsets[ 2 * 64 + 1 ];
+	//when half an SCK period is a whole number of samples, every word has the same schedule and mEdgeOffsets is computed once.
+	bool mFixedSchedule;
 
 protected: //SPI specific
 	ClockGenerator mClockGenerator;
 
 	void CreateSpiTransaction();
-	void OutputWord_CPHA0( U64 mosi_data, U64 miso_data );
-	void OutputWord_CPHA1( U64 mosi_data, U64 miso_data );
+	void CreateCountingTransaction();
+	void CreateBurstTransaction();
+	void CreateRegisterTransaction();
+	void CreateLongTransaction();
+	void CreateRandomGapTransaction();
+	void CreateClockErrorTransaction();
+	double GetIdleHalfPeriods();
+
+	U64 RandomWord();
+	U32 RandomBetween( U32 min, U32 max );
+	void SetEnable( bool active );
+	void BuildToggleTable();
+	void OutputWord( U64 mosi_data, U64 miso_data, double idle_half_periods = 2.0 );
+	void OutputDataLine( SimulationChannelDescriptor* channel, U64 data, U64 word_start );
 
 
 	SimulationChannelDescriptorGroup mEnrichableSpiSimulationChannels;
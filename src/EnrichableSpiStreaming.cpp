@@ -0,0 +1,209 @@
+#include "EnrichableSpiStreaming.h"
+#include "EnrichableSpiCapture.h"
+#include "EnrichableSpiHeadless.h"
+#include "EnrichableSpiAnalyzerSettings.h"
+#include "EnrichableSpiExport.h"
+#include "EnrichableAnalyzerSubprocess.h"
+
+#include <memory>
+
+StreamingSpiResults::StreamingSpiResults()
+:	mSettings( NULL ),
+	mSubprocess( NULL ),
+	mTriggerSample( 0 ),
+	mSampleRate( 0 ),
+	mDisplayBase( Hexadecimal ),
+	mEnriched( false ),
+	mPackets( false ),
+	mFile( NULL ),
+	mFrameCount( 0 ),
+	mPacketCount( 0 ),
+	mOpenPacketFirstFrame( 0 ),
+	mOpenPacketWritten( false )
+{
+}
+
+void StreamingSpiResults::Start( EnrichableSpiAnalyzerSettings* settings, EnrichableAnalyzerSubprocess* subprocess, U64 trigger_sample, U32 sample_rate, DisplayBase display_base, bool enriched, bool packets, void* f )
+{
+	mSettings = settings;
+	mSubprocess = subprocess;
+	mTriggerSample = trigger_sample;
+	mSampleRate = sample_rate;
+	mDisplayBase = display_base;
+	mEnriched = enriched;
+	mPackets = packets;
+	mFile = f;
+
+	mFrameCount = 0;
+	mPacketCount = 0;
+	mOpenPacket.clear();
+	mOpenPacketFirstFrame = 0;
+	mOpenPacketWritten = false;
+
+	// Written along with the first frame, as `WriteSpiExport` does.
+	mLine.str( std::string() );
+	FormatSpiExportHeader( mLine, mEnriched );
+}
+
+void StreamingSpiResults::Finish()
+{
+	WriteOpenPacket( INVALID_RESULT_INDEX );
+	mOpenPacketFirstFrame = mFrameCount;
+	mOpenPacketWritten = false;
+}
+
+U64 StreamingSpiResults::AddFrame( const Frame& frame )
+{
+	U64 frame_index = mFrameCount++;
+	if( !mPackets )
+	{
+		Write( frame, frame_index, INVALID_RESULT_INDEX );
+	}
+	else if( mOpenPacketWritten )
+	{
+		Write( frame, frame_index, mPacketCount );
+	}
+	else
+	{
+		mOpenPacket.push_back( frame );
+		if( mOpenPacket.size() >= STREAMING_MAX_OPEN_PACKET_FRAMES )
+		{
+			WriteOpenPacket( mPacketCount );
+			mOpenPacketWritten = true;
+		}
+	}
+
+	return frame_index;
+}
+
+void StreamingSpiResults::AddMarker( U64 /*sample_number*/, AnalyzerResults::MarkerType /*marker_type*/, Channel& /*channel*/ )
+{
+}
+
+U64 StreamingSpiResults::CommitPacketAndStartNewPacket()
+{
+	if( mOpenPacketFirstFrame == mFrameCount )
+		return INVALID_RESULT_INDEX;
+
+	U64 packet_id = mPacketCount++;
+	WriteOpenPacket( packet_id );
+	mOpenPacketFirstFrame = mFrameCount;
+	mOpenPacketWritten = false;
+
+	return packet_id;
+}
+
+void StreamingSpiResults::CommitResults()
+{
+}
+
+U64 StreamingSpiResults::GetNumFrames()
+{
+	return mFrameCount;
+}
+
+U64 StreamingSpiResults::GetNumPackets()
+{
+	return mPacketCount;
+}
+
+void StreamingSpiResults::WriteOpenPacket( U64 packet_id )
+{
+	for( size_t i = 0; i < mOpenPacket.size(); i++ )
+		Write( mOpenPacket[i], mOpenPacketFirstFrame + i, packet_id );
+	mOpenPacket.clear();
+}
+
+void StreamingSpiResults::Write( const Frame& frame, U64 frame_index, U64 packet_id )
+{
+	if( ( frame.mFlags & SPI_ERROR_FLAG ) != 0 )
+		return;
+
+	FormatSpiExportRow( mLine, frame, frame_index, packet_id, mSettings, mSubprocess, mTriggerSample, mSampleRate, mDisplayBase, mEnriched );
+	std::string line = mLine.str();
+	AnalyzerHelpers::AppendToFile( (U8*)line.c_str(), line.length(), mFile );
+	mLine.str( std::string() );
+}
+
+EnrichableSpiStreamingAnalyzer::EnrichableSpiStreamingAnalyzer( EnrichableSpiAnalyzerSettings* settings, EnrichableSpiMappedCapture* capture )
+:	mSettings( settings ),
+	mCapture( capture ),
+	mDecoder( settings, this )
+{
+}
+
+void EnrichableSpiStreamingAnalyzer::Run( EnrichableAnalyzerSubprocess* subprocess, DisplayBase display_base, U32 export_type, void* f )
+{
+	std::auto_ptr< MappedChannelData > mosi;
+	std::auto_ptr< MappedChannelData > miso;
+	std::auto_ptr< MappedChannelData > enable;
+
+	if( mCapture->GetChannel( mSettings->mMosiChannel ) != NULL )
+		mosi.reset( new MappedChannelData( mCapture->GetChannel( mSettings->mMosiChannel ), mCapture ) );
+	if( mCapture->GetChannel( mSettings->mMisoChannel ) != NULL )
+		miso.reset( new MappedChannelData( mCapture->GetChannel( mSettings->mMisoChannel ), mCapture ) );
+	if( mCapture->GetChannel( mSettings->mEnableChannel ) != NULL )
+		enable.reset( new MappedChannelData( mCapture->GetChannel( mSettings->mEnableChannel ), mCapture ) );
+
+	const MappedCaptureChannel* clockChannel = mCapture->GetChannel( mSettings->mClockChannel );
+	if( clockChannel == NULL )
+		return;
+	MappedChannelData clock( clockChannel, mCapture );
+
+	HeadlessRunSetup setup = SetUpHeadlessRun( mSettings, subprocess, mCapture->mTriggerSample );
+	bool stats = setup.mStats;
+	EnrichableTrace* trace = setup.mTrace;
+	EnrichableFrameTee* tee = setup.mTee;
+	EnrichableAnalyzerSubprocess* enrichment = setup.mEnrichment;
+
+	bool enriched = export_type == SPI_EXPORT_ENRICHED_CSV;
+	EnrichableAnalyzerSubprocess* tabular = NULL;
+	if( enriched && enrichment != NULL && enrichment->TabularEnabled() )
+		tabular = enrichment;
+	mResults.Start( mSettings, tabular, mCapture->mTriggerSample, mCapture->mSampleRate, display_base, enriched, enable.get() != NULL, f );
+
+	mDecoder.Setup( &mResults, enrichment, trace, tee, mosi.get(), miso.get(), &clock, enable.get() );
+
+	try
+	{
+		mDecoder.AdvanceToActiveEnableEdgeWithCorrectClockPolarity();
+
+		for( ; ; )
+		{
+			TraceSpan span( trace, "GetWord" );
+			if( stats )
+			{
+				U64 start = EnrichableAnalyzerStats::Now();
+				mDecoder.GetWord();
+				subprocess->RecordDecode( EnrichableAnalyzerStats::Now() - start );
+			}
+			else
+			{
+				mDecoder.GetWord();
+			}
+		}
+	}
+	catch( CaptureExhausted& )
+	{
+	}
+
+	mDecoder.FlushPendingMarkers();
+	mResults.Finish();
+	if( stats )
+		subprocess->WriteStats( true );
+	if( trace != NULL )
+		trace->Flush( true );
+}
+
+U64 EnrichableSpiStreamingAnalyzer::GetNumFrames()
+{
+	return mResults.GetNumFrames();
+}
+
+void EnrichableSpiStreamingAnalyzer::ReportProgress( U64 /*sample_number*/ )
+{
+}
+
+void EnrichableSpiStreamingAnalyzer::CheckIfThreadShouldExit()
+{
+}
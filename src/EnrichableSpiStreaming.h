@@ -0,0 +1,97 @@
+#ifndef SPI_STREAMING_H
+#define SPI_STREAMING_H
+
+#include <AnalyzerResults.h>
+#include "EnrichableSpiDecoder.h"
+#include "EnrichableSpiMappedCapture.h"
+
+#include <sstream>
+#include <vector>
+
+// Frames of one packet held until the packet ends; a longer packet is written
+// out under the id it will get when it ends.
+#define STREAMING_MAX_OPEN_PACKET_FRAMES 65536
+
+class EnrichableSpiAnalyzerSettings;
+class EnrichableAnalyzerSubprocess;
+
+// Stands in for `AnalyzerResults` when frames are exported as they are
+// decoded rather than kept: each frame is written to the export as soon as
+// the packet it belongs to is known, so only the open packet is held.
+// Markers are dropped, as the export doesn't show them.
+//
+// Packets longer than `STREAMING_MAX_OPEN_PACKET_FRAMES` are the exception:
+// their frames are written before the packet ends, with the id the packet
+// gets when committed.  Should the capture end first, they keep that id
+// where `WriteSpiExport` would leave it out.
+class StreamingSpiResults
+{
+public:
+	StreamingSpiResults();
+
+	// Starts a new export to `f`; see `WriteSpiExport`.  Without an enable
+	// channel the decoder never ends a packet, and frames are written
+	// straight away.
+	void Start( EnrichableSpiAnalyzerSettings* settings, EnrichableAnalyzerSubprocess* subprocess, U64 trigger_sample, U32 sample_rate, DisplayBase display_base, bool enriched, bool packets, void* f );
+	// Writes the frames of the packet left open, outside of any packet
+	// unless they were written already.
+	void Finish();
+
+	U64 AddFrame( const Frame& frame );
+	void AddMarker( U64 sample_number, AnalyzerResults::MarkerType marker_type, Channel& channel );
+	U64 CommitPacketAndStartNewPacket();
+	void CommitResults();
+	U64 GetNumFrames();
+	U64 GetNumPackets();
+
+protected:
+	void Write( const Frame& frame, U64 frame_index, U64 packet_id );
+	void WriteOpenPacket( U64 packet_id );
+
+	EnrichableSpiAnalyzerSettings* mSettings;
+	EnrichableAnalyzerSubprocess* mSubprocess;
+	U64 mTriggerSample;
+	U32 mSampleRate;
+	DisplayBase mDisplayBase;
+	bool mEnriched;
+	bool mPackets;
+	void* mFile;
+	std::stringstream mLine;
+
+	U64 mFrameCount;
+	U64 mPacketCount;
+	// Frames of the open packet; the first is frame `mOpenPacketFirstFrame`.
+	std::vector<Frame> mOpenPacket;
+	U64 mOpenPacketFirstFrame;
+	// Whether the open packet outgrew `mOpenPacket` and its frames are
+	// written as they come, with id `mPacketCount`.
+	bool mOpenPacketWritten;
+};
+
+// Decodes an `EnrichableSpiMappedCapture` like `EnrichableSpiHeadlessAnalyzer`
+// decodes a capture in memory, but exports frames while decoding.  Memory use
+// is independent of the capture's length.
+class EnrichableSpiStreamingAnalyzer
+{
+public:
+	EnrichableSpiStreamingAnalyzer( EnrichableSpiAnalyzerSettings* settings, EnrichableSpiMappedCapture* capture );
+
+	// Decodes the whole capture into `f` in the format of `WriteSpiExport`
+	// with `export_type`.  `subprocess` may be NULL, in which case no
+	// enrichment script is started, no statistics or trace are collected
+	// and no frame output is written.
+	void Run( EnrichableAnalyzerSubprocess* subprocess, DisplayBase display_base, U32 export_type, void* f );
+
+	U64 GetNumFrames();
+
+	void ReportProgress( U64 sample_number );
+	void CheckIfThreadShouldExit();
+
+protected:
+	EnrichableSpiAnalyzerSettings* mSettings;
+	EnrichableSpiMappedCapture* mCapture;
+	StreamingSpiResults mResults;
+	EnrichableSpiDecoder< MappedChannelData, StreamingSpiResults, EnrichableSpiStreamingAnalyzer > mDecoder;
+};
+
+#endif //SPI_STREAMING_H
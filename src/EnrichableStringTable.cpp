@@ -0,0 +1,231 @@
+#include "EnrichableStringTable.h"
+
+#include <string.h>
+
+#define STRING_TABLE_CHUNK_BYTES 65536
+#define STRING_TABLE_INITIAL_SLOTS 1024
+
+namespace {
+	U32 HashString(const char* text, size_t length) {
+		U32 hash = 2166136261u;
+		for(size_t i = 0; i < length; i++) {
+			hash = (hash ^ (unsigned char)text[i]) * 16777619u;
+		}
+		return hash;
+	}
+
+	// The block holding `id`, and its position there.
+	void LocateId(U32 id, unsigned* block, U64* index) {
+		U64 position = U64(id) + (U64(1) << STRING_TABLE_FIRST_BLOCK_BITS);
+		unsigned bit = 63 - __builtin_clzll(position);
+		*block = bit - STRING_TABLE_FIRST_BLOCK_BITS;
+		*index = position - (U64(1) << bit);
+	}
+}
+
+EnrichableStringTable::EnrichableStringTable():
+	chunkUsed(0),
+	chunkSize(0),
+	arenaBytes(0),
+	count(0),
+	blockBytes(0),
+	slots(STRING_TABLE_INITIAL_SLOTS, 0),
+	bytes(0)
+{
+	for(unsigned i = 0; i < STRING_TABLE_BLOCKS; i++) {
+		blocks[i].store(NULL, std::memory_order_relaxed);
+	}
+}
+
+EnrichableStringTable::~EnrichableStringTable() {
+	for(unsigned i = 0; i < STRING_TABLE_BLOCKS; i++) {
+		delete[] blocks[i].load(std::memory_order_relaxed);
+	}
+}
+
+U32 EnrichableStringTable::Intern(const char* text, size_t length) {
+	U32 hash = HashString(text, length);
+
+	std::lock_guard<std::mutex> guard(lock);
+
+	size_t mask = slots.size() - 1;
+	size_t slot = hash & mask;
+	while(slots[slot] != 0) {
+		U32 id = slots[slot] - 1;
+		if(hashes[id] == hash && lengths[id] == length && memcmp(Get(id), text, length) == 0) {
+			return id;
+		}
+		slot = (slot + 1) & mask;
+	}
+
+	char* copy = Allocate(length + 1);
+	memcpy(copy, text, length);
+	copy[length] = '\0';
+
+	U32 id = count;
+	unsigned block;
+	U64 index;
+	LocateId(id, &block, &index);
+	const char** strings = blocks[block].load(std::memory_order_relaxed);
+	if(strings == NULL) {
+		U64 size = U64(1) << (block + STRING_TABLE_FIRST_BLOCK_BITS);
+		strings = new const char*[size];
+		blockBytes += size * sizeof(const char*);
+		blocks[block].store(strings, std::memory_order_release);
+	}
+	strings[index] = copy;
+	count++;
+	lengths.push_back(U32(length));
+	hashes.push_back(hash);
+	slots[slot] = id + 1;
+
+	// Kept at most half full.
+	if(U64(count) * 2 > slots.size()) {
+		GrowIndex();
+	}
+	bytes.store(
+		arenaBytes
+			+ blockBytes
+			+ (lengths.capacity() + hashes.capacity() + slots.capacity()) * sizeof(U32),
+		std::memory_order_relaxed
+	);
+	return id;
+}
+
+const char* EnrichableStringTable::Get(U32 id) {
+	unsigned block;
+	U64 index;
+	LocateId(id, &block, &index);
+	return blocks[block].load(std::memory_order_acquire)[index];
+}
+
+U32 EnrichableStringTable::GetCount() {
+	std::lock_guard<std::mutex> guard(lock);
+	return count;
+}
+
+U64 EnrichableStringTable::GetBytes() {
+	return bytes.load(std::memory_order_relaxed);
+}
+
+char* EnrichableStringTable::Allocate(size_t bytes) {
+	// Lines longer than a chunk get one of their own.
+	if(chunks.empty() || chunkUsed + bytes > chunkSize) {
+		chunkSize = bytes > STRING_TABLE_CHUNK_BYTES ? bytes : STRING_TABLE_CHUNK_BYTES;
+		chunks.push_back(std::unique_ptr<char[]>(new char[chunkSize]));
+		chunkUsed = 0;
+		arenaBytes += chunkSize;
+	}
+
+	char* memory = chunks.back().get() + chunkUsed;
+	chunkUsed += bytes;
+	return memory;
+}
+
+void EnrichableStringTable::GrowIndex() {
+	std::vector<U32> grown(slots.size() * 2, 0);
+	size_t mask = grown.size() - 1;
+	for(U32 id = 0; id < count; id++) {
+		size_t slot = hashes[id] & mask;
+		while(grown[slot] != 0) {
+			slot = (slot + 1) & mask;
+		}
+		grown[slot] = id + 1;
+	}
+	slots.swap(grown);
+}
+
+void EnrichableTextLines::Add(const std::shared_ptr<EnrichableStringTable>& from, const char* text, size_t length) {
+	table = from;
+	ids.push_back(from->Intern(text, length));
+}
+
+void EnrichableTextLines::Clear() {
+	table.reset();
+	ids.clear();
+}
+
+EnrichableTextCache::EnrichableTextCache(U64 maxBytes):
+	maxBytes(maxBytes),
+	pageBytes(0)
+{
+}
+
+bool EnrichableTextCache::Find(Kind kind, U64 frameIndex, U32 check, EnrichableTextLines* lines) {
+	std::lock_guard<std::mutex> guard(lock);
+
+	U32* entry = GetEntry(kind, frameIndex, false);
+	if(entry == NULL || *entry == 0 || pool[*entry - 1] != check) {
+		return false;
+	}
+
+	const U32* stored = &pool[*entry];
+	lines->Clear();
+	if(stored[0] > 0) {
+		lines->table = table;
+		lines->ids.assign(stored + 1, stored + 1 + stored[0]);
+	}
+	return true;
+}
+
+void EnrichableTextCache::Store(Kind kind, U64 frameIndex, U32 check, const EnrichableTextLines& lines) {
+	std::lock_guard<std::mutex> guard(lock);
+
+	U64 bytes = pageBytes + (pool.size() + 2 + lines.ids.size()) * sizeof(U32);
+	if(bytes > maxBytes || (!lines.empty() && lines.table != table)) {
+		Empty();
+	}
+	if(!lines.empty()) {
+		table = lines.table;
+	}
+
+	// Offsets into the pool are 32 bits.
+	if(pool.size() + 2 + lines.ids.size() > U64(0xffffffff)) {
+		return;
+	}
+	U32* entry = GetEntry(kind, frameIndex, true);
+	if(entry == NULL) {
+		return;
+	}
+	*entry = U32(pool.size() + 1);
+	pool.push_back(check);
+	pool.push_back(U32(lines.ids.size()));
+	pool.insert(pool.end(), lines.ids.begin(), lines.ids.end());
+}
+
+void EnrichableTextCache::Clear() {
+	std::lock_guard<std::mutex> guard(lock);
+	Empty();
+}
+
+void EnrichableTextCache::Empty() {
+	for(unsigned i = 0; i < KindCount; i++) {
+		pages[i].clear();
+		pages[i].shrink_to_fit();
+	}
+	pageBytes = 0;
+	pool.clear();
+	pool.shrink_to_fit();
+	table.reset();
+}
+
+U32* EnrichableTextCache::GetEntry(Kind kind, U64 frameIndex, bool add) {
+	U64 page = frameIndex >> TEXT_CACHE_PAGE_BITS;
+	std::vector<std::unique_ptr<U32[]>>& kindPages = pages[kind];
+	if(page >= kindPages.size()) {
+		// The page list itself is kept within the budget.
+		if(!add || (page + 1) * sizeof(kindPages[0]) > maxBytes) {
+			return NULL;
+		}
+		kindPages.resize(page + 1);
+	}
+	if(!kindPages[page]) {
+		if(!add) {
+			return NULL;
+		}
+		U64 size = U64(1) << TEXT_CACHE_PAGE_BITS;
+		kindPages[page].reset(new U32[size]());
+		pageBytes += size * sizeof(U32);
+	}
+	return &kindPages[page][frameIndex & ((U64(1) << TEXT_CACHE_PAGE_BITS) - 1)];
+}
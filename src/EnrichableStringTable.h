@@ -0,0 +1,128 @@
+#pragma once
+
+#include <LogicPublicTypes.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Ids are indexed through blocks that double in size, the first holding
+// 2^STRING_TABLE_FIRST_BLOCK_BITS ids, so every U32 id has a block.
+#define STRING_TABLE_FIRST_BLOCK_BITS 6
+#define STRING_TABLE_BLOCKS (32 - STRING_TABLE_FIRST_BLOCK_BITS + 1)
+
+// Frames per page of a text cache's index.
+#define TEXT_CACHE_PAGE_BITS 12
+
+// Append-only storage for enrichment text.  Scripts return the same few
+// hundred lines ("(R) RXLVL Ch A", ...) over and over; each distinct line is
+// copied into the arena once and afterwards referred to by a 32-bit id.
+//
+// Strings never move or change once added, so the pointer `Get` returns is
+// valid for the table's lifetime.  All methods may be called from any thread;
+// `Get` takes no lock, since Logic calls it for every line of every bubble it
+// draws.
+class EnrichableStringTable {
+	public:
+		EnrichableStringTable();
+		~EnrichableStringTable();
+
+		// Returns the id of `text`, adding it on first use.
+		U32 Intern(const char* text, size_t length);
+		// `id` must have come from `Intern`, on this thread or handed over
+		// through a lock, as `EnrichableTextLines` are.
+		const char* Get(U32 id);
+
+		U32 GetCount();
+		// Arena and index memory in use; takes no lock.
+		U64 GetBytes();
+
+	protected:
+		char* Allocate(size_t bytes);
+		void GrowIndex();
+
+		std::mutex lock;
+		std::vector<std::unique_ptr<char[]>> chunks;
+		size_t chunkUsed;
+		size_t chunkSize;
+		U64 arenaBytes;
+
+		// The string of each id; blocks are allocated as ids reach them and
+		// never move.
+		std::atomic<const char**> blocks[STRING_TABLE_BLOCKS];
+		U32 count;
+		U64 blockBytes;
+		std::vector<U32> lengths;
+		std::vector<U32> hashes;
+		// Open addressing; each slot holds an id plus one, or 0 if free.
+		std::vector<U32> slots;
+		std::atomic<U64> bytes;
+};
+
+// Lines of enrichment text, as interned ids; the table they came from is
+// kept alive for as long as they are, even after the subprocess moves on to
+// a fresh one.
+class EnrichableTextLines {
+	public:
+		size_t size() const {
+			return ids.size();
+		}
+		bool empty() const {
+			return ids.empty();
+		}
+		const char* operator[](size_t index) const {
+			return table->Get(ids[index]);
+		}
+
+		// Every line of one object comes from the same table.
+		void Add(const std::shared_ptr<EnrichableStringTable>& from, const char* text, size_t length);
+		void Clear();
+		void swap(EnrichableTextLines& other) {
+			table.swap(other.table);
+			ids.swap(other.ids);
+		}
+
+	protected:
+		friend class EnrichableTextCache;
+
+		std::shared_ptr<EnrichableStringTable> table;
+		std::vector<U32> ids;
+};
+
+// The enrichment text of each frame, kept as ids so that Logic drawing a
+// frame again doesn't cost another round trip to the script.  Every frame
+// index has four bytes in a paged index, plus its ids once stored; text from
+// a different string table, or more than `maxBytes` of index and ids, starts
+// the cache over.  All methods may be called from any thread.
+class EnrichableTextCache {
+	public:
+		enum Kind {
+			MosiBubble,
+			MisoBubble,
+			Tabular,
+			KindCount
+		};
+
+		EnrichableTextCache(U64 maxBytes);
+
+		// `check` tells apart frames given the same index by different
+		// runs; a stored entry only matches the same value.
+		bool Find(Kind kind, U64 frameIndex, U32 check, EnrichableTextLines* lines);
+		void Store(Kind kind, U64 frameIndex, U32 check, const EnrichableTextLines& lines);
+		void Clear();
+
+	protected:
+		// Both only called while holding `lock`.
+		void Empty();
+		U32* GetEntry(Kind kind, U64 frameIndex, bool add);
+
+		std::mutex lock;
+		U64 maxBytes;
+		std::shared_ptr<EnrichableStringTable> table;
+		// Per kind, pages of 2^TEXT_CACHE_PAGE_BITS entries, each an offset
+		// into `pool` plus one, or 0 if nothing is stored.
+		std::vector<std::unique_ptr<U32[]>> pages[KindCount];
+		U64 pageBytes;
+		// Stored text as `check, count, ids...`.
+		std::vector<U32> pool;
+};
@@ -0,0 +1,334 @@
+#include "EnrichableTrace.h"
+#include "EnrichableAnalyzerStats.h"
+
+#include <iostream>
+#include <thread>
+
+#include <unistd.h>
+
+#define TRACE_BLOCK_EVENTS 16384
+// Unflushed blocks a single thread may hold (512 KiB each) before further
+// spans are dropped.
+#define TRACE_MAX_BLOCKS 256
+#define TRACE_FLUSH_INTERVAL_NS 1000000000ull
+#define TRACE_THREAD_CACHE_SLOTS 4
+
+struct TraceEvent {
+	const char* name;
+	U64 start;
+	U64 end;
+	U64 frameIndex;
+};
+
+// Written by its owning thread only; `count` and `next` publish its contents
+// to the flushing thread.
+struct TraceBlock {
+	TraceBlock():
+		count(0),
+		next(NULL)
+	{
+	}
+
+	TraceEvent events[TRACE_BLOCK_EVENTS];
+	std::atomic<unsigned> count;
+	std::atomic<TraceBlock*> next;
+};
+
+struct TraceThreadBuffer {
+	TraceThreadBuffer(std::thread::id owner, unsigned id):
+		owner(owner),
+		id(id),
+		name(NULL),
+		nameWritten(false),
+		first(new TraceBlock()),
+		tail(first),
+		flushIndex(0),
+		blocks(1),
+		dropped(0)
+	{
+	}
+
+	~TraceThreadBuffer() {
+		while(first != NULL) {
+			TraceBlock* next = first->next.load(std::memory_order_relaxed);
+			delete first;
+			first = next;
+		}
+	}
+
+	std::thread::id owner;
+	unsigned id;
+	std::atomic<const char*> name;
+	bool nameWritten;
+
+	// Owned by the flushing thread.
+	TraceBlock* first;
+	// Owned by the recording thread.
+	TraceBlock* tail;
+	unsigned flushIndex;
+
+	std::atomic<unsigned> blocks;
+	std::atomic<U64> dropped;
+};
+
+namespace {
+	// Generations are unique across every trace, so one small cache per
+	// thread serves all analyzer instances.
+	std::atomic<U64> nextGeneration(1);
+
+	struct ThreadBufferCacheEntry {
+		U64 generation;
+		TraceThreadBuffer* buffer;
+	};
+
+	thread_local ThreadBufferCacheEntry threadBufferCache[TRACE_THREAD_CACHE_SLOTS];
+	thread_local unsigned threadBufferCacheNext = 0;
+}
+
+EnrichableTrace::EnrichableTrace():
+	enabled(false),
+	generation(0),
+	lastFlush(0),
+	output(NULL),
+	firstEvent(true),
+	origin(0),
+	pid(getpid())
+{
+}
+
+EnrichableTrace::~EnrichableTrace() {
+	Close();
+
+	for(TraceThreadBuffer* buffer: buffers) {
+		delete buffer;
+	}
+	for(TraceThreadBuffer* buffer: retired) {
+		delete buffer;
+	}
+}
+
+void EnrichableTrace::SetOutputFile(std::string path) {
+	std::lock_guard<std::mutex> guard(lock);
+
+	CloseLocked();
+
+	for(TraceThreadBuffer* buffer: retired) {
+		delete buffer;
+	}
+	retired.swap(buffers);
+	buffers.clear();
+	generation.store(nextGeneration.fetch_add(1), std::memory_order_release);
+
+	if(!path.length()) {
+		return;
+	}
+
+	output = fopen(path.c_str(), "w");
+	if(output == NULL) {
+		std::cerr << "Unable to write trace file: ";
+		std::cerr << path;
+		std::cerr << "\n";
+		return;
+	}
+
+	fputs("[\n", output);
+	firstEvent = true;
+	origin = EnrichableAnalyzerStats::Now();
+	lastFlush.store(origin, std::memory_order_relaxed);
+	enabled.store(true, std::memory_order_release);
+}
+
+bool EnrichableTrace::Enabled() const {
+	return enabled.load(std::memory_order_relaxed);
+}
+
+void EnrichableTrace::NameThread(const char* name) {
+	if(!Enabled()) {
+		return;
+	}
+
+	TraceThreadBuffer* buffer = GetThreadBuffer();
+	if(buffer != NULL) {
+		buffer->name.store(name, std::memory_order_release);
+	}
+}
+
+TraceThreadBuffer* EnrichableTrace::GetThreadBuffer() {
+	U64 current = generation.load(std::memory_order_acquire);
+	for(unsigned i = 0; i < TRACE_THREAD_CACHE_SLOTS; i++) {
+		if(threadBufferCache[i].generation == current) {
+			return threadBufferCache[i].buffer;
+		}
+	}
+
+	std::lock_guard<std::mutex> guard(lock);
+	if(output == NULL || generation.load(std::memory_order_relaxed) != current) {
+		return NULL;
+	}
+
+	std::thread::id self = std::this_thread::get_id();
+	TraceThreadBuffer* buffer = NULL;
+	for(TraceThreadBuffer* candidate: buffers) {
+		if(candidate->owner == self) {
+			buffer = candidate;
+			break;
+		}
+	}
+	if(buffer == NULL) {
+		buffer = new TraceThreadBuffer(self, buffers.size() + 1);
+		buffers.push_back(buffer);
+	}
+
+	ThreadBufferCacheEntry& entry = threadBufferCache[threadBufferCacheNext++ % TRACE_THREAD_CACHE_SLOTS];
+	entry.generation = current;
+	entry.buffer = buffer;
+	return buffer;
+}
+
+void EnrichableTrace::Record(const char* name, U64 start, U64 end, U64 frameIndex) {
+	TraceThreadBuffer* buffer = GetThreadBuffer();
+	if(buffer == NULL) {
+		return;
+	}
+
+	TraceBlock* block = buffer->tail;
+	unsigned index = block->count.load(std::memory_order_relaxed);
+	if(index == TRACE_BLOCK_EVENTS) {
+		if(buffer->blocks.load(std::memory_order_relaxed) >= TRACE_MAX_BLOCKS) {
+			buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		TraceBlock* next = new TraceBlock();
+		buffer->blocks.fetch_add(1, std::memory_order_relaxed);
+		block->next.store(next, std::memory_order_release);
+		buffer->tail = block = next;
+		index = 0;
+	}
+
+	TraceEvent& event = block->events[index];
+	event.name = name;
+	event.start = start;
+	event.end = end;
+	event.frameIndex = frameIndex;
+	block->count.store(index + 1, std::memory_order_release);
+}
+
+void EnrichableTrace::Flush(bool force) {
+	if(!Enabled()) {
+		return;
+	}
+
+	U64 now = EnrichableAnalyzerStats::Now();
+	if(!force && now - lastFlush.load(std::memory_order_relaxed) < TRACE_FLUSH_INTERVAL_NS) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> guard(lock);
+	lastFlush.store(now, std::memory_order_relaxed);
+	if(output != NULL) {
+		WriteEvents();
+		fflush(output);
+	}
+}
+
+void EnrichableTrace::Close() {
+	std::lock_guard<std::mutex> guard(lock);
+	CloseLocked();
+}
+
+void EnrichableTrace::CloseLocked() {
+	enabled.store(false, std::memory_order_relaxed);
+	if(output == NULL) {
+		return;
+	}
+
+	WriteEvents();
+	fputs("\n]\n", output);
+	fclose(output);
+	output = NULL;
+
+	for(TraceThreadBuffer* buffer: buffers) {
+		U64 dropped = buffer->dropped.load(std::memory_order_relaxed);
+		if(dropped) {
+			std::cerr << "Trace buffer full; dropped ";
+			std::cerr << dropped;
+			std::cerr << " spans\n";
+		}
+	}
+}
+
+void EnrichableTrace::WriteEvents() {
+	for(TraceThreadBuffer* buffer: buffers) {
+		const char* name = buffer->name.load(std::memory_order_acquire);
+		if(name != NULL && !buffer->nameWritten) {
+			fprintf(
+				output,
+				"%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+				firstEvent ? "" : ",\n",
+				pid,
+				buffer->id,
+				name
+			);
+			firstEvent = false;
+			buffer->nameWritten = true;
+		}
+
+		for(;;) {
+			TraceBlock* block = buffer->first;
+			// `next` is published only once the block is full, so load it
+			// before `count` to know whether the block can be released.
+			TraceBlock* next = block->next.load(std::memory_order_acquire);
+			unsigned count = block->count.load(std::memory_order_acquire);
+
+			for(unsigned i = buffer->flushIndex; i < count; i++) {
+				const TraceEvent& event = block->events[i];
+				if(event.start < origin) {
+					continue;
+				}
+
+				fprintf(
+					output,
+					"%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f",
+					firstEvent ? "" : ",\n",
+					event.name,
+					pid,
+					buffer->id,
+					(event.start - origin) / 1000.0,
+					(event.end - event.start) / 1000.0
+				);
+				if(event.frameIndex != TRACE_NO_ARG) {
+					fprintf(output, ",\"args\":{\"frame\":%llu}", (unsigned long long)event.frameIndex);
+				}
+				fputc('}', output);
+				firstEvent = false;
+			}
+			buffer->flushIndex = count;
+
+			if(next == NULL) {
+				break;
+			}
+			buffer->first = next;
+			buffer->flushIndex = 0;
+			buffer->blocks.fetch_sub(1, std::memory_order_relaxed);
+			delete block;
+		}
+	}
+}
+
+TraceSpan::TraceSpan(EnrichableTrace* trace, const char* name, U64 frameIndex):
+	trace(trace != NULL && trace->Enabled() ? trace : NULL),
+	name(name),
+	frameIndex(frameIndex),
+	start(0)
+{
+	if(this->trace != NULL) {
+		start = EnrichableAnalyzerStats::Now();
+	}
+}
+
+TraceSpan::~TraceSpan() {
+	if(trace != NULL) {
+		trace->Record(name, start, EnrichableAnalyzerStats::Now(), frameIndex);
+	}
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <LogicPublicTypes.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+
+#define TRACE_NO_ARG 0xFFFFFFFFFFFFFFFFull
+
+struct TraceThreadBuffer;
+
+// Records spans into per-thread buffers and writes them as Chrome trace-event
+// JSON (the "JSON Array Format"), viewable in chrome://tracing or Perfetto.
+//
+// Each thread appends to its own buffer without taking a lock; `Flush`
+// appends whatever has been recorded since the previous flush to the file.
+// Span names are stored by pointer and must be string literals.
+class EnrichableTrace {
+	public:
+		EnrichableTrace();
+		~EnrichableTrace();
+
+		// Closes the current trace file, if any, and starts a new one;
+		// an empty path disables tracing.
+		void SetOutputFile(std::string path);
+		bool Enabled() const;
+
+		// Labels the calling thread in the trace viewer.
+		void NameThread(const char* name);
+		// `start` and `end` come from `EnrichableAnalyzerStats::Now()`.
+		void Record(const char* name, U64 start, U64 end, U64 frameIndex=TRACE_NO_ARG);
+
+		// Appends recorded spans to the file at most once per second;
+		// `force` appends them regardless.
+		void Flush(bool force);
+		// Flushes and terminates the JSON array.
+		void Close();
+
+	protected:
+		TraceThreadBuffer* GetThreadBuffer();
+		void WriteEvents();
+		void CloseLocked();
+
+		std::atomic<bool> enabled;
+		std::atomic<U64> generation;
+		std::atomic<U64> lastFlush;
+
+		// Guards everything below; taken when a thread first records into a
+		// trace and when flushing, never per span.
+		std::mutex lock;
+		std::vector<TraceThreadBuffer*> buffers;
+		// Buffers from the previous trace file.  A thread may still be
+		// finishing a span in one of these, so they are freed a file later.
+		std::vector<TraceThreadBuffer*> retired;
+		FILE* output;
+		bool firstEvent;
+		U64 origin;
+		int pid;
+};
+
+// Records a span covering its own lifetime when tracing is enabled.
+class TraceSpan {
+	public:
+		TraceSpan(EnrichableTrace* trace, const char* name, U64 frameIndex=TRACE_NO_ARG);
+		~TraceSpan();
+
+	protected:
+		EnrichableTrace* trace;
+		const char* name;
+		U64 frameIndex;
+		U64 start;
+};
@@ -0,0 +1,378 @@
+// Batch capture replay.
+//
+// Decodes many captures at once, each as `enrichable_spi_replay` would, on a
+// pool of worker threads, and writes a summary of how long each took.
+//
+//   enrichable_spi_batch --jobs FILE [--workers N] [--scripts N] [--summary FILE]
+//
+// Every non-empty line of the jobs file not starting with '#' holds one
+// capture's `enrichable_spi_replay` arguments, quoted as in a shell.  Jobs
+// decode on one thread each unless they pass `--threads`.
+//
+// The largest captures are started first, so that the last ones to finish
+// are short and the run takes about as long as its total work divided by the
+// number of workers.  At most `--scripts` jobs run an enrichment script at a
+// time; while that many are running, workers go on to jobs without one.
+
+#include "ReplayJob.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+struct BatchEntry
+{
+	std::unique_ptr<ReplayJob> mJob;
+	std::string mLine;
+	bool mRunsScript;
+	U64 mInputBytes;
+
+	bool mStarted;
+	bool mSucceeded;
+	std::string mError;
+	ReplayResult mResult;
+};
+
+class BatchScheduler
+{
+public:
+	BatchScheduler( std::vector<BatchEntry>& entries, U32 scripts )
+	:	mEntries( entries ),
+		mScriptSlots( scripts ),
+		mScriptsRunning( 0 ),
+		mFinished( 0 )
+	{
+		for( size_t i = 0; i < entries.size(); i++ )
+			mOrder.push_back( i );
+		std::stable_sort( mOrder.begin(), mOrder.end(), [&]( size_t a, size_t b ) {
+			return entries[a].mInputBytes > entries[b].mInputBytes;
+		} );
+	}
+
+	void Worker()
+	{
+		for( ; ; )
+		{
+			BatchEntry* entry = Take();
+			if( entry == NULL )
+				return;
+
+			entry->mSucceeded = RunReplayJob( entry->mJob.get(), &entry->mResult, &entry->mError );
+			Finish( entry );
+		}
+	}
+
+protected:
+	// The largest job not yet started that a script slot is free for, or
+	// NULL once every job has been started.
+	BatchEntry* Take()
+	{
+		std::unique_lock<std::mutex> guard( mLock );
+		for( ; ; )
+		{
+			bool pending = false;
+			for( size_t index : mOrder )
+			{
+				BatchEntry& entry = mEntries[index];
+				if( entry.mStarted )
+					continue;
+				pending = true;
+				if( entry.mRunsScript && mScriptsRunning >= mScriptSlots )
+					continue;
+
+				entry.mStarted = true;
+				if( entry.mRunsScript )
+					mScriptsRunning++;
+				return &entry;
+			}
+			if( !pending )
+				return NULL;
+			mSlotFreed.wait( guard );
+		}
+	}
+
+	void Finish( BatchEntry* entry )
+	{
+		std::lock_guard<std::mutex> guard( mLock );
+		mFinished++;
+		if( entry->mRunsScript )
+		{
+			mScriptsRunning--;
+			mSlotFreed.notify_all();
+		}
+
+		std::cerr << "[" << mFinished << "/" << mEntries.size() << "] " << entry->mJob->mInput << ": ";
+		if( entry->mSucceeded )
+			std::cerr << entry->mResult.mFrames << " frames in "
+				<< entry->mResult.mLoadSeconds + entry->mResult.mDecodeSeconds + entry->mResult.mExportSeconds << " s\n";
+		else
+			std::cerr << entry->mError << "\n";
+	}
+
+	std::vector<BatchEntry>& mEntries;
+	std::vector<size_t> mOrder;
+	U32 mScriptSlots;
+	U32 mScriptsRunning;
+	size_t mFinished;
+	std::mutex mLock;
+	std::condition_variable mSlotFreed;
+};
+
+// The size of a capture file, or of every file in an export directory.
+static U64 InputBytes( const std::string& path )
+{
+	struct stat info;
+	if( stat( path.c_str(), &info ) != 0 )
+		return 0;
+	if( !S_ISDIR( info.st_mode ) )
+		return info.st_size;
+
+	U64 bytes = 0;
+	DIR* directory = opendir( path.c_str() );
+	if( directory == NULL )
+		return 0;
+	while( struct dirent* entry = readdir( directory ) )
+	{
+		std::string file = path + "/" + entry->d_name;
+		if( stat( file.c_str(), &info ) == 0 && S_ISREG( info.st_mode ) )
+			bytes += info.st_size;
+	}
+	closedir( directory );
+	return bytes;
+}
+
+// Splits a jobs file line into arguments at unquoted blanks, removing quotes
+// and backslashes as a shell would.  Nothing is expanded: `$VARS`, `~` and
+// globs are taken literally.  Returns false on an unclosed quote or a
+// trailing backslash.
+static bool SplitArguments( const std::string& line, std::vector<std::string>* args )
+{
+	std::string arg;
+	bool inArg = false;
+	for( size_t i = 0; i < line.length(); i++ )
+	{
+		char c = line[i];
+		if( c == ' ' || c == '\t' || c == '\r' )
+		{
+			if( inArg )
+				args->push_back( arg );
+			arg.clear();
+			inArg = false;
+			continue;
+		}
+
+		inArg = true;
+		if( c == '\'' )
+		{
+			size_t end = line.find( '\'', i + 1 );
+			if( end == std::string::npos )
+				return false;
+			arg.append( line, i + 1, end - i - 1 );
+			i = end;
+		}
+		else if( c == '"' )
+		{
+			for( i++; i < line.length() && line[i] != '"'; i++ )
+			{
+				// Within double quotes, a backslash only escapes these.
+				if( line[i] == '\\' && i + 1 < line.length() && strchr( "\"\\$`", line[i + 1] ) != NULL )
+					i++;
+				arg += line[i];
+			}
+			if( i == line.length() )
+				return false;
+		}
+		else if( c == '\\' )
+		{
+			if( i + 1 == line.length() )
+				return false;
+			arg += line[++i];
+		}
+		else
+		{
+			arg += c;
+		}
+	}
+	if( inArg )
+		args->push_back( arg );
+	return true;
+}
+
+static bool LoadJobs( const std::string& path, std::vector<BatchEntry>* entries )
+{
+	std::ifstream in( path.c_str() );
+	if( !in )
+	{
+		std::cerr << "Unable to read jobs file: " << path << "\n";
+		return false;
+	}
+
+	std::string line;
+	U32 lineNumber = 0;
+	while( std::getline( in, line ) )
+	{
+		lineNumber++;
+		size_t first = line.find_first_not_of( " \t\r" );
+		if( first == std::string::npos || line[first] == '#' )
+			continue;
+
+		BatchEntry entry;
+		entry.mJob.reset( new ReplayJob() );
+		entry.mJob->mThreads = 1;
+		entry.mLine = line;
+
+		std::vector<std::string> args;
+		std::string error;
+		if( !SplitArguments( line, &args ) )
+			error = "unbalanced quotes or a trailing backslash";
+		else if( !ParseReplayArguments( args, entry.mJob.get(), &error ) && error.empty() )
+			error = "missing --input, --output, --sample-rate or --clock";
+		if( !error.empty() )
+		{
+			std::cerr << path << ":" << lineNumber << ": " << error << "\n";
+			return false;
+		}
+
+		entry.mRunsScript = ReplayJobRunsScript( *entry.mJob );
+		entry.mInputBytes = InputBytes( entry.mJob->mInput );
+		entry.mStarted = false;
+		entry.mSucceeded = false;
+		entries->push_back( std::move( entry ) );
+	}
+	return true;
+}
+
+static void WriteSummary( std::ostream& out, const std::vector<BatchEntry>& entries, U32 workers, U32 scripts, double elapsedSeconds )
+{
+	U64 frames = 0;
+	U64 failed = 0;
+	double workSeconds = 0;
+	for( const BatchEntry& entry : entries )
+	{
+		if( !entry.mSucceeded )
+		{
+			failed++;
+			continue;
+		}
+		frames += entry.mResult.mFrames;
+		workSeconds += entry.mResult.mLoadSeconds + entry.mResult.mDecodeSeconds + entry.mResult.mExportSeconds;
+	}
+
+	out << "# Enrichable SPI batch summary\n";
+	out << "workers " << workers << "\n";
+	out << "script_slots " << scripts << "\n";
+	out << std::fixed << std::setprecision( 3 );
+	out << "elapsed_s " << elapsedSeconds << "\n";
+	// The time every job took, added up; with perfect scheduling the run
+	// takes this divided by the number of workers started, one per job at
+	// most.
+	out << "work_s " << workSeconds << "\n";
+	out << std::setprecision( 1 );
+	size_t started = std::min<size_t>( workers, entries.size() );
+	if( elapsedSeconds > 0 && started > 0 )
+		out << "efficiency " << 100.0 * workSeconds / ( elapsedSeconds * started ) << "%\n";
+	out << "jobs=" << entries.size() << " failed=" << failed << " frames=" << frames;
+	if( elapsedSeconds > 0 )
+		out << " frames_per_s=" << std::setprecision( 0 ) << frames / elapsedSeconds;
+	out << "\n";
+
+	for( const BatchEntry& entry : entries )
+	{
+		out << "\n" << entry.mJob->mInput << "\n";
+		if( !entry.mSucceeded )
+		{
+			out << "  status=failed error=\"" << entry.mError << "\"\n";
+			continue;
+		}
+
+		const ReplayResult& result = entry.mResult;
+		double seconds = result.mLoadSeconds + result.mDecodeSeconds + result.mExportSeconds;
+		out << "  status=ok output=" << entry.mJob->mOutput;
+		out << " bytes=" << entry.mInputBytes;
+		out << " frames=" << result.mFrames;
+		out << std::setprecision( 3 );
+		out << " load_s=" << result.mLoadSeconds;
+		out << " decode_s=" << result.mDecodeSeconds;
+		out << " export_s=" << result.mExportSeconds;
+		if( seconds > 0 )
+			out << " frames_per_s=" << std::setprecision( 0 ) << result.mFrames / seconds;
+		out << "\n";
+	}
+}
+
+int main( int argc, char** argv )
+{
+	std::string jobsFile;
+	std::string summaryFile;
+	U32 workers = std::max( 1u, std::thread::hardware_concurrency() );
+	U32 scripts = 0;
+
+	for( int i = 1; i < argc; i++ )
+	{
+		if( strcmp( argv[i], "--jobs" ) == 0 && i + 1 < argc )
+			jobsFile = argv[++i];
+		else if( strcmp( argv[i], "--workers" ) == 0 && i + 1 < argc )
+			workers = std::max( 1ul, strtoul( argv[++i], NULL, 10 ) );
+		else if( strcmp( argv[i], "--scripts" ) == 0 && i + 1 < argc )
+			scripts = std::max( 1ul, strtoul( argv[++i], NULL, 10 ) );
+		else if( strcmp( argv[i], "--summary" ) == 0 && i + 1 < argc )
+			summaryFile = argv[++i];
+		else
+		{
+			jobsFile.clear();
+			break;
+		}
+	}
+	if( jobsFile.empty() )
+	{
+		std::cerr << "usage: " << argv[0] << " --jobs FILE [--workers N] [--scripts N] [--summary FILE]\n";
+		return 2;
+	}
+	// Scripts take a core each while they work, on top of their job's.
+	if( scripts == 0 )
+		scripts = std::max( 1u, workers / 2 );
+
+	std::vector<BatchEntry> entries;
+	if( !LoadJobs( jobsFile, &entries ) )
+		return 2;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	BatchScheduler scheduler( entries, scripts );
+	std::vector<std::thread> threads;
+	for( U32 i = 0; i < std::min<size_t>( workers, entries.size() ); i++ )
+		threads.push_back( std::thread( &BatchScheduler::Worker, &scheduler ) );
+	for( std::thread& thread : threads )
+		thread.join();
+	double elapsedSeconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+
+	if( summaryFile.empty() )
+		WriteSummary( std::cout, entries, workers, scripts, elapsedSeconds );
+	else
+	{
+		std::ofstream out( summaryFile.c_str(), std::ios::trunc );
+		if( !out )
+		{
+			std::cerr << "Unable to write summary file: " << summaryFile << "\n";
+			return 1;
+		}
+		WriteSummary( out, entries, workers, scripts, elapsedSeconds );
+	}
+
+	for( const BatchEntry& entry : entries )
+		if( !entry.mSucceeded )
+			return 1;
+	return 0;
+}
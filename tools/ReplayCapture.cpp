@@ -0,0 +1,66 @@
+// Offline capture replay.
+//
+// Decodes digital data exported from Logic with the analyzer's own decoder,
+// optionally enriching it through a script, and writes the same CSV that
+// "Export as text/csv file" (or its enriched variant) produces -- without
+// Logic, as fast as the machine allows.
+//
+//   enrichable_spi_replay --input PATH --sample-rate HZ --clock N --output FILE
+//       [--mosi N] [--miso N] [--enable N] [--cpol 0|1] [--cpha 0|1]
+//       [--bits N] [--lsb-first] [--enable-active-high]
+//       [--script COMMAND] [--filter EXPR] [--enriched] [--base hex|dec|bin|ascii]
+//       [--stats FILE] [--trace FILE] [--threads N] [--sample-bytes N]
+//       [--frame-output PATH] [--frame-output-block]
+//       [--record-script FILE | --replay-script FILE] [--stream]
+//       [--script-around-trigger FROM:TO | --script-samples FIRST:LAST]
+//
+// PATH is either a Logic 2 binary export directory (digital_N.bin files) or
+// a CSV file with one row per transition.  With `--sample-bytes` it is a raw
+// file of packed samples instead, N bytes each with bit K holding channel K.
+//
+// `--record-script` saves the conversation with the script; `--replay-script`
+// answers from such a recording instead of running a script, which makes for
+// reproducible runs without the script at hand.
+//
+// `--script-around-trigger` and `--script-samples` limit the script to the
+// frames near the trigger or within a range of samples, as the "Script
+// Region" setting does.
+//
+// `--stream` maps a binary export directory into memory and writes frames
+// out as they are decoded, so captures larger than memory can be replayed.
+
+#include "ReplayJob.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+int main( int argc, char** argv )
+{
+	ReplayJob job;
+	std::vector<std::string> args( argv + 1, argv + argc );
+	std::string error;
+
+	if( !ParseReplayArguments( args, &job, &error ) )
+	{
+		if( error.empty() )
+			std::cerr << "usage: " << argv[0] << " " << REPLAY_JOB_USAGE;
+		else
+			std::cerr << error << "\n";
+		return 2;
+	}
+
+	ReplayResult result;
+	if( !RunReplayJob( &job, &result, &error ) )
+	{
+		std::cerr << error << "\n";
+		return 1;
+	}
+
+	std::cerr << result.mFrames << " frames decoded in " << result.mDecodeSeconds << " s";
+	if( result.mDecodeSeconds > 0 )
+		std::cerr << " (" << U64( result.mFrames / result.mDecodeSeconds ) << " frames/s)";
+	std::cerr << ", exported in " << result.mExportSeconds << " s\n";
+
+	return 0;
+}
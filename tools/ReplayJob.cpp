@@ -0,0 +1,307 @@
+#include "ReplayJob.h"
+
+#include <AnalyzerHelpers.h>
+#include "EnrichableSpiCaptureFile.h"
+#include "EnrichableSpiExport.h"
+#include "EnrichableSpiHeadless.h"
+#include "EnrichableSpiStreaming.h"
+#include "EnrichableAnalyzerSubprocess.h"
+#include "EnrichableFrameFilter.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+#include <sys/stat.h>
+
+const char* const REPLAY_JOB_USAGE =
+	"--input PATH --sample-rate HZ --clock N --output FILE\n"
+	"       [--mosi N] [--miso N] [--enable N] [--cpol 0|1] [--cpha 0|1]\n"
+	"       [--bits N] [--lsb-first] [--enable-active-high]\n"
+	"       [--script COMMAND] [--filter EXPR] [--enriched] [--base hex|dec|bin|ascii]\n"
+	"       [--stats FILE] [--trace FILE] [--threads N] [--sample-bytes N]\n"
+	"       [--frame-output PATH] [--frame-output-block]\n"
+	"       [--record-script FILE | --replay-script FILE] [--stream]\n"
+	"       [--script-around-trigger FROM:TO | --script-samples FIRST:LAST]\n";
+
+ReplayJob::ReplayJob()
+:	mSampleRate( 0 ),
+	mSampleBytes( 0 ),
+	mThreads( std::thread::hardware_concurrency() ),
+	mExportType( SPI_EXPORT_CSV ),
+	mDisplayBase( Hexadecimal ),
+	mStream( false )
+{
+	mSettings.mClockChannel = UNDEFINED_CHANNEL;
+}
+
+bool ParseReplayArguments( const std::vector<std::string>& args, ReplayJob* job, std::string* error )
+{
+	EnrichableSpiAnalyzerSettings& settings = job->mSettings;
+	error->clear();
+
+	for( size_t i = 0; i < args.size(); i++ )
+	{
+		const char* arg = args[i].c_str();
+		const char* value = i + 1 < args.size() ? args[i + 1].c_str() : NULL;
+		bool takesValue = true;
+
+		if( strcmp( arg, "--lsb-first" ) == 0 )
+		{
+			settings.mShiftOrder = AnalyzerEnums::LsbFirst;
+			takesValue = false;
+		}
+		else if( strcmp( arg, "--enable-active-high" ) == 0 )
+		{
+			settings.mEnableActiveState = BIT_HIGH;
+			takesValue = false;
+		}
+		else if( strcmp( arg, "--frame-output-block" ) == 0 )
+		{
+			settings.mFrameOutputPolicy = EnrichableFrameTee::BlockWhenFull;
+			takesValue = false;
+		}
+		else if( strcmp( arg, "--enriched" ) == 0 )
+		{
+			job->mExportType = SPI_EXPORT_ENRICHED_CSV;
+			takesValue = false;
+		}
+		else if( strcmp( arg, "--stream" ) == 0 )
+		{
+			job->mStream = true;
+			takesValue = false;
+		}
+		else if( value == NULL )
+			return false;
+		else if( strcmp( arg, "--input" ) == 0 )
+			job->mInput = value;
+		else if( strcmp( arg, "--output" ) == 0 )
+			job->mOutput = value;
+		else if( strcmp( arg, "--script" ) == 0 )
+			job->mScript = value;
+		else if( strcmp( arg, "--filter" ) == 0 )
+			job->mFilter = value;
+		else if( strcmp( arg, "--stats" ) == 0 )
+			job->mStatsFile = value;
+		else if( strcmp( arg, "--trace" ) == 0 )
+			job->mTraceFile = value;
+		else if( strcmp( arg, "--frame-output" ) == 0 )
+			job->mFrameOutput = value;
+		else if( strcmp( arg, "--record-script" ) == 0 )
+		{
+			job->mRecording = value;
+			settings.mScriptRecordingMode = EnrichableScriptRecording::Record;
+		}
+		else if( strcmp( arg, "--replay-script" ) == 0 )
+		{
+			job->mRecording = value;
+			settings.mScriptRecordingMode = EnrichableScriptRecording::Replay;
+		}
+		else if( strcmp( arg, "--script-around-trigger" ) == 0 || strcmp( arg, "--script-samples" ) == 0 )
+		{
+			long long first;
+			long long last;
+			char end;
+			if( sscanf( value, "%lld:%lld%c", &first, &last, &end ) != 2 || first > last )
+			{
+				*error = std::string( arg ) + " takes two sample numbers, the first no greater than the second, as FIRST:LAST";
+				return false;
+			}
+			settings.mScriptRegion = strcmp( arg, "--script-samples" ) == 0 ? ScriptRegionSampleRange : ScriptRegionAroundTrigger;
+			settings.mScriptRegionStart = first;
+			settings.mScriptRegionEnd = last;
+		}
+		else if( strcmp( arg, "--threads" ) == 0 )
+			job->mThreads = strtoul( value, NULL, 10 );
+		else if( strcmp( arg, "--sample-bytes" ) == 0 )
+			job->mSampleBytes = strtoul( value, NULL, 10 );
+		else if( strcmp( arg, "--sample-rate" ) == 0 )
+			job->mSampleRate = strtoul( value, NULL, 10 );
+		else if( strcmp( arg, "--mosi" ) == 0 )
+			settings.mMosiChannel = Channel( 0, strtoul( value, NULL, 10 ) );
+		else if( strcmp( arg, "--miso" ) == 0 )
+			settings.mMisoChannel = Channel( 0, strtoul( value, NULL, 10 ) );
+		else if( strcmp( arg, "--clock" ) == 0 )
+			settings.mClockChannel = Channel( 0, strtoul( value, NULL, 10 ) );
+		else if( strcmp( arg, "--enable" ) == 0 )
+			settings.mEnableChannel = Channel( 0, strtoul( value, NULL, 10 ) );
+		else if( strcmp( arg, "--cpol" ) == 0 )
+			settings.mClockInactiveState = atoi( value ) ? BIT_HIGH : BIT_LOW;
+		else if( strcmp( arg, "--cpha" ) == 0 )
+			settings.mDataValidEdge = atoi( value ) ? AnalyzerEnums::TrailingEdge : AnalyzerEnums::LeadingEdge;
+		else if( strcmp( arg, "--bits" ) == 0 )
+			settings.mBitsPerTransfer = strtoul( value, NULL, 10 );
+		else if( strcmp( arg, "--base" ) == 0 )
+		{
+			if( strcmp( value, "dec" ) == 0 )
+				job->mDisplayBase = Decimal;
+			else if( strcmp( value, "bin" ) == 0 )
+				job->mDisplayBase = Binary;
+			else if( strcmp( value, "ascii" ) == 0 )
+				job->mDisplayBase = ASCII;
+			else
+				job->mDisplayBase = Hexadecimal;
+		}
+		else
+		{
+			*error = std::string( "unknown option " ) + arg;
+			return false;
+		}
+
+		if( takesValue )
+			i++;
+	}
+
+	if( job->mInput.empty() || job->mOutput.empty() || job->mSampleRate == 0 || settings.mClockChannel == UNDEFINED_CHANNEL )
+		return false;
+	if( settings.mMosiChannel == UNDEFINED_CHANNEL && settings.mMisoChannel == UNDEFINED_CHANNEL )
+	{
+		*error = "Please select at least one input for either MISO or MOSI.";
+		return false;
+	}
+	if( settings.mBitsPerTransfer < 1 || settings.mBitsPerTransfer > 64 )
+	{
+		*error = "--bits must be between 1 and 64.";
+		return false;
+	}
+	if( job->mStream && job->mSampleBytes != 0 )
+	{
+		*error = "--stream reads Logic 2 binary exports, not packed samples.";
+		return false;
+	}
+	std::string filterError;
+	if( !EnrichableFrameFilter().Compile( job->mFilter, &filterError ) )
+	{
+		*error = "--filter: " + filterError;
+		return false;
+	}
+
+	settings.mParserCommand = job->mScript;
+	settings.mScriptFilter = job->mFilter;
+	settings.mStatisticsFile = job->mStatsFile;
+	settings.mTraceFile = job->mTraceFile;
+	settings.mFrameOutput = job->mFrameOutput;
+	settings.mScriptRecording = job->mRecording;
+	return true;
+}
+
+bool ReplayJobRunsScript( const ReplayJob& job )
+{
+	bool replay = !job.mRecording.empty() && job.mSettings.mScriptRecordingMode == EnrichableScriptRecording::Replay;
+	return !job.mScript.empty() && !replay;
+}
+
+bool ReplayJobIsEnriched( const ReplayJob& job )
+{
+	bool replay = !job.mRecording.empty() && job.mSettings.mScriptRecordingMode == EnrichableScriptRecording::Replay;
+	return !job.mScript.empty() || replay;
+}
+
+namespace
+{
+	// Decoding and exporting happen together, so their time is reported as
+	// decoding.
+	bool RunStreamingReplayJob( ReplayJob* job, ReplayResult* result, std::string* error )
+	{
+		EnrichableSpiAnalyzerSettings& settings = job->mSettings;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		struct stat info;
+		if( stat( job->mInput.c_str(), &info ) == 0 && !S_ISDIR( info.st_mode ) )
+		{
+			*error = "--stream reads Logic 2 binary export directories; " + job->mInput + " is not one";
+			return false;
+		}
+
+		EnrichableSpiMappedCapture capture;
+		if( !capture.Open( job->mInput, job->mSampleRate, error ) )
+			return false;
+		if( capture.GetChannel( settings.mClockChannel ) == NULL )
+		{
+			*error = "The clock channel is not present in " + job->mInput;
+			return false;
+		}
+		std::chrono::steady_clock::time_point decodeStart = std::chrono::steady_clock::now();
+
+		EnrichableAnalyzerSubprocess subprocess;
+		EnrichableSpiStreamingAnalyzer analyzer( &settings, &capture );
+		void* f = AnalyzerHelpers::StartFile( job->mOutput.c_str() );
+		analyzer.Run( &subprocess, job->mDisplayBase, job->mExportType, f );
+		AnalyzerHelpers::EndFile( f );
+		std::chrono::steady_clock::time_point decoded = std::chrono::steady_clock::now();
+		subprocess.Stop();
+
+		result->mFrames = analyzer.GetNumFrames();
+		result->mLoadSeconds = std::chrono::duration<double>( decodeStart - start ).count();
+		result->mDecodeSeconds = std::chrono::duration<double>( decoded - decodeStart ).count();
+		result->mExportSeconds = 0;
+		return true;
+	}
+}
+
+bool RunReplayJob( ReplayJob* job, ReplayResult* result, std::string* error )
+{
+	if( job->mStream )
+		return RunStreamingReplayJob( job, result, error );
+
+	EnrichableSpiAnalyzerSettings& settings = job->mSettings;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	EnrichableSpiCapture capture;
+	bool loaded;
+	if( job->mSampleBytes != 0 )
+	{
+		// Only the channels being decoded are turned into transitions.
+		U64 channelMask = 0;
+		const Channel* channels[] = { &settings.mMosiChannel, &settings.mMisoChannel, &settings.mClockChannel, &settings.mEnableChannel };
+		for( const Channel* channel : channels )
+		{
+			if( *channel != UNDEFINED_CHANNEL && channel->mChannelIndex < 64 )
+				channelMask |= 1ull << channel->mChannelIndex;
+		}
+		loaded = LoadPackedSampleFile( job->mInput, job->mSampleRate, job->mSampleBytes, channelMask, &capture, error );
+	}
+	else
+		loaded = LoadLogicExport( job->mInput, job->mSampleRate, &capture, error );
+
+	if( !loaded )
+		return false;
+	if( capture.GetChannel( settings.mClockChannel ) == NULL )
+	{
+		*error = "The clock channel is not present in " + job->mInput;
+		return false;
+	}
+	std::chrono::steady_clock::time_point decodeStart = std::chrono::steady_clock::now();
+
+	EnrichableAnalyzerSubprocess subprocess;
+	EnrichableSpiHeadlessAnalyzer analyzer( &settings, &capture );
+	analyzer.SetThreadCount( job->mThreads );
+	analyzer.Run( &subprocess );
+	std::chrono::steady_clock::time_point decoded = std::chrono::steady_clock::now();
+
+	{
+		TraceSpan span( subprocess.GetTrace(), "export" );
+		void* f = AnalyzerHelpers::StartFile( job->mOutput.c_str() );
+		WriteSpiExport(
+			&analyzer.GetResults(),
+			&settings,
+			ReplayJobIsEnriched( *job ) ? &subprocess : NULL,
+			analyzer.GetTriggerSample(),
+			analyzer.GetSampleRate(),
+			job->mDisplayBase,
+			job->mExportType,
+			f
+		);
+		AnalyzerHelpers::EndFile( f );
+	}
+	std::chrono::steady_clock::time_point exported = std::chrono::steady_clock::now();
+	subprocess.Stop();
+
+	result->mFrames = analyzer.GetResults().GetNumFrames();
+	result->mLoadSeconds = std::chrono::duration<double>( decodeStart - start ).count();
+	result->mDecodeSeconds = std::chrono::duration<double>( decoded - decodeStart ).count();
+	result->mExportSeconds = std::chrono::duration<double>( exported - decoded ).count();
+	return true;
+}
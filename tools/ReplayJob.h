@@ -0,0 +1,66 @@
+#ifndef REPLAY_JOB_H
+#define REPLAY_JOB_H
+
+#include <AnalyzerTypes.h>
+#include "EnrichableSpiAnalyzerSettings.h"
+
+#include <string>
+#include <vector>
+
+// One capture for the replay tools to decode: where it comes from, the
+// analyzer settings to decode it with and where the export goes.  The
+// settings' strings point into the job, so jobs are not copied.
+struct ReplayJob
+{
+	ReplayJob();
+
+	std::string mInput;
+	std::string mOutput;
+	std::string mScript;
+	std::string mFilter;
+	std::string mStatsFile;
+	std::string mTraceFile;
+	std::string mFrameOutput;
+	std::string mRecording;
+	U32 mSampleRate;
+	U32 mSampleBytes;
+	U32 mThreads;
+	U32 mExportType;
+	DisplayBase mDisplayBase;
+	// Decode a Logic 2 binary export in place and export frames as they are
+	// decoded, instead of loading the whole capture first.
+	bool mStream;
+	EnrichableSpiAnalyzerSettings mSettings;
+
+private:
+	ReplayJob( const ReplayJob& );
+	ReplayJob& operator=( const ReplayJob& );
+};
+
+struct ReplayResult
+{
+	U64 mFrames;
+	double mLoadSeconds;
+	double mDecodeSeconds;
+	double mExportSeconds;
+};
+
+// The options `ParseReplayArguments` accepts.
+extern const char* const REPLAY_JOB_USAGE;
+
+// Sets up `job` from `enrichable_spi_replay` command-line arguments; options
+// not given keep the job's values.  On failure it returns false and
+// describes the problem in `error`, which is left empty when the arguments
+// are simply incomplete.
+bool ParseReplayArguments( const std::vector<std::string>& args, ReplayJob* job, std::string* error );
+
+// Whether running `job` starts an enrichment script.
+bool ReplayJobRunsScript( const ReplayJob& job );
+// Whether `job` is enriched, by a script or from a recording.
+bool ReplayJobIsEnriched( const ReplayJob& job );
+
+// Loads, decodes and exports the capture.  On failure it returns false and
+// describes the problem in `error`.
+bool RunReplayJob( ReplayJob* job, ReplayResult* result, std::string* error );
+
+#endif //REPLAY_JOB_H